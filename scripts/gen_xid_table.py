@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+# 生成 src/util/xid_table.h
+# XID_Start / XID_Continue 取自 Python 的 str.isidentifier(), 其 Unicode 版本即表中记录的版本
+#
+# 用法: python3 scripts/gen_xid_table.py > src/util/xid_table.h
+
+import unicodedata
+
+BLOCK = 128
+LIMIT = 0x40000
+
+
+def bitmap(flags):
+    words = []
+    for w in range(0, BLOCK, 64):
+        value = 0
+        for bit in range(64):
+            if flags[w + bit]:
+                value |= 1 << bit
+        words.append(value)
+    return words
+
+
+def main():
+    start = [chr(c).isidentifier() for c in range(LIMIT)]
+    cont = [('a' + chr(c)).isidentifier() for c in range(LIMIT)]
+
+    index = []
+    blocks = {}
+    for b in range(LIMIT // BLOCK):
+        lo, hi = b * BLOCK, (b + 1) * BLOCK
+        key = tuple(bitmap(start[lo:hi]) + bitmap(cont[lo:hi]))
+        index.append(blocks.setdefault(key, len(blocks)))
+
+    assert len(blocks) <= 256
+
+    print('#pragma once')
+    print()
+    print('// Generated by scripts/gen_xid_table.py, do not edit')
+    print(f'// Unicode {unicodedata.unidata_version}')
+    print()
+    print('#include <cstdint>')
+    print()
+    print('namespace rain::detail {')
+    print(f'    // 码点 < 0x{LIMIT:X} 时, 第 cp / {BLOCK} 块在 xid_blocks 中的下标')
+    print(f'    inline constexpr uint8_t xid_index[{len(index)}] = {{')
+    for i in range(0, len(index), 16):
+        print('        ' + ', '.join(f'{v:3}' for v in index[i:i + 16]) + ',')
+    print('    };')
+    print()
+    print(f'    // 每块 {BLOCK} 个码点, 依次为 XID_Start 与 XID_Continue 的位图')
+    print('    struct XidBlock {')
+    print(f'        uint64_t start[{BLOCK // 64}];')
+    print(f'        uint64_t cont[{BLOCK // 64}];')
+    print('    };')
+    print()
+    print(f'    inline constexpr XidBlock xid_blocks[{len(blocks)}] = {{')
+    for key in blocks:
+        half = BLOCK // 64
+        s = ', '.join(f'0x{w:016x}' for w in key[:half])
+        c = ', '.join(f'0x{w:016x}' for w in key[half:])
+        print(f'        {{{{{s}}}, {{{c}}}}},')
+    print('    };')
+    print('}')
+
+
+if __name__ == '__main__':
+    main()
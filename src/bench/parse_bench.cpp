@@ -0,0 +1,243 @@
+#include "parser/syntax.h"
+#include "parser/ast_visitor.h"
+
+#include <chrono>
+#include <iostream>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// 在形状可控的生成输入上测量 ExprNode::parse
+// 结果以 JSON 输出到标准输出, 便于跟踪回归
+//
+//   Rain_parsebench [--size=N] [--repeat=R]
+//
+// size 为每种输入的规模 (项数或嵌套层数), 每种输入解析 repeat 次, 取最快的一次
+
+using namespace rain;
+
+// a0 + a1 + a2 ..., 全部落在 AddExprNode 的 ClosureNode 中
+static std::string __flat_source__(size_t size) {
+    std::string source = "a0";
+    for (size_t i = 1 ; i < size ; i ++) {
+        source += std::format(" + a{}", i);
+    }
+    return source;
+}
+
+// ((((x)))), 每一层都是一次 PrimaryExprNode -> ExprNode 的递归
+static std::string __deep_source__(size_t size) {
+    return std::string(size, '(') + "x" + std::string(size, ')');
+}
+
+// a * b + c / d - e % f ..., 两层优先级交替, 间或加括号
+static std::string __mixed_source__(size_t size) {
+    static const char *ops[] = {" * ", " + ", " / ", " - ", " % ", " + "};
+    std::string source = "v0";
+    for (size_t i = 1 ; i < size ; i ++) {
+        source += ops[i % 6];
+        source += (i % 7 == 0) ? std::format("(v{} - {})", i, i % 10) : std::format("v{}", i);
+    }
+    return source;
+}
+
+// 依次使用 LiteralNode 的七个候选, 越靠后的候选回溯越多
+static std::string __literal_source__(size_t size) {
+    static const char *literals[] = {"12", "0x1f", "017", "0b101", "2.5", "\"str\"", "'c'"};
+    std::string source = literals[0];
+    for (size_t i = 1 ; i < size ; i ++) {
+        source += (i % 2 == 0) ? " + " : " * ";
+        source += literals[i % 7];
+    }
+    return source;
+}
+
+struct __node_counter__ {
+    size_t count = 0;
+
+    template<typename Node>
+    void pre(const Node *node, size_t depth) {
+        count ++;
+    }
+};
+
+struct __bench_result__ {
+    const char *shape;
+    size_t tokens = 0;
+    size_t nodes = 0;
+    double seconds = 0;
+    size_t allocations = 0;
+    size_t stack_bytes = 0;
+    long peak_rss_kb = 0;
+    bool success = false;
+};
+
+// 在自备的栈上运行 parse, 栈由 mmap 分配, 只有用到的页才会驻留
+// 之后用 mincore 从栈底找第一个驻留的页, 得到栈的最大使用量 (按页取整), 而不会像预先填充那样抬高 RSS
+static constexpr size_t __stack_size__ = 256 << 20;
+
+struct __parse_job__ {
+    const std::vector<Token *> *tokens;
+    size_t repeat;
+    __bench_result__ *result;
+};
+
+static void *__parse_thread__(void *arg) {
+    __parse_job__ &job = *static_cast<__parse_job__ *>(arg);
+    __bench_result__ &result = *job.result;
+
+    for (size_t i = 0 ; i < job.repeat ; i ++) {
+        TokenStream stream(*job.tokens);
+        size_t news = mem::Accounting::phase(mem::Phase::PARSE).news;
+
+        auto begin = std::chrono::steady_clock::now();
+        auto res = [&]() {
+            RAIN_MEM_PHASE(PARSE);
+            return ExprNode::parse(stream.begin(), stream.end());
+        }();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        result.success = res.success && (*res.end)->type == TokenType::ENDMARK;
+        if (res.success) {
+            __node_counter__ counter;
+            walk_iterative(static_cast<const ExprNode *>(res.val), counter);
+            result.nodes = counter.count;
+            destroy_tree(res.val);
+        }
+        if (i == 0 || seconds < result.seconds) {
+            result.seconds = seconds;
+            result.allocations = mem::Accounting::phase(mem::Phase::PARSE).news - news;
+        }
+    }
+    return nullptr;
+}
+
+static __bench_result__ __run__(const char *shape, const std::string &source, size_t repeat) {
+    __bench_result__ result;
+    result.shape = shape;
+
+    Lexer lexer(bytebuffer(source), shape);
+    lexer.produce_all();
+    result.tokens = lexer.token_sequence.size();
+
+    void *stack = mmap(nullptr, __stack_size__, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (stack == MAP_FAILED) {
+        return result;
+    }
+    __parse_job__ job{&lexer.token_sequence, repeat, &result};
+
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, __stack_size__);
+    bool started = pthread_create(&thread, &attr, __parse_thread__, &job) == 0;
+    pthread_attr_destroy(&attr);
+    if (started) {
+        pthread_join(thread, nullptr);
+
+        // 栈向低地址增长, 第一个驻留的页即最深处
+        size_t page = sysconf(_SC_PAGESIZE);
+        std::vector<unsigned char> resident(__stack_size__ / page);
+        if (mincore(stack, __stack_size__, resident.data()) == 0) {
+            size_t lowest = 0;
+            while (lowest < resident.size() && ! (resident[lowest] & 1)) {
+                lowest ++;
+            }
+            result.stack_bytes = (resident.size() - lowest) * page;
+        }
+    }
+    munmap(stack, __stack_size__);
+    return result;
+}
+
+// 每种输入在单独的子进程中生成并运行, 峰值 RSS 取自子进程的 rusage
+// 同一进程中的 getrusage 只能得到整个进程的最高值, 之后的输入都会报告之前最大的那个
+static __bench_result__ __run_isolated__(const char *shape, std::string (*generate)(size_t), size_t size, size_t repeat) {
+    __bench_result__ result;
+    result.shape = shape;
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return result;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return result;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        __bench_result__ child = __run__(shape, generate(size), repeat);
+        bool written = write(fds[1], &child, sizeof(child)) == sizeof(child);
+        _exit(written ? 0 : 1);
+    }
+
+    close(fds[1]);
+    __bench_result__ child;
+    bool received = read(fds[0], &child, sizeof(child)) == sizeof(child);
+    close(fds[0]);
+
+    int status;
+    rusage usage;
+    // 子进程异常退出 (例如栈溢出) 时 success 保持 false
+    if (wait4(pid, &status, 0, &usage) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0 && received) {
+        result = child;
+        result.peak_rss_kb = usage.ru_maxrss;
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    size_t size = 100000;
+    size_t repeat = 5;
+    for (int i = 1 ; i < argc ; i ++) {
+        std::string_view arg = argv[i];
+        if (arg.starts_with("--size=")) {
+            size = std::stoul(std::string(arg.substr(strlen("--size="))));
+        }
+        else if (arg.starts_with("--repeat=")) {
+            repeat = std::max(1ul, std::stoul(std::string(arg.substr(strlen("--repeat=")))));
+        }
+        else {
+            std::cerr << "usage: Rain_parsebench [--size=N] [--repeat=R]" << std::endl;
+            return 2;
+        }
+    }
+
+    // 每层括号约消耗 1KB 栈, 深度单独限制在 __stack_size__ 以内
+    struct {
+        const char *shape;
+        std::string (*generate)(size_t);
+        size_t size;
+    } inputs[] = {
+        {"flat", __flat_source__, size},
+        {"deep", __deep_source__, std::min<size_t>(size, 100000)},
+        {"mixed", __mixed_source__, size},
+        {"literal", __literal_source__, size},
+    };
+
+    bool ok = true;
+    std::string out = std::format("{{\n  \"size\": {},\n  \"repeat\": {},\n  \"benchmarks\": [\n", size, repeat);
+    for (size_t i = 0 ; i < std::size(inputs) ; i ++) {
+        __bench_result__ r = __run_isolated__(inputs[i].shape, inputs[i].generate, inputs[i].size, repeat);
+        ok &= r.success;
+        out += std::format("    {{\"shape\": \"{}\", \"success\": {}, \"tokens\": {}, \"nodes\": {}, \"seconds\": {:.6f}, "
+                           "\"tokens_per_sec\": {:.0f}, \"nodes_per_sec\": {:.0f}, \"allocs_per_node\": {:.3f}, "
+                           "\"max_stack_bytes\": {}, \"peak_rss_kb\": {}}}{}\n",
+                           r.shape, r.success ? "true" : "false", r.tokens, r.nodes, r.seconds,
+                           r.seconds > 0 ? r.tokens / r.seconds : 0.0,
+                           r.seconds > 0 ? r.nodes / r.seconds : 0.0,
+                           r.nodes > 0 ? static_cast<double>(r.allocations) / r.nodes : 0.0,
+                           r.stack_bytes, r.peak_rss_kb,
+                           i + 1 < std::size(inputs) ? "," : "");
+    }
+    out += "  ]\n}\n";
+    std::cout << out;
+
+    Token::pool.cleanup();
+    PosInfo::pool.cleanup();
+    return ok ? 0 : 1;
+}
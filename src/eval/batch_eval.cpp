@@ -0,0 +1,229 @@
+#include "eval/batch_eval.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace rain;
+
+// 该行还没有出错时记录 code, 每行只保留第一个错误, 与逐行求值一致
+static inline EvalStatus __record__(EvalStatus current, bool failed, EvalStatus code) {
+    return (current == EvalStatus::OK && failed) ? code : current;
+}
+
+// 以下各内核都写成不含分支的逐元素循环, r 可能与 a 指向同一块
+template<TokenType Op>
+static void __int_kernel__(const int64_t *a, const int64_t *b, int64_t *r, EvalStatus *st, size_t n) {
+    for (size_t j = 0 ; j < n ; j ++) {
+        int64_t x = a[j], y = b[j], v;
+        if constexpr (Op == TokenType::SIGN_ADD) {
+            bool overflow = __builtin_add_overflow(x, y, &v);
+            st[j] = __record__(st[j], overflow, EvalStatus::INT_OVERFLOW);
+        }
+        else if constexpr (Op == TokenType::SIGN_SUB) {
+            bool overflow = __builtin_sub_overflow(x, y, &v);
+            st[j] = __record__(st[j], overflow, EvalStatus::INT_OVERFLOW);
+        }
+        else if constexpr (Op == TokenType::SIGN_MUL) {
+            bool overflow = __builtin_mul_overflow(x, y, &v);
+            st[j] = __record__(st[j], overflow, EvalStatus::INT_OVERFLOW);
+        }
+        else if constexpr (Op == TokenType::SIGN_DIV) {
+            // 出错的行换成除以 1, 避免触发硬件异常
+            bool zero = y == 0;
+            bool overflow = x == INT64_MIN && y == -1;
+            v = x / ((zero || overflow) ? 1 : y);
+            st[j] = __record__(st[j], zero, EvalStatus::DIV_BY_ZERO);
+            st[j] = __record__(st[j], overflow, EvalStatus::INT_OVERFLOW);
+        }
+        else {
+            // x % -1 恒为 0, 同样换成对 1 取模
+            bool zero = y == 0;
+            v = x % ((zero || y == -1) ? 1 : y);
+            st[j] = __record__(st[j], zero, EvalStatus::DIV_BY_ZERO);
+        }
+        r[j] = v;
+    }
+}
+
+template<TokenType Op>
+static void __float_kernel__(const double *a, const double *b, double *r, size_t n) {
+    for (size_t j = 0 ; j < n ; j ++) {
+        if constexpr (Op == TokenType::SIGN_ADD) r[j] = a[j] + b[j];
+        else if constexpr (Op == TokenType::SIGN_SUB) r[j] = a[j] - b[j];
+        else if constexpr (Op == TokenType::SIGN_MUL) r[j] = a[j] * b[j];
+        else if constexpr (Op == TokenType::SIGN_DIV) r[j] = a[j] / b[j];
+        else r[j] = std::fmod(a[j], b[j]);
+    }
+}
+
+static void __int_step__(TokenType op, const int64_t *a, const int64_t *b, int64_t *r, EvalStatus *st, size_t n) {
+    switch (op) {
+    case TokenType::SIGN_ADD: __int_kernel__<TokenType::SIGN_ADD>(a, b, r, st, n); break;
+    case TokenType::SIGN_SUB: __int_kernel__<TokenType::SIGN_SUB>(a, b, r, st, n); break;
+    case TokenType::SIGN_MUL: __int_kernel__<TokenType::SIGN_MUL>(a, b, r, st, n); break;
+    case TokenType::SIGN_DIV: __int_kernel__<TokenType::SIGN_DIV>(a, b, r, st, n); break;
+    default:                  __int_kernel__<TokenType::SIGN_MOD>(a, b, r, st, n); break;
+    }
+}
+
+static void __float_step__(TokenType op, const double *a, const double *b, double *r, size_t n) {
+    switch (op) {
+    case TokenType::SIGN_ADD: __float_kernel__<TokenType::SIGN_ADD>(a, b, r, n); break;
+    case TokenType::SIGN_SUB: __float_kernel__<TokenType::SIGN_SUB>(a, b, r, n); break;
+    case TokenType::SIGN_MUL: __float_kernel__<TokenType::SIGN_MUL>(a, b, r, n); break;
+    case TokenType::SIGN_DIV: __float_kernel__<TokenType::SIGN_DIV>(a, b, r, n); break;
+    default:                  __float_kernel__<TokenType::SIGN_MOD>(a, b, r, n); break;
+    }
+}
+
+static const TokenType __operators__[] = {
+    TokenType::SIGN_ADD, TokenType::SIGN_SUB, TokenType::SIGN_MUL, TokenType::SIGN_DIV, TokenType::SIGN_MOD
+};
+
+EvalStatus BatchEvaluator::prepare(const Program &program, const std::vector<Value::Kind> &kinds) {
+    steps.clear();
+    registers = program.registers;
+
+    // 模拟执行一遍, 记录每个寄存器当前保存的是什么
+    std::vector<Operand> regs(registers);
+    auto operand = [&](uint8_t suffix, uint32_t index, Operand &out) {
+        switch (suffix) {
+        case Operand::REGISTER:
+            out = regs[index];
+            return true;
+        case Operand::CONSTANT:
+            out = {Operand::CONSTANT, program.constants[index].kind, index};
+            return true;
+        default:
+            if (index >= kinds.size()) {
+                return false;
+            }
+            out = {Operand::SLOT, kinds[index], index};
+            return true;
+        }
+    };
+
+    for (const Instruction &ins : program.code) {
+        switch (ins.op) {
+        case OpCode::LOADK:
+            operand(Operand::CONSTANT, ins.b, regs[ins.dst]);
+            break;
+        case OpCode::LOADS:
+            if (! operand(Operand::SLOT, ins.b, regs[ins.dst])) {
+                return EvalStatus::UNBOUND;
+            }
+            break;
+        case OpCode::RET:
+            result = regs[ins.dst];
+            break;
+        default: {
+            // 与 bytecode.cpp 中的编码一致: ADD_RR 起每个运算符占 RR, RK, RS 三个
+            size_t code = static_cast<size_t>(ins.op) - static_cast<size_t>(OpCode::ADD_RR);
+            Step step;
+            step.op = __operators__[code / 3];
+            step.dst = ins.dst;
+            step.a = regs[ins.a];
+            if (! operand(code % 3, ins.b, step.b)) {
+                return EvalStatus::UNBOUND;
+            }
+            step.kind = (step.a.kind == Value::INT && step.b.kind == Value::INT) ? Value::INT : Value::FLOAT;
+            steps.push_back(step);
+            regs[ins.dst] = {Operand::REGISTER, step.kind, ins.dst};
+            break;
+        }
+        }
+    }
+
+    // 常量放在寄存器之后, 广播为整块
+    size_t blocks = registers + program.constants.size();
+    int_blocks.assign(blocks * BLOCK, 0);
+    float_blocks.assign(blocks * BLOCK, 0.0);
+    promoted.assign(2 * BLOCK, 0.0);
+    for (size_t i = 0 ; i < program.constants.size() ; i ++) {
+        const Value &k = program.constants[i];
+        if (k.kind == Value::INT) {
+            std::fill_n(int_blocks.data() + (registers + i) * BLOCK, BLOCK, k.i);
+        } else {
+            std::fill_n(float_blocks.data() + (registers + i) * BLOCK, BLOCK, k.f);
+        }
+    }
+    return EvalStatus::OK;
+}
+
+const void *BatchEvaluator::resolve(const Operand &operand, const Column *columns, size_t row) {
+    switch (operand.source) {
+    case Operand::SLOT:
+        if (operand.kind == Value::INT) {
+            return static_cast<const int64_t *>(columns[operand.index].data) + row;
+        }
+        return static_cast<const double *>(columns[operand.index].data) + row;
+    case Operand::REGISTER:
+        if (operand.kind == Value::INT) {
+            return int_blocks.data() + operand.index * BLOCK;
+        }
+        return float_blocks.data() + operand.index * BLOCK;
+    default:
+        if (operand.kind == Value::INT) {
+            return int_blocks.data() + (registers + operand.index) * BLOCK;
+        }
+        return float_blocks.data() + (registers + operand.index) * BLOCK;
+    }
+}
+
+void BatchEvaluator::run_blocks(const Column *columns, size_t rows, void *out, EvalStatus *status) {
+    std::fill_n(status, rows, EvalStatus::OK);
+
+    for (size_t row = 0 ; row < rows ; row += BLOCK) {
+        size_t n = std::min(BLOCK, rows - row);
+        EvalStatus *st = status + row;
+
+        for (const Step &step : steps) {
+            const void *a = resolve(step.a, columns, row);
+            const void *b = resolve(step.b, columns, row);
+
+            if (step.kind == Value::INT) {
+                int64_t *r = int_blocks.data() + step.dst * BLOCK;
+                __int_step__(step.op, static_cast<const int64_t *>(a), static_cast<const int64_t *>(b), r, st, n);
+                continue;
+            }
+
+            // 混合运算时整数一侧先提升为浮点数
+            const double *fa = static_cast<const double *>(a);
+            const double *fb = static_cast<const double *>(b);
+            if (step.a.kind == Value::INT) {
+                const int64_t *ia = static_cast<const int64_t *>(a);
+                for (size_t j = 0 ; j < n ; j ++) {
+                    promoted[j] = static_cast<double>(ia[j]);
+                }
+                fa = promoted.data();
+            }
+            if (step.b.kind == Value::INT) {
+                const int64_t *ib = static_cast<const int64_t *>(b);
+                for (size_t j = 0 ; j < n ; j ++) {
+                    promoted[BLOCK + j] = static_cast<double>(ib[j]);
+                }
+                fb = promoted.data() + BLOCK;
+            }
+            __float_step__(step.op, fa, fb, float_blocks.data() + step.dst * BLOCK, n);
+        }
+
+        static_assert(sizeof(int64_t) == sizeof(double));
+        memcpy(static_cast<char *>(out) + row * sizeof(int64_t), resolve(result, columns, row), n * sizeof(int64_t));
+    }
+}
+
+bool BatchEvaluator::run(const Column *columns, size_t rows, int64_t *out, EvalStatus *status) {
+    if (result.kind != Value::INT) {
+        return false;
+    }
+    run_blocks(columns, rows, out, status);
+    return true;
+}
+
+bool BatchEvaluator::run(const Column *columns, size_t rows, double *out, EvalStatus *status) {
+    if (result.kind != Value::FLOAT) {
+        return false;
+    }
+    run_blocks(columns, rows, out, status);
+    return true;
+}
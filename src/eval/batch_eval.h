@@ -0,0 +1,77 @@
+#pragma once
+
+#include "eval/bytecode.h"
+
+namespace rain {
+    // 一列变量值, 同一列中所有行的类型相同
+    struct Column {
+        Value::Kind kind;
+        const void *data;
+
+        static Column of(const int64_t *data) {
+            return {Value::INT, data};
+        }
+
+        static Column of(const double *data) {
+            return {Value::FLOAT, data};
+        }
+    };
+
+    // 列式批量求值
+    //
+    // 对同一个表达式的多组绑定求值, 每个变量槽位对应一列, 每次处理 BLOCK 行
+    // 由于每列的类型固定, 每条指令的操作数类型在 prepare 时即可确定, 运算按块在连续的数组上进行, 便于编译器自动向量化
+    // 每一行有独立的状态, 除以 0 或溢出只影响该行, 状态与逐行调用 Program::run 的结果相同
+    //
+    // LOADK 与 LOADS 不产生运算, 只让寄存器指向常量块或列; 块缓冲区在 prepare 时分配, run 时不再分配内存
+    class BatchEvaluator {
+    public:
+        static constexpr size_t BLOCK = 1024;
+
+        // 按各列的类型准备 program, kinds[slot] 为槽位 slot 的列的类型
+        EvalStatus prepare(const Program &program, const std::vector<Value::Kind> &kinds);
+
+        // 结果列的类型, prepare 之后有效
+        [[nodiscard]] Value::Kind result_kind() const {
+            return result.kind;
+        }
+
+        // columns[slot] 为槽位 slot 的列, 各有 rows 行, 类型须与 prepare 时相同
+        // 结果写入 out, status[row] 为每一行的状态, 不为 OK 的行的结果未定义
+        // out 的类型与 result_kind() 不符时返回 false
+        bool run(const Column *columns, size_t rows, int64_t *out, EvalStatus *status);
+        bool run(const Column *columns, size_t rows, double *out, EvalStatus *status);
+
+    private:
+        struct Operand {
+            enum Source : uint8_t {
+                REGISTER = 0,
+                CONSTANT = 1,
+                SLOT     = 2
+            } source;
+            Value::Kind kind;
+            uint32_t index;
+        };
+
+        struct Step {
+            TokenType op;
+            Value::Kind kind;   // 运算的类型, 操作数类型不同时整数一侧先转换为浮点数
+            uint8_t dst;
+            Operand a;
+            Operand b;
+        };
+
+        std::vector<Step> steps;
+        Operand result = {};
+
+        // 每个寄存器与常量各占一块, 整数与浮点数分开存放
+        std::vector<int64_t> int_blocks;
+        std::vector<double> float_blocks;
+        size_t registers = 0;
+        // 整数操作数提升为浮点数时使用的两块
+        std::vector<double> promoted;
+
+        void run_blocks(const Column *columns, size_t rows, void *out, EvalStatus *status);
+        const void *resolve(const Operand &operand, const Column *columns, size_t row);
+    };
+}
@@ -0,0 +1,246 @@
+#include "eval/bytecode.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+using namespace rain;
+
+#if defined(__GNUC__) && ! defined(RAIN_VM_SWITCH_DISPATCH)
+#define RAIN_VM_COMPUTED_GOTO
+#endif
+
+const char *rain::to_string(OpCode op) noexcept {
+    switch (op) {
+#define RAIN_OPCODE_NAME(name) case OpCode::name: return #name;
+        RAIN_OPCODES(RAIN_OPCODE_NAME)
+#undef RAIN_OPCODE_NAME
+    }
+    return "<unknown>";
+}
+
+// 操作数为字面量或标识符时直接编码进指令, 不占用寄存器
+struct __operand__ {
+    enum Kind {
+        REGISTER = 0,
+        CONSTANT = 1,
+        SLOT     = 2
+    } kind;
+    uint32_t index;
+};
+
+static constexpr uint8_t __opcode_base__(TokenType op) {
+    switch (op) {
+    case TokenType::SIGN_ADD: return static_cast<uint8_t>(OpCode::ADD_RR);
+    case TokenType::SIGN_SUB: return static_cast<uint8_t>(OpCode::SUB_RR);
+    case TokenType::SIGN_MUL: return static_cast<uint8_t>(OpCode::MUL_RR);
+    case TokenType::SIGN_DIV: return static_cast<uint8_t>(OpCode::DIV_RR);
+    default:                  return static_cast<uint8_t>(OpCode::MOD_RR);
+    }
+}
+
+struct __compiler__ {
+    SlotMap &slots;
+    Program &program;
+    EvalStatus status = EvalStatus::OK;
+    // 常量去重, 以 (类型, 位模式) 为键
+    std::unordered_map<uint64_t, uint32_t> constant_index[2];
+
+    void emit(OpCode op, size_t dst, size_t a, uint32_t b) {
+        program.code.push_back({op, static_cast<uint8_t>(dst), static_cast<uint8_t>(a), 0, b});
+    }
+
+    bool reserve(size_t reg) {
+        if (reg >= Program::MAX_REGISTERS) {
+            status = EvalStatus::UNSUPPORTED;
+            return false;
+        }
+        program.registers = std::max(program.registers, reg + 1);
+        return true;
+    }
+
+    uint32_t constant(Value value) {
+        uint64_t bits;
+        memcpy(&bits, &value.i, sizeof(bits));
+        auto [it, inserted] = constant_index[value.kind].emplace(bits, program.constants.size());
+        if (inserted) {
+            program.constants.push_back(value);
+        }
+        return it->second;
+    }
+
+    // 若 node 可以直接作为操作数则填入 operand
+    bool leaf(const PrimaryExprNode *node, __operand__ &operand) {
+        if (node->index() == 0) {
+            const Token *tok = std::visit([](auto *terminal) {
+                return terminal->token();
+            }, std::get<0>(node->child())->child());
+
+            Value value;
+            EvalStatus res = parse_literal(tok, value);
+            if (res != EvalStatus::OK) {
+                status = res;
+                value = Value::of(static_cast<int64_t>(0));
+            }
+            operand = {__operand__::CONSTANT, constant(value)};
+            return true;
+        }
+        if (node->index() == 1) {
+            uint32_t slot = slots.intern(std::get<1>(node->child())->token()->content);
+            program.slot_count = std::max(program.slot_count, static_cast<size_t>(slot) + 1);
+            operand = {__operand__::SLOT, slot};
+            return true;
+        }
+        return false;
+    }
+
+    bool leaf(const MulExprNode *node, __operand__ &operand) {
+        return std::get<1>(node->children())->children().empty() && leaf(std::get<0>(node->children()), operand);
+    }
+
+    void compile(const PrimaryExprNode *node, size_t dst) {
+        __operand__ operand;
+        if (! leaf(node, operand)) {
+            compile(std::get<1>(std::get<2>(node->child())->children()), dst);
+            return;
+        }
+        emit(operand.kind == __operand__::CONSTANT ? OpCode::LOADK : OpCode::LOADS, dst, 0, operand.index);
+    }
+
+    void compile(const MulExprNode *node, size_t dst) {
+        compile_chain(node, dst);
+    }
+
+    void compile(const ExprNode *node, size_t dst) {
+        compile_chain(node, dst);
+    }
+
+    // dst = head; dst = dst op operand; ...
+    template<typename Chain>
+    void compile_chain(const Chain *node, size_t dst) {
+        if (! reserve(dst)) {
+            return;
+        }
+
+        const auto &[head, tail] = node->children();
+        compile(head, dst);
+
+        for (const auto *step : tail->children()) {
+            TokenType op = std::visit([](auto *terminal) {
+                return terminal->token()->type;
+            }, std::get<0>(step->children())->child());
+
+            __operand__ operand;
+            if (! leaf(std::get<1>(step->children()), operand)) {
+                if (! reserve(dst + 1)) {
+                    return;
+                }
+                compile(std::get<1>(step->children()), dst + 1);
+                operand = {__operand__::REGISTER, static_cast<uint32_t>(dst + 1)};
+            }
+            emit(static_cast<OpCode>(__opcode_base__(op) + operand.kind), dst, dst, operand.index);
+        }
+    }
+};
+
+EvalStatus rain::compile(const ExprNode *root, SlotMap &slots, Program &out) {
+    out = Program();
+    __compiler__ compiler{slots, out};
+    compiler.compile(root, 0);
+    compiler.emit(OpCode::RET, 0, 0, 0);
+    return compiler.status;
+}
+
+EvalStatus Program::run(std::span<const Value> values, Value &out) const {
+    return execute(code.data(), constants.data(), slot_count, values, out);
+}
+
+EvalStatus Program::execute(const Instruction *code, const Value *constants, size_t slot_count, std::span<const Value> bindings, Value &out) {
+    if (bindings.size() < slot_count) {
+        return EvalStatus::UNBOUND;
+    }
+
+    Value regs[MAX_REGISTERS];
+    const Value *values = bindings.data();
+    const Instruction *ip = code;
+    const Value *k = constants;
+    EvalStatus status;
+
+#ifdef RAIN_VM_COMPUTED_GOTO
+    static const void *labels[] = {
+#define RAIN_OPCODE_LABEL(name) &&op_##name,
+        RAIN_OPCODES(RAIN_OPCODE_LABEL)
+#undef RAIN_OPCODE_LABEL
+    };
+#define VM_CASE(name) op_##name:
+#define VM_NEXT() goto *labels[static_cast<size_t>((++ ip)->op)]
+    goto *labels[static_cast<size_t>(ip->op)];
+#else
+#define VM_CASE(name) case OpCode::name:
+#define VM_NEXT() ++ ip; continue
+    for (;;) {
+    switch (ip->op) {
+#endif
+
+#define VM_BINARY(name, sign, rhs)                                          \
+    VM_CASE(name)                                                           \
+        status = apply_binary(TokenType::sign, regs[ip->a], rhs, regs[ip->dst]); \
+        if (status != EvalStatus::OK) {                                     \
+            return status;                                                  \
+        }                                                                   \
+        VM_NEXT();
+
+#define VM_ARITH(op, sign)                          \
+    VM_BINARY(op##_RR, sign, regs[ip->b])           \
+    VM_BINARY(op##_RK, sign, k[ip->b])              \
+    VM_BINARY(op##_RS, sign, values[ip->b])
+
+    VM_CASE(LOADK)
+        regs[ip->dst] = k[ip->b];
+        VM_NEXT();
+    VM_CASE(LOADS)
+        regs[ip->dst] = values[ip->b];
+        VM_NEXT();
+
+    VM_ARITH(ADD, SIGN_ADD)
+    VM_ARITH(SUB, SIGN_SUB)
+    VM_ARITH(MUL, SIGN_MUL)
+    VM_ARITH(DIV, SIGN_DIV)
+    VM_ARITH(MOD, SIGN_MOD)
+
+    VM_CASE(RET)
+        out = regs[ip->dst];
+        return EvalStatus::OK;
+
+#ifndef RAIN_VM_COMPUTED_GOTO
+    }
+    }
+#endif
+
+#undef VM_ARITH
+#undef VM_BINARY
+#undef VM_NEXT
+#undef VM_CASE
+}
+
+std::string Program::dump(const SlotMap &slots) const {
+    std::string text = std::format("; {} registers, {} constants\n", registers, constants.size());
+
+    for (size_t i = 0 ; i < code.size() ; i ++) {
+        const Instruction &ins = code[i];
+        text += std::format("{:4}  {:<7} r{}", i, to_string(ins.op), ins.dst);
+
+        if (ins.op == OpCode::LOADK) {
+            text += std::format(", {}", constants[ins.b].repr());
+        } else if (ins.op == OpCode::LOADS) {
+            text += std::format(", {}", slots.name(ins.b));
+        } else if (ins.op != OpCode::RET) {
+            switch ((static_cast<uint8_t>(ins.op) - static_cast<uint8_t>(OpCode::ADD_RR)) % 3) {
+            case __operand__::REGISTER: text += std::format(", r{}, r{}", ins.a, ins.b); break;
+            case __operand__::CONSTANT: text += std::format(", r{}, {}", ins.a, constants[ins.b].repr()); break;
+            default:                    text += std::format(", r{}, {}", ins.a, slots.name(ins.b)); break;
+            }
+        }
+        text += "\n";
+    }
+    return text;
+}
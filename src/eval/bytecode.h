@@ -0,0 +1,69 @@
+#pragma once
+
+#include "parser/syntax.h"
+#include "eval/value.h"
+#include "eval/slot_map.h"
+
+#include <span>
+
+namespace rain {
+    // 基于寄存器的表达式字节码
+    //
+    // 每条指令为 dst = a op b, 其中 a 为寄存器, b 按后缀区分:
+    //   _RR  b 为寄存器
+    //   _RK  b 为常量池下标
+    //   _RS  b 为变量槽位
+    // 语法树按左结合顺序编译, 寄存器个数等于括号嵌套深度加一
+
+#define RAIN_OPCODES(X)             \
+    X(LOADK)    X(LOADS)            \
+    X(ADD_RR)   X(ADD_RK)   X(ADD_RS)   \
+    X(SUB_RR)   X(SUB_RK)   X(SUB_RS)   \
+    X(MUL_RR)   X(MUL_RK)   X(MUL_RS)   \
+    X(DIV_RR)   X(DIV_RK)   X(DIV_RS)   \
+    X(MOD_RR)   X(MOD_RK)   X(MOD_RS)   \
+    X(RET)
+
+    enum class OpCode : uint8_t {
+#define RAIN_OPCODE_ENUM(name) name,
+        RAIN_OPCODES(RAIN_OPCODE_ENUM)
+#undef RAIN_OPCODE_ENUM
+    };
+
+    const char *to_string(OpCode op) noexcept;
+
+    struct Instruction {
+        OpCode op;
+        uint8_t dst;
+        uint8_t a;
+        uint8_t reserved;
+        uint32_t b;
+    };
+
+    static_assert(sizeof(Instruction) == 8);
+
+    class Program {
+    public:
+        static constexpr size_t MAX_REGISTERS = 256;
+
+        std::vector<Instruction> code;
+        std::vector<Value> constants;
+        size_t registers = 0;
+        // 用到的最大槽位加一
+        size_t slot_count = 0;
+
+        // values 按 compile 时 SlotMap 分配的槽位排列, 个数少于 slot_count 时返回 UNBOUND
+        EvalStatus run(std::span<const Value> values, Value &out) const;
+
+        // 执行任意存储中的指令, 供编译期生成的程序 (eval/embedded.h) 使用
+        // 只在入口检查 values 的个数, 指令中的槽位必须小于 slot_count
+        static EvalStatus execute(const Instruction *code, const Value *constants, size_t slot_count, std::span<const Value> values, Value &out);
+
+        // 反汇编, 用于调试
+        std::string dump(const SlotMap &slots) const;
+    };
+
+    // 将表达式编译为字节码, 遇到的标识符依次加入 slots
+    // 字面量无效或嵌套过深时返回相应的错误
+    EvalStatus compile(const ExprNode *root, SlotMap &slots, Program &out);
+}
@@ -0,0 +1,469 @@
+#pragma once
+
+#include "eval/bytecode.h"
+#include "lexer/lex_scan.h"
+#include "lexer/lex_tables.h"
+
+#include <array>
+#include <bit>
+#include <string_view>
+
+namespace rain {
+    // 在编译期分析嵌入 C++ 代码中的 Rain 表达式
+    //
+    //   static constexpr auto program = rain::compile<"a * 3 + b">();
+    //   program.run(values, out);     // values 按 program.slots 的顺序排列
+    //
+    // 词法分析, 解析与代码生成都在常量求值中完成, 结果存放在定长数组中, 运行时不做任何分析与分配
+    // 生成的指令, 常量与槽位和先用 Lexer 与 ExprNode 解析, 再调用 compile 得到的完全相同
+    // 语法错误, 无效或溢出的字面量以及过深的嵌套都是编译错误, 出错位置为下面对应的 throw
+    //
+    // 数字, 标识符, 字符与字符串字面量的扫描与 Lexer 共用 lexer/lex_scan.h, 整数与字符字面量的取值与 parse_literal 共用 eval/value.h
+    // 字符串字面量可以 tokenize, 但与 compile 返回 UNSUPPORTED 一样不能求值, 直接报错
+    // from_chars 不能在常量求值中使用, 浮点字面量只接受有效数字不超过 2^53, 小数位不超过 22 的写法,
+    // 此时一次除法即可得到与 from_chars 相同的舍入
+
+    // 作为模板参数的字符串字面量
+    template<size_t N>
+    struct SnippetText {
+        char text[N] {};
+
+        constexpr SnippetText(const char (&str)[N]) {
+            for (size_t i = 0 ; i < N ; i ++) {
+                text[i] = str[i];
+            }
+        }
+
+        [[nodiscard]] constexpr std::string_view view() const {
+            return std::string_view(text, N - 1);
+        }
+    };
+
+    // 只记录位置, 内容从片段中取得
+    struct SnippetToken {
+        TokenType type = TokenType::NONE;
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    // 每个 token 至少占一个字节, 加上 ENDMARK 不超过 N 个
+    template<size_t N>
+    struct SnippetTokens {
+        std::array<SnippetToken, N> tokens {};
+        size_t count = 0;
+    };
+
+    // 编译期生成的程序, 数组的长度恰好等于指令, 常量与槽位的个数
+    template<size_t Code, size_t Constants, size_t Slots>
+    struct EmbeddedProgram {
+        std::array<Instruction, Code> code {};
+        std::array<Value, Constants> constants {};
+        // 指向模板参数中的片段, 与程序的生存期相同
+        std::array<std::string_view, Slots> slots {};
+        size_t registers = 0;
+
+        // name 的槽位, 不存在时返回 SlotMap::NPOS
+        [[nodiscard]] constexpr uint32_t slot(std::string_view name) const {
+            for (size_t i = 0 ; i < Slots ; i ++) {
+                if (slots[i] == name) {
+                    return static_cast<uint32_t>(i);
+                }
+            }
+            return SlotMap::NPOS;
+        }
+
+        // 每个槽位都在指令中用到, values 少于 Slots 个时返回 UNBOUND
+        EvalStatus run(std::span<const Value> values, Value &out) const {
+            return Program::execute(code.data(), constants.data(), Slots, values, out);
+        }
+
+        // 复制为运行时的 Program, 槽位依次加入 slot_map, 用于反汇编或交给 JIT
+        Program to_program(SlotMap &slot_map) const {
+            Program program;
+            program.code.assign(code.begin(), code.end());
+            program.constants.assign(constants.begin(), constants.end());
+            program.registers = registers;
+            program.slot_count = Slots;
+            for (std::string_view name : slots) {
+                slot_map.intern(name);
+            }
+            return program;
+        }
+    };
+
+    namespace detail {
+        constexpr bool snippet_space(char ch) {
+            return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\v' || ch == '\f' || ch == '\r';
+        }
+
+        // 扫描函数报告的错误都是编译错误, 出错位置为对应的 throw
+        struct SnippetScanError {
+            constexpr void operator()(ScanError kind, size_t, char) const {
+                switch (kind) {
+                case ScanError::HEX_DIGIT:      throw "embedded snippet: hex literal without digits";
+                case ScanError::OCT_DIGIT:      throw "embedded snippet: invalid digit in octal literal";
+                case ScanError::BIN_DIGIT:      throw "embedded snippet: invalid digit in binary literal";
+                case ScanError::HEX_ESCAPE:     throw "embedded snippet: invalid hex digits in escape sequence";
+                case ScanError::OCT_ESCAPE:     throw "embedded snippet: invalid octal digits in escape sequence";
+                case ScanError::UNICODE_ESCAPE: throw "embedded snippet: invalid hex digits in unicode escape sequence";
+                case ScanError::ESCAPE:         throw "embedded snippet: invalid escape sequence";
+                case ScanError::CHAR_MISSING:   throw "embedded snippet: empty char literal";
+                case ScanError::CHAR_CLOSING:   throw "embedded snippet: missing closing quote in char literal";
+                case ScanError::STRING_CLOSING: throw "embedded snippet: missing closing quote in string literal";
+                }
+            }
+        };
+
+        // 运算符以外的 token, 与 Lexer 的 __nonsymbol__ 相同的顺序
+        constexpr TokenType snippet_nonsymbol(const char *p, size_t &length) {
+            TokenType type = number_type(p);
+            switch (type) {
+            case TokenType::DEC_INTEGER:
+                length = scan_decimal(p, type);
+                return type;
+            case TokenType::HEX_INTEGER:
+                length = scan_hex(p, SnippetScanError());
+                return type;
+            case TokenType::OCT_INTEGER:
+                length = scan_octal(p, SnippetScanError());
+                return type;
+            case TokenType::BIN_INTEGER:
+                length = scan_binary(p, SnippetScanError());
+                return type;
+            default:
+                break;
+            }
+
+            if (identifier_char(p, true) > 0) {
+                length = scan_identifier(p);
+                type = lookup_keyword(std::string_view(p, length));
+                return type == TokenType::NONE ? TokenType::IDENTIFIER : type;
+            }
+            if (p[0] == '"') {
+                length = scan_string(p, SnippetScanError());
+                return TokenType::LITERAL_STRING;
+            }
+            if (p[0] == '\'') {
+                length = scan_char(p, SnippetScanError());
+                return TokenType::LITERAL_CHAR;
+            }
+            throw "embedded snippet: couldn't recognize any token";
+        }
+
+        // 与 Lexer 相同的划分方式, 跳过空白与注释后依次识别运算符, 数字, 标识符与关键字, 字符与字符串字面量
+        // 扫描函数读到 '\0' 为止, text 之后须紧跟一个 '\0', SnippetText::view 满足这一点
+        template<size_t N>
+        constexpr SnippetTokens<N> lex_snippet(std::string_view text) {
+            SnippetTokens<N> out;
+            size_t cur = 0;
+            auto at = [&](size_t i) {
+                return i < text.size() ? text[i] : '\0';
+            };
+
+            while (true) {
+                // 未闭合的块注释一直延伸到结尾, 与 Lexer 相同
+                while (cur < text.size()) {
+                    if (snippet_space(text[cur])) {
+                        cur ++;
+                    }
+                    else if (at(cur) == '/' && at(cur + 1) == '/') {
+                        while (cur < text.size() && text[cur] != '\n') {
+                            cur ++;
+                        }
+                    }
+                    else if (at(cur) == '/' && at(cur + 1) == '*') {
+                        cur += 2;
+                        while (cur < text.size() && ! (text[cur] == '*' && at(cur + 1) == '/')) {
+                            cur ++;
+                        }
+                        cur = std::min(cur + 2, text.size());
+                    }
+                    else {
+                        break;
+                    }
+                }
+
+                SnippetToken &tok = out.tokens[out.count ++];
+                tok.offset = static_cast<uint32_t>(cur);
+                if (cur == text.size()) {
+                    tok.type = TokenType::ENDMARK;
+                    return out;
+                }
+
+                size_t length = 0;
+                TokenType type = match_operator(text.substr(cur), length);
+                if (type == TokenType::NONE) {
+                    type = snippet_nonsymbol(text.data() + cur, length);
+                }
+
+                tok.type = type;
+                tok.length = static_cast<uint32_t>(length);
+                cur += length;
+            }
+        }
+
+        // 有效数字与 10 的幂都能精确表示为 double 时, 一次除法的舍入与 from_chars 相同
+        constexpr double snippet_float(std::string_view text) {
+            constexpr uint64_t MAX_MANTISSA = uint64_t(1) << 53;
+            uint64_t mantissa = 0;
+            int fraction = -1;
+            for (char ch : text) {
+                if (ch == '.') {
+                    fraction = 0;
+                    continue;
+                }
+                mantissa = mantissa * 10 + (ch - '0');
+                if (mantissa > MAX_MANTISSA) {
+                    throw "embedded snippet: float literal has too many significant digits";
+                }
+                fraction += fraction >= 0;
+            }
+            if (fraction > 22) {
+                throw "embedded snippet: float literal has too many fraction digits";
+            }
+
+            double scale = 1;
+            for (int i = 0 ; i < fraction ; i ++) {
+                scale *= 10;
+            }
+            return static_cast<double>(mantissa) / scale;
+        }
+
+        // 与 parse_literal 相同的取值, 无效或溢出的字面量报错
+        constexpr Value snippet_literal(TokenType type, std::string_view text) {
+            Value value = Value::of(static_cast<int64_t>(0));
+            EvalStatus status;
+            switch (type) {
+            case TokenType::DEC_INTEGER:  status = parse_integer(text, 10, value); break;
+            case TokenType::HEX_INTEGER:  status = parse_integer(text.substr(2), 16, value); break;
+            case TokenType::BIN_INTEGER:  status = parse_integer(text.substr(2), 2, value); break;
+            case TokenType::OCT_INTEGER:  status = parse_integer(text.substr(1), 8, value); break;
+            case TokenType::LITERAL_CHAR: status = parse_char(text, value); break;
+            case TokenType::FLOAT:        return Value::of(snippet_float(text));
+            default:                      status = EvalStatus::UNSUPPORTED; break;
+            }
+
+            if (status == EvalStatus::INT_OVERFLOW) {
+                throw "embedded snippet: integer literal overflows int64";
+            }
+            if (status != EvalStatus::OK) {
+                throw "embedded snippet: invalid literal";
+            }
+            return value;
+        }
+
+        template<size_t N>
+        struct SnippetProgram {
+            std::array<Instruction, N> code {};
+            std::array<Value, N> constants {};
+            std::array<std::string_view, N> slots {};
+            size_t code_size = 0;
+            size_t constant_size = 0;
+            size_t slot_count = 0;
+            size_t registers = 0;
+        };
+
+        // 按 ExprNode 的文法递归下降, 生成与 compile 相同的代码
+        // 字面量与标识符先作为操作数返回, 由调用者决定直接编码进指令还是加载到寄存器,
+        // 这与 compile 先判断子树是否为叶子再生成代码的顺序一致
+        template<size_t N>
+        class SnippetCompiler {
+        public:
+            SnippetProgram<N> program;
+
+            constexpr SnippetCompiler(std::string_view text, const SnippetTokens<N> &tokens)
+                : text(text), tokens(tokens)
+            {
+            }
+
+            constexpr void compile() {
+                expr(0);
+                if (peek().type != TokenType::ENDMARK) {
+                    throw "embedded snippet: unexpected token after the expression";
+                }
+                emit(OpCode::RET, 0, 0, 0);
+            }
+
+        private:
+            struct Operand {
+                enum Kind {
+                    REGISTER = 0,
+                    CONSTANT = 1,
+                    SLOT     = 2
+                } kind;
+                uint32_t index;
+            };
+
+            std::string_view text;
+            SnippetTokens<N> tokens;
+            size_t pos = 0;
+
+            constexpr const SnippetToken &peek() const {
+                return tokens.tokens[pos];
+            }
+
+            constexpr std::string_view content(const SnippetToken &tok) const {
+                return text.substr(tok.offset, tok.length);
+            }
+
+            constexpr void emit(OpCode op, size_t dst, size_t a, uint32_t b) {
+                program.code[program.code_size ++] = Instruction{op, static_cast<uint8_t>(dst), static_cast<uint8_t>(a), 0, b};
+            }
+
+            constexpr void reserve(size_t reg) {
+                if (reg >= Program::MAX_REGISTERS) {
+                    throw "embedded snippet: expression nests too deeply";
+                }
+                program.registers = std::max(program.registers, reg + 1);
+            }
+
+            // 按 (类型, 位模式) 去重
+            constexpr uint32_t constant(Value value) {
+                for (size_t i = 0 ; i < program.constant_size ; i ++) {
+                    const Value &k = program.constants[i];
+                    if (k.kind == value.kind && (k.kind == Value::INT ? k.i == value.i
+                                                                      : std::bit_cast<uint64_t>(k.f) == std::bit_cast<uint64_t>(value.f))) {
+                        return static_cast<uint32_t>(i);
+                    }
+                }
+                program.constants[program.constant_size] = value;
+                return static_cast<uint32_t>(program.constant_size ++);
+            }
+
+            constexpr uint32_t slot(std::string_view name) {
+                for (size_t i = 0 ; i < program.slot_count ; i ++) {
+                    if (program.slots[i] == name) {
+                        return static_cast<uint32_t>(i);
+                    }
+                }
+                program.slots[program.slot_count] = name;
+                return static_cast<uint32_t>(program.slot_count ++);
+            }
+
+            constexpr void load(Operand operand, size_t dst) {
+                emit(operand.kind == Operand::CONSTANT ? OpCode::LOADK : OpCode::LOADS, dst, 0, operand.index);
+            }
+
+            static constexpr uint8_t opcode_base(TokenType op) {
+                switch (op) {
+                case TokenType::SIGN_ADD: return static_cast<uint8_t>(OpCode::ADD_RR);
+                case TokenType::SIGN_SUB: return static_cast<uint8_t>(OpCode::SUB_RR);
+                case TokenType::SIGN_MUL: return static_cast<uint8_t>(OpCode::MUL_RR);
+                case TokenType::SIGN_DIV: return static_cast<uint8_t>(OpCode::DIV_RR);
+                default:                  return static_cast<uint8_t>(OpCode::MOD_RR);
+                }
+            }
+
+            // 字面量或标识符返回 true 并填入 operand, 括号内的表达式编译到 dst
+            constexpr bool primary(size_t dst, Operand &operand) {
+                const SnippetToken &tok = peek();
+                switch (tok.type) {
+                case TokenType::DEC_INTEGER:
+                case TokenType::HEX_INTEGER:
+                case TokenType::OCT_INTEGER:
+                case TokenType::BIN_INTEGER:
+                case TokenType::FLOAT:
+                case TokenType::LITERAL_CHAR:
+                    operand = {Operand::CONSTANT, constant(snippet_literal(tok.type, content(tok)))};
+                    pos ++;
+                    return true;
+                case TokenType::LITERAL_STRING:
+                    throw "embedded snippet: string literals cannot be evaluated";
+                case TokenType::IDENTIFIER:
+                    operand = {Operand::SLOT, slot(content(tok))};
+                    pos ++;
+                    return true;
+                case TokenType::SIGN_LPAREN:
+                    pos ++;
+                    expr(dst);
+                    if (peek().type != TokenType::SIGN_RPAREN) {
+                        throw "embedded snippet: expected ')'";
+                    }
+                    pos ++;
+                    return false;
+                default:
+                    throw "embedded snippet: expected a literal, an identifier or '('";
+                }
+            }
+
+            // 没有乘除运算且只有一个叶子时返回 true 并填入 operand, 否则结果在 dst
+            constexpr bool mul(size_t dst, Operand &operand) {
+                Operand head;
+                bool leaf = primary(dst, head);
+                if (! is_mul(peek().type)) {
+                    operand = head;
+                    return leaf;
+                }
+
+                reserve(dst);
+                if (leaf) {
+                    load(head, dst);
+                }
+                while (is_mul(peek().type)) {
+                    TokenType op = peek().type;
+                    pos ++;
+                    Operand rhs;
+                    if (! primary(dst + 1, rhs)) {
+                        reserve(dst + 1);
+                        rhs = {Operand::REGISTER, static_cast<uint32_t>(dst + 1)};
+                    }
+                    emit(static_cast<OpCode>(opcode_base(op) + rhs.kind), dst, dst, rhs.index);
+                }
+                return false;
+            }
+
+            // 结果在 dst
+            constexpr void expr(size_t dst) {
+                reserve(dst);
+                Operand head;
+                if (mul(dst, head)) {
+                    load(head, dst);
+                }
+                while (peek().type == TokenType::SIGN_ADD || peek().type == TokenType::SIGN_SUB) {
+                    TokenType op = peek().type;
+                    pos ++;
+                    Operand rhs;
+                    if (! mul(dst + 1, rhs)) {
+                        reserve(dst + 1);
+                        rhs = {Operand::REGISTER, static_cast<uint32_t>(dst + 1)};
+                    }
+                    emit(static_cast<OpCode>(opcode_base(op) + rhs.kind), dst, dst, rhs.index);
+                }
+            }
+
+            static constexpr bool is_mul(TokenType type) {
+                return type == TokenType::SIGN_MUL || type == TokenType::SIGN_DIV || type == TokenType::SIGN_MOD;
+            }
+        };
+    }
+
+    // 片段的 token 序列, 以 ENDMARK 结尾
+    template<SnippetText Text>
+    consteval auto tokenize() {
+        constexpr size_t N = sizeof(Text.text);
+        return detail::lex_snippet<N>(Text.view());
+    }
+
+    template<SnippetText Text>
+    consteval auto compile() {
+        constexpr size_t N = sizeof(Text.text);
+        constexpr auto full = [] {
+            detail::SnippetCompiler<N> compiler(Text.view(), detail::lex_snippet<N>(Text.view()));
+            compiler.compile();
+            return compiler.program;
+        }();
+
+        EmbeddedProgram<full.code_size, full.constant_size, full.slot_count> program;
+        for (size_t i = 0 ; i < full.code_size ; i ++) {
+            program.code[i] = full.code[i];
+        }
+        for (size_t i = 0 ; i < full.constant_size ; i ++) {
+            program.constants[i] = full.constants[i];
+        }
+        for (size_t i = 0 ; i < full.slot_count ; i ++) {
+            program.slots[i] = full.slots[i];
+        }
+        program.registers = full.registers;
+        return program;
+    }
+}
@@ -0,0 +1,404 @@
+#include "eval/eval_bench.h"
+#include "eval/bytecode.h"
+#include "eval/batch_eval.h"
+#include "eval/tree_eval.h"
+#include "eval/jit.h"
+#include "eval/embedded.h"
+#include "parser/ast_visitor.h"
+
+#include "util/hash.h"
+
+#include <chrono>
+#include <iostream>
+
+using namespace rain;
+
+static constexpr size_t __variables__ = 16;
+static constexpr size_t __binding_sets__ = 64;
+
+static constexpr void __append_number__(std::string &out, size_t value) {
+    char digits[20] = {};
+    size_t n = 0;
+    do {
+        digits[n ++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (n > 0) {
+        out += digits[-- n];
+    }
+}
+
+// (((x0 * x1 + 1) % 1009 * x2 + 2) % 1009 ...)
+// 生成函数都是 constexpr 的, 同一份源码也在编译期交给 compile<>
+static constexpr std::string __deep_source__(size_t depth) {
+    std::string source = "x0";
+    for (size_t i = 1 ; i <= depth ; i ++) {
+        std::string next = "(";
+        next += source;
+        next += " * x";
+        __append_number__(next, i % __variables__);
+        next += " + ";
+        __append_number__(next, i);
+        next += ") % 1009";
+        source = std::move(next);
+    }
+    return source;
+}
+
+// x0 * 3 + x1 % 7 - x2 * 5 + ...
+static constexpr std::string __wide_source__(size_t width) {
+    constexpr const char *ops[] = {" + ", " - ", " + "};
+    constexpr const char *factors[] = {" * 3", " % 7", " * 5", " / 2", ""};
+
+    std::string source;
+    for (size_t i = 0 ; i < width ; i ++) {
+        if (i > 0) {
+            source += ops[i % 3];
+        }
+        source += "x";
+        __append_number__(source, i % __variables__);
+        source += factors[i % 5];
+    }
+    return source;
+}
+
+static constexpr char __edge_source__[] = "x0 / x1 + x2 % x3 - x4 * x5 + (x6 - x7) * x8 % x9";
+
+// 把 constexpr 的生成函数的结果变为 compile<> 的模板参数
+template<auto Generate>
+consteval auto __snippet_text__() {
+    constexpr size_t N = Generate().size() + 1;
+    std::string source = Generate();
+    char text[N] = {};
+    for (size_t i = 0 ; i + 1 < N ; i ++) {
+        text[i] = source[i];
+    }
+    return SnippetText<N>(text);
+}
+
+// 含 0, -1, 极值与浮点数的绑定, 用于覆盖 JIT 退回解释执行的路径
+static Value __edge_value__(size_t set, size_t slot) {
+    static const Value table[] = {
+        Value::of(static_cast<int64_t>(0)), Value::of(static_cast<int64_t>(1)), Value::of(static_cast<int64_t>(-1)),
+        Value::of(static_cast<int64_t>(7)), Value::of(static_cast<int64_t>(-13)),
+        Value::of(INT64_MAX), Value::of(INT64_MIN), Value::of(2.5), Value::of(-0.0)
+    };
+    return table[(set * 5 + slot * 3) % std::size(table)];
+}
+
+static Value __small_value__(size_t set, size_t slot) {
+    return Value::of(static_cast<int64_t>((set * 31 + slot * 7) % 100 + 1));
+}
+
+static bool __same_result__(EvalStatus lhs_status, Value lhs, EvalStatus rhs_status, Value rhs) {
+    return lhs_status == rhs_status && (lhs_status != EvalStatus::OK || lhs == rhs);
+}
+
+static bool __bench_one__(const char *name, const std::string &source, Value (*binding)(size_t, size_t), size_t iterations) {
+    Lexer lexer(bytebuffer(source), name);
+    TokenStream stream(lexer);
+    auto res = ExprNode::parse(stream.begin(), stream.end());
+    if (! res.success || (*res.end)->type != TokenType::ENDMARK) {
+        std::cout << std::format("{}: couldn't parse the generated expression", name) << std::endl;
+        return false;
+    }
+
+    JitCache jit;
+    EvalStatus status;
+    const JitFunction *function = jit.get(res.val, status);
+    if (function == nullptr) {
+        std::cout << std::format("{}: compile failed: {}", name, to_string(status)) << std::endl;
+        destroy_tree(res.val);
+        return false;
+    }
+
+    const SlotMap &slots = jit.slots;
+    const Program &program = function->bytecode();
+
+    // 预先生成若干组绑定, 求值时轮流使用
+    std::vector<Value> bindings(__binding_sets__ * slots.size());
+    for (size_t set = 0 ; set < __binding_sets__ ; set ++) {
+        for (size_t slot = 0 ; slot < slots.size() ; slot ++) {
+            bindings[set * slots.size() + slot] = binding(set, slot);
+        }
+    }
+
+    // 先逐组比较结果
+    bool consistent = true;
+    for (size_t set = 0 ; set < __binding_sets__ ; set ++) {
+        std::span<const Value> values(bindings.data() + set * slots.size(), slots.size());
+        Value expected, interpreted, compiled;
+        EvalStatus expected_status = evaluate_tree(res.val, slots, values.data(), expected);
+        EvalStatus interpreted_status = program.run(values, interpreted);
+        EvalStatus compiled_status = (*function)(values, compiled);
+        if (! __same_result__(expected_status, expected, interpreted_status, interpreted)
+            || ! __same_result__(expected_status, expected, compiled_status, compiled)) {
+            std::cout << std::format("{}: mismatch on binding set {}: tree {} ({}), bytecode {} ({}), jit {} ({})",
+                                     name, set, expected.repr(), to_string(expected_status),
+                                     interpreted.repr(), to_string(interpreted_status),
+                                     compiled.repr(), to_string(compiled_status)) << std::endl;
+            consistent = false;
+            break;
+        }
+    }
+
+    using clock = std::chrono::steady_clock;
+    // 边界绑定下结果可能是浮点数或错误, 只比较位模式之和
+    // 出错时 out 的值无意义, 只计入状态
+    uint64_t checksum[3] = {0, 0, 0};
+    auto fold = [](EvalStatus status, const Value &out) {
+        return status == EvalStatus::OK ? static_cast<uint64_t>(out.i) : static_cast<uint64_t>(status);
+    };
+
+    auto begin = clock::now();
+    for (size_t i = 0 ; i < iterations ; i ++) {
+        Value out;
+        out.i = 0;
+        EvalStatus status = evaluate_tree(res.val, slots, bindings.data() + (i % __binding_sets__) * slots.size(), out);
+        checksum[0] += fold(status, out);
+    }
+    auto tree_end = clock::now();
+    for (size_t i = 0 ; i < iterations ; i ++) {
+        Value out;
+        out.i = 0;
+        EvalStatus status = program.run(std::span(bindings).subspan((i % __binding_sets__) * slots.size(), slots.size()), out);
+        checksum[1] += fold(status, out);
+    }
+    auto vm_end = clock::now();
+    for (size_t i = 0 ; i < iterations ; i ++) {
+        Value out;
+        out.i = 0;
+        EvalStatus status = (*function)(std::span(bindings).subspan((i % __binding_sets__) * slots.size(), slots.size()), out);
+        checksum[2] += fold(status, out);
+    }
+    auto jit_end = clock::now();
+    bool checksum_ok = checksum[0] == checksum[1] && checksum[0] == checksum[2];
+
+    double tree_ns = std::chrono::duration<double, std::nano>(tree_end - begin).count() / iterations;
+    double vm_ns = std::chrono::duration<double, std::nano>(vm_end - tree_end).count() / iterations;
+    double jit_ns = std::chrono::duration<double, std::nano>(jit_end - vm_end).count() / iterations;
+    std::cout << std::format("{:<6} {:>5} insns  tree {:>10.1f} ns/eval  bytecode {:>8.1f} ns/eval ({:>5.1f}x)  "
+                             "jit {:>8.1f} ns/eval ({:>5.1f}x, {}){}",
+                             name, program.code.size(), tree_ns, vm_ns, tree_ns / vm_ns,
+                             jit_ns, tree_ns / jit_ns,
+                             function->native() ? std::format("{} bytes", function->code_size()) : "interpreted",
+                             checksum_ok ? "" : "  (checksum mismatch)") << std::endl;
+
+    destroy_tree(res.val);
+    return consistent && checksum_ok;
+}
+
+// tokenize<> 的结果须与 Lexer 逐个相同, 包括类型, 位置与内容
+template<SnippetText Text>
+static bool __tokens_one__(const char *name) {
+    static constexpr auto tokens = tokenize<Text>();
+    std::string_view source = Text.view();
+
+    Lexer lexer(bytebuffer(std::string(source)), name);
+    lexer.produce_all();
+    const auto &expected = lexer.token_sequence;
+
+    for (size_t i = 0 ; i < std::max(expected.size(), tokens.count) ; i ++) {
+        if (i < expected.size() && i < tokens.count) {
+            const SnippetToken &tok = tokens.tokens[i];
+            std::string_view content = source.substr(tok.offset, tok.length);
+            if (tok.type == expected[i]->type && tok.offset == expected[i]->offset && content == expected[i]->content) {
+                continue;
+            }
+        }
+        std::cout << std::format("{}: token {} differs from the lexer: lexer {}, embedded {}",
+                                 name, i,
+                                 i < expected.size() ? expected[i]->repr() : "<none>",
+                                 i < tokens.count ? std::format("({}, '{}')", static_cast<short>(tokens.tokens[i].type),
+                                                                source.substr(tokens.tokens[i].offset, tokens.tokens[i].length))
+                                                  : "<none>") << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 编译期生成的程序须与运行时解析再编译的结果逐条相同, 并比较运行时解析与编译的耗时
+template<SnippetText Text>
+static bool __embedded_one__(const char *name) {
+    static constexpr auto embedded = compile<Text>();
+    std::string_view source = Text.view();
+    if (! __tokens_one__<Text>(name)) {
+        return false;
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto begin = clock::now();
+    Lexer lexer(bytebuffer(std::string(source)), name);
+    TokenStream stream(lexer);
+    auto res = ExprNode::parse(stream.begin(), stream.end());
+    if (! res.success || (*res.end)->type != TokenType::ENDMARK) {
+        std::cout << std::format("{}: couldn't parse the snippet", name) << std::endl;
+        return false;
+    }
+    SlotMap slots;
+    Program program;
+    EvalStatus status = compile(res.val, slots, program);
+    auto runtime_end = clock::now();
+    destroy_tree(res.val);
+    if (status != EvalStatus::OK) {
+        std::cout << std::format("{}: compile failed: {}", name, to_string(status)) << std::endl;
+        return false;
+    }
+
+    bool same = program.registers == embedded.registers && program.code.size() == embedded.code.size()
+                && program.constants.size() == embedded.constants.size() && slots.size() == embedded.slots.size();
+    for (size_t i = 0 ; same && i < program.code.size() ; i ++) {
+        const Instruction &lhs = program.code[i], &rhs = embedded.code[i];
+        same = lhs.op == rhs.op && lhs.dst == rhs.dst && lhs.a == rhs.a && lhs.b == rhs.b;
+    }
+    for (size_t i = 0 ; same && i < program.constants.size() ; i ++) {
+        same = program.constants[i] == embedded.constants[i];
+    }
+    for (size_t i = 0 ; same && i < slots.size() ; i ++) {
+        same = slots.name(i) == embedded.slots[i];
+    }
+    if (! same) {
+        SlotMap embedded_slots;
+        std::cout << std::format("{}: embedded program differs from the runtime compile\n{}---\n{}",
+                                 name, program.dump(slots), embedded.to_program(embedded_slots).dump(embedded_slots));
+        return false;
+    }
+
+    std::vector<Value> values(slots.size());
+    for (size_t set = 0 ; set < __binding_sets__ ; set ++) {
+        for (size_t slot = 0 ; slot < slots.size() ; slot ++) {
+            values[slot] = __edge_value__(set, slot);
+        }
+        Value expected, actual;
+        EvalStatus expected_status = program.run(values, expected);
+        EvalStatus actual_status = embedded.run(values, actual);
+        if (! __same_result__(expected_status, expected, actual_status, actual)) {
+            std::cout << std::format("{}: mismatch on binding set {}: bytecode {} ({}), embedded {} ({})",
+                                     name, set, expected.repr(), to_string(expected_status),
+                                     actual.repr(), to_string(actual_status)) << std::endl;
+            return false;
+        }
+    }
+
+    double runtime_us = std::chrono::duration<double, std::micro>(runtime_end - begin).count();
+    std::cout << std::format("{:<7} {:>5} insns  runtime lex + parse + compile {:.1f} us, embedded 0 us", name, embedded.code.size(), runtime_us) << std::endl;
+    return true;
+}
+
+bool rain::run_eval_bench(size_t iterations) {
+    bool ok = __bench_one__("deep", __deep_source__(64), __small_value__, iterations);
+    ok &= __bench_one__("wide", __wide_source__(512), __small_value__, iterations);
+    ok &= __bench_one__("edge", __edge_source__, __edge_value__, iterations);
+
+    // 同样的源码在编译期生成程序, 逐个 token 与 Lexer 比较, 逐条指令与 compile 比较
+    ok &= __embedded_one__<__snippet_text__<[] { return __deep_source__(64); }>()>("deep");
+    ok &= __embedded_one__<__snippet_text__<[] { return __wide_source__(512); }>()>("wide");
+    ok &= __embedded_one__<__edge_source__>("edge");
+    ok &= __embedded_one__<"(x0 * 3 + x1) % 0x7f - x2 / 2.5 + (x3 - 'a') * x0">("snippet");
+    // 各种进制, 转义序列与非 ASCII 的标识符和字符
+    ok &= __embedded_one__<"(π * 0b101 + 'é') % 017 - café / 0.125 + '\\u00e9' * x_1 - '\\n' + 0X7F * '😀' % '\\101' /* c */ + ℕ2 // end">("literal");
+    // 字符串不能求值, 只比较 token
+    ok &= __tokens_one__<"\"s\\x41\\U0001F600\" + x0 /* \"c\" */ + \"é\" + 'x'">("string");
+    return ok;
+}
+
+// 每个槽位的列, 名字以 f 开头的变量为浮点数列, 其余为整数列
+// 整数列中约 1/64 的值为 0, 用于覆盖逐行的除零
+static bool __batch_one__(const char *name, const std::string &source, size_t rows) {
+    Lexer lexer(bytebuffer(source), name);
+    TokenStream stream(lexer);
+    auto res = ExprNode::parse(stream.begin(), stream.end());
+    if (! res.success || (*res.end)->type != TokenType::ENDMARK) {
+        std::cout << std::format("{}: couldn't parse the generated expression", name) << std::endl;
+        return false;
+    }
+
+    SlotMap slots;
+    Program program;
+    EvalStatus status = compile(res.val, slots, program);
+    destroy_tree(res.val);
+    if (status != EvalStatus::OK) {
+        std::cout << std::format("{}: compile failed: {}", name, to_string(status)) << std::endl;
+        return false;
+    }
+
+    std::vector<Value::Kind> kinds(slots.size());
+    std::vector<std::vector<int64_t>> int_columns(slots.size());
+    std::vector<std::vector<double>> float_columns(slots.size());
+    std::vector<Column> columns(slots.size());
+    for (size_t slot = 0 ; slot < slots.size() ; slot ++) {
+        if (slots.name(slot).starts_with("f")) {
+            kinds[slot] = Value::FLOAT;
+            float_columns[slot].resize(rows);
+            for (size_t row = 0 ; row < rows ; row ++) {
+                float_columns[slot][row] = static_cast<double>((row * 13 + slot * 7) % 1000) / 8.0;
+            }
+            columns[slot] = Column::of(float_columns[slot].data());
+        } else {
+            kinds[slot] = Value::INT;
+            int_columns[slot].resize(rows);
+            for (size_t row = 0 ; row < rows ; row ++) {
+                uint64_t h = hash_mix(row * 31 + slot);
+                int_columns[slot][row] = (h & 63) == 0 ? 0 : static_cast<int64_t>(h % 2001) - 1000;
+            }
+            columns[slot] = Column::of(int_columns[slot].data());
+        }
+    }
+
+    BatchEvaluator batch;
+    status = batch.prepare(program, kinds);
+    if (status != EvalStatus::OK) {
+        std::cout << std::format("{}: prepare failed: {}", name, to_string(status)) << std::endl;
+        return false;
+    }
+
+    using clock = std::chrono::steady_clock;
+
+    // 逐行: 每一行先组装绑定再解释执行
+    std::vector<Value> scalar_out(rows);
+    std::vector<EvalStatus> scalar_status(rows);
+    std::vector<Value> values(slots.size());
+    auto begin = clock::now();
+    for (size_t row = 0 ; row < rows ; row ++) {
+        for (size_t slot = 0 ; slot < slots.size() ; slot ++) {
+            values[slot] = kinds[slot] == Value::INT ? Value::of(int_columns[slot][row]) : Value::of(float_columns[slot][row]);
+        }
+        scalar_status[row] = program.run(values, scalar_out[row]);
+    }
+    auto scalar_end = clock::now();
+
+    std::vector<int64_t> int_out(rows);
+    std::vector<double> float_out(rows);
+    std::vector<EvalStatus> batch_status(rows);
+    if (batch.result_kind() == Value::INT) {
+        batch.run(columns.data(), rows, int_out.data(), batch_status.data());
+    } else {
+        batch.run(columns.data(), rows, float_out.data(), batch_status.data());
+    }
+    auto batch_end = clock::now();
+
+    size_t failed = 0;
+    for (size_t row = 0 ; row < rows ; row ++) {
+        Value batched = batch.result_kind() == Value::INT ? Value::of(int_out[row]) : Value::of(float_out[row]);
+        if (! __same_result__(scalar_status[row], scalar_out[row], batch_status[row], batched)) {
+            std::cout << std::format("{}: mismatch on row {}: scalar {} ({}), batch {} ({})",
+                                     name, row, scalar_out[row].repr(), to_string(scalar_status[row]),
+                                     batched.repr(), to_string(batch_status[row])) << std::endl;
+            return false;
+        }
+        failed += scalar_status[row] != EvalStatus::OK;
+    }
+
+    double scalar_s = std::chrono::duration<double>(scalar_end - begin).count();
+    double batch_s = std::chrono::duration<double>(batch_end - scalar_end).count();
+    std::cout << std::format("{:<6} {:>9} rows ({} failed)  scalar {:>12.0f} rows/s  batch {:>12.0f} rows/s ({:>5.1f}x)",
+                             name, rows, failed, rows / scalar_s, rows / batch_s, scalar_s / batch_s) << std::endl;
+    return true;
+}
+
+bool rain::run_batch_bench(size_t rows) {
+    bool ok = __batch_one__("int", "(x0 * 3 + x1) % 1009 - x2 / x3 + x4 * x5 - 7", rows);
+    ok &= __batch_one__("float", "f0 * 2.5 + f1 / f2 - f3 * f0 + 1.0", rows);
+    ok &= __batch_one__("mixed", "x0 * f0 + x1 % x2 - f1 / 4 + x3", rows);
+    return ok;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "util/util.h"
+
+namespace rain {
+    // 在生成的深层与宽表达式上比较语法树求值, 字节码解释与 JIT 的速度
+    // 每次求值使用不同的变量绑定, 两者结果不一致时报告错误
+    // 返回 false 表示出现了不一致
+    bool run_eval_bench(size_t iterations);
+
+    // 比较 BatchEvaluator 与逐行调用 Program::run 的吞吐量 (行/秒)
+    // 两者的结果或状态不一致时报告错误并返回 false
+    bool run_batch_bench(size_t rows);
+}
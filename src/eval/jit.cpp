@@ -0,0 +1,256 @@
+#include "eval/jit.h"
+#include "eval/x86_emitter.h"
+#include "parser/ast_visitor.h"
+#include "util/hash.h"
+
+#include <cstddef>
+
+#if defined(RAIN_JIT_NATIVE)
+#include <sys/mman.h>
+#endif
+
+using namespace rain;
+
+// 把语法树序列化为括号形式, 结构相同当且仅当指纹相同
+struct __fingerprint__ {
+    std::string text;
+
+    template<typename Node>
+    void pre(const Node *node, size_t depth) {
+        constexpr NodeKind kind = node_kind_v<Node>;
+        if constexpr (kind == NodeKind::TERMINAL) {
+            const std::string &content = node->token()->content;
+            text += std::format("{}:{}", content.size(), content);
+        } else if constexpr (kind == NodeKind::OPTIONS) {
+            text += std::format("({}", node->index());
+        } else {
+            text += '(';
+        }
+    }
+
+    template<typename Node>
+    void post(const Node *node, size_t depth) {
+        if constexpr (node_kind_v<Node> != NodeKind::TERMINAL) {
+            text += ')';
+        }
+    }
+};
+
+#if defined(RAIN_JIT_NATIVE)
+
+static_assert(offsetof(Value, kind) == 0 && offsetof(Value, i) == 8 && sizeof(Value) == 16);
+
+// 生成 int (*)(const Value *values, int64_t *out)
+// values 在 rdi, out 在 rsi, 字节码寄存器全部放在栈上, rax 缓存最近写入的寄存器
+class __jit_codegen__ {
+public:
+    x86::Emitter emitter;
+
+    bool generate(const Program &program) {
+        for (const Value &k : program.constants) {
+            if (k.kind != Value::INT) {
+                return false;
+            }
+        }
+        frame = static_cast<int32_t>(program.registers * 8);
+        if (frame > 0) {
+            emitter.adjust_stack(-frame);
+        }
+
+        for (const Instruction &ins : program.code) {
+            if (! lower(program, ins)) {
+                return false;
+            }
+        }
+
+        // 退回解释执行
+        size_t bail = emitter.offset();
+        for (x86::Emitter::Fixup fixup : bails) {
+            emitter.bind(fixup, bail);
+        }
+        epilogue(1);
+        return true;
+    }
+
+private:
+    int32_t frame = 0;
+    // rax 中保存的字节码寄存器, -1 表示没有
+    int cached = -1;
+    std::vector<x86::Emitter::Fixup> bails;
+
+    static int32_t reg_disp(size_t reg) {
+        return static_cast<int32_t>(reg * 8);
+    }
+
+    void epilogue(int32_t result) {
+        if (frame > 0) {
+            emitter.adjust_stack(frame);
+        }
+        emitter.mov32(x86::RAX, result);
+        emitter.ret();
+    }
+
+    void bail_if(x86::Cond cond) {
+        bails.push_back(emitter.jcc(cond));
+    }
+
+    bool load_slot(x86::Reg dst, uint32_t slot) {
+        if (slot >= INT32_MAX / sizeof(Value) - 1) {
+            return false;
+        }
+        int32_t disp = static_cast<int32_t>(slot * sizeof(Value));
+        emitter.cmp_byte(x86::RDI, disp + offsetof(Value, kind), Value::INT);
+        bail_if(x86::NOT_EQUAL);
+        emitter.load(dst, x86::RDI, disp + offsetof(Value, i));
+        return true;
+    }
+
+    void load_register(x86::Reg dst, size_t reg) {
+        emitter.load(dst, x86::RSP, reg_disp(reg));
+    }
+
+    void define(size_t reg) {
+        emitter.store(x86::RSP, reg_disp(reg), x86::RAX);
+        cached = static_cast<int>(reg);
+    }
+
+    bool lower(const Program &program, const Instruction &ins) {
+        if (ins.op == OpCode::LOADK) {
+            emitter.mov(x86::RAX, program.constants[ins.b].i);
+            define(ins.dst);
+            return true;
+        }
+        if (ins.op == OpCode::LOADS) {
+            if (! load_slot(x86::RAX, ins.b)) {
+                return false;
+            }
+            define(ins.dst);
+            return true;
+        }
+        if (ins.op == OpCode::RET) {
+            if (cached != ins.dst) {
+                load_register(x86::RAX, ins.dst);
+            }
+            emitter.store(x86::RSI, 0, x86::RAX);
+            epilogue(0);
+            return true;
+        }
+
+        // dst = a op b, 先把 a 放进 rax, b 放进 rcx
+        uint8_t index = static_cast<uint8_t>(ins.op) - static_cast<uint8_t>(OpCode::ADD_RR);
+        OpCode base = static_cast<OpCode>(static_cast<uint8_t>(OpCode::ADD_RR) + index / 3 * 3);
+
+        if (cached != ins.a) {
+            load_register(x86::RAX, ins.a);
+        }
+        switch (index % 3) {
+        case 0:
+            load_register(x86::RCX, ins.b);
+            break;
+        case 1:
+            emitter.mov(x86::RCX, program.constants[ins.b].i);
+            break;
+        default:
+            if (! load_slot(x86::RCX, ins.b)) {
+                return false;
+            }
+            break;
+        }
+
+        switch (base) {
+        case OpCode::ADD_RR:
+            emitter.add(x86::RAX, x86::RCX);
+            bail_if(x86::OVERFLOW);
+            break;
+        case OpCode::SUB_RR:
+            emitter.sub(x86::RAX, x86::RCX);
+            bail_if(x86::OVERFLOW);
+            break;
+        case OpCode::MUL_RR:
+            emitter.imul(x86::RAX, x86::RCX);
+            bail_if(x86::OVERFLOW);
+            break;
+        default:
+            // 除数为 0 或 -1 的情形交给解释器处理
+            emitter.test(x86::RCX, x86::RCX);
+            bail_if(x86::EQUAL);
+            emitter.cmp(x86::RCX, -1);
+            bail_if(x86::EQUAL);
+            emitter.cqo_idiv(x86::RCX);
+            if (base == OpCode::MOD_RR) {
+                emitter.mov(x86::RAX, x86::RDX);
+            }
+            break;
+        }
+        define(ins.dst);
+        return true;
+    }
+};
+
+JitFunction::JitFunction(std::string fingerprint, Program program)
+    : fingerprint(std::move(fingerprint)), program(std::move(program))
+{
+    __jit_codegen__ codegen;
+    if (! codegen.generate(this->program)) {
+        return;
+    }
+
+    const std::vector<uint8_t> &bytes = codegen.emitter.code;
+    void *map = mmap(nullptr, bytes.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        return;
+    }
+    memcpy(map, bytes.data(), bytes.size());
+    if (mprotect(map, bytes.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(map, bytes.size());
+        return;
+    }
+
+    code = map;
+    size = bytes.size();
+    entry = reinterpret_cast<Entry>(map);
+}
+
+JitFunction::~JitFunction() {
+    if (code != nullptr) {
+        munmap(code, size);
+    }
+}
+
+#else
+
+JitFunction::JitFunction(std::string fingerprint, Program program)
+    : fingerprint(std::move(fingerprint)), program(std::move(program))
+{
+}
+
+JitFunction::~JitFunction() {
+}
+
+#endif
+
+const JitFunction *JitCache::get(const ExprNode *root, EvalStatus &status) {
+    __fingerprint__ fingerprint;
+    walk_iterative(root, fingerprint);
+    uint64_t key = hash_bytes(fingerprint.text.data(), fingerprint.text.size());
+
+    std::vector<std::unique_ptr<JitFunction>> &bucket = entries[key];
+    for (const auto &function : bucket) {
+        if (function->fingerprint == fingerprint.text) {
+            hits ++;
+            status = EvalStatus::OK;
+            return function.get();
+        }
+    }
+
+    misses ++;
+    Program program;
+    status = compile(root, slots, program);
+    if (status != EvalStatus::OK) {
+        return nullptr;
+    }
+
+    bucket.push_back(std::make_unique<JitFunction>(std::move(fingerprint.text), std::move(program)));
+    count ++;
+    return bucket.back().get();
+}
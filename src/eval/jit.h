@@ -0,0 +1,85 @@
+#pragma once
+
+#include "eval/bytecode.h"
+
+#include <memory>
+#include <unordered_map>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define RAIN_JIT_NATIVE
+#endif
+
+namespace rain {
+    // 由字节码生成 x86-64 机器码的表达式
+    //
+    // 生成的代码只处理整数: 浮点常量会使整个表达式退回字节码解释,
+    // 运行时遇到浮点变量, 整数溢出, 除数为 0 或 -1 时本次求值退回解释执行,
+    // 因此结果与 evaluate_tree 完全一致
+    class JitFunction {
+    public:
+        // 结构指纹, 用于在缓存中区分哈希相同的表达式
+        const std::string fingerprint;
+
+        JitFunction(std::string fingerprint, Program program);
+        ~JitFunction();
+
+        JitFunction(const JitFunction &) = delete;
+        JitFunction &operator=(const JitFunction &) = delete;
+
+        // values 按所属 JitCache 的 slots 排列, 个数少于字节码用到的槽位时返回 UNBOUND
+        EvalStatus operator()(std::span<const Value> values, Value &out) const {
+            if (values.size() < program.slot_count) {
+                return EvalStatus::UNBOUND;
+            }
+            int64_t result;
+            if (entry != nullptr && entry(values.data(), &result) == 0) {
+                out = Value::of(result);
+                return EvalStatus::OK;
+            }
+            return program.run(values, out);
+        }
+
+        // 是否生成了机器码
+        [[nodiscard]] bool native() const {
+            return entry != nullptr;
+        }
+
+        [[nodiscard]] size_t code_size() const {
+            return size;
+        }
+
+        [[nodiscard]] const Program &bytecode() const {
+            return program;
+        }
+
+    private:
+        // 成功返回 0 并写入 *out, 需要退回解释执行时返回 1
+        using Entry = int (*)(const Value *values, int64_t *out);
+
+        Program program;
+        Entry entry = nullptr;
+        void *code = nullptr;
+        size_t size = 0;
+    };
+
+    // 按表达式的结构哈希缓存编译结果
+    class JitCache {
+    public:
+        // 所有缓存的函数共用一套槽位
+        SlotMap slots;
+
+        size_t hits = 0;
+        size_t misses = 0;
+
+        // 返回 root 对应的函数, 字面量无效或嵌套过深时返回 nullptr 并设置 status
+        const JitFunction *get(const ExprNode *root, EvalStatus &status);
+
+        [[nodiscard]] size_t size() const {
+            return count;
+        }
+
+    private:
+        std::unordered_map<uint64_t, std::vector<std::unique_ptr<JitFunction>>> entries;
+        size_t count = 0;
+    };
+}
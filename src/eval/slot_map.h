@@ -0,0 +1,44 @@
+#pragma once
+
+#include "util/util.h"
+
+#include <unordered_map>
+
+namespace rain {
+    // 标识符到槽位的映射
+    // 编译后的表达式按槽位下标读取变量, 调用者按同样的下标准备变量值
+    class SlotMap {
+    public:
+        static constexpr uint32_t NPOS = UINT32_MAX;
+
+        // 返回 name 的槽位, 不存在时分配一个新的
+        uint32_t intern(std::string_view name) {
+            auto it = index.find(std::string(name));
+            if (it != index.end()) {
+                return it->second;
+            }
+            uint32_t slot = names.size();
+            names.emplace_back(name);
+            index.emplace(names.back(), slot);
+            return slot;
+        }
+
+        // 返回 name 的槽位, 不存在时返回 NPOS
+        [[nodiscard]] uint32_t find(std::string_view name) const {
+            auto it = index.find(std::string(name));
+            return it != index.end() ? it->second : NPOS;
+        }
+
+        [[nodiscard]] const std::string &name(uint32_t slot) const {
+            return names.at(slot);
+        }
+
+        [[nodiscard]] size_t size() const {
+            return names.size();
+        }
+
+    private:
+        std::vector<std::string> names;
+        std::unordered_map<std::string, uint32_t> index;
+    };
+}
@@ -0,0 +1,133 @@
+#include "eval/tree_eval.h"
+
+using namespace rain;
+
+struct __tree_evaluator__ {
+    const SlotMap &slots;
+    const Value *values;
+
+    EvalStatus evaluate(const PrimaryExprNode *node, Value &out) {
+        switch (node->index()) {
+        case 0: {
+            const Token *tok = std::visit([](auto *terminal) {
+                return terminal->token();
+            }, std::get<0>(node->child())->child());
+            return parse_literal(tok, out);
+        }
+        case 1: {
+            uint32_t slot = slots.find(std::get<1>(node->child())->token()->content);
+            if (slot == SlotMap::NPOS) {
+                return EvalStatus::UNBOUND;
+            }
+            out = values[slot];
+            return EvalStatus::OK;
+        }
+        default:
+            return evaluate(std::get<1>(std::get<2>(node->child())->children()), out);
+        }
+    }
+
+    EvalStatus evaluate(const MulExprNode *node, Value &out) {
+        return evaluate_chain(node, out);
+    }
+
+    EvalStatus evaluate(const ExprNode *node, Value &out) {
+        return evaluate_chain(node, out);
+    }
+
+    template<typename Chain>
+    EvalStatus evaluate_chain(const Chain *node, Value &out) {
+        const auto &[head, tail] = node->children();
+
+        EvalStatus status = evaluate(head, out);
+        for (const auto *step : tail->children()) {
+            if (status != EvalStatus::OK) {
+                return status;
+            }
+
+            Value rhs;
+            status = evaluate(std::get<1>(step->children()), rhs);
+            if (status != EvalStatus::OK) {
+                return status;
+            }
+
+            TokenType op = std::visit([](auto *terminal) {
+                return terminal->token()->type;
+            }, std::get<0>(step->children())->child());
+            status = apply_binary(op, out, rhs, out);
+        }
+        return status;
+    }
+};
+
+EvalStatus rain::evaluate_tree(const ExprNode *root, const SlotMap &slots, const Value *values, Value &out) {
+    __tree_evaluator__ evaluator{slots, values};
+    return evaluator.evaluate(root, out);
+}
+
+// 每条规则解析成功时求值, 子规则的结果已经求出, 出错的状态按与 __tree_evaluator__ 相同的顺序传递
+struct __eval_action__ {
+    using value_type = Evaluated;
+
+    const SlotMap &slots;
+    const Value *values;
+
+    template<typename Attr>
+    Evaluated reduce(std::type_identity<LiteralNode>, Attr &&attr) {
+        const Token *tok = std::visit([](const Token *tok) {
+            return tok;
+        }, attr);
+        Evaluated out;
+        out.status = parse_literal(tok, out.value);
+        return out;
+    }
+
+    template<typename Attr>
+    Evaluated reduce(std::type_identity<PrimaryExprNode>, Attr &&attr) {
+        switch (attr.index()) {
+        case 0:
+            return std::get<0>(attr);
+        case 1: {
+            Evaluated out;
+            uint32_t slot = slots.find(std::get<1>(attr)->content);
+            if (slot == SlotMap::NPOS) {
+                out.status = EvalStatus::UNBOUND;
+            } else {
+                out.value = values[slot];
+            }
+            return out;
+        }
+        default:
+            return std::get<1>(std::get<2>(attr));
+        }
+    }
+
+    // MulExprNode 与 ExprNode: head (op operand)*
+    template<typename Rule, typename Attr>
+    Evaluated reduce(std::type_identity<Rule>, Attr &&attr) {
+        auto &[head, tail] = attr;
+
+        Evaluated out = head;
+        for (const auto &step : tail) {
+            if (out.status != EvalStatus::OK) {
+                return out;
+            }
+
+            const Evaluated &rhs = std::get<1>(step);
+            if (rhs.status != EvalStatus::OK) {
+                return rhs;
+            }
+
+            TokenType op = std::visit([](const Token *tok) {
+                return tok->type;
+            }, std::get<0>(step));
+            out.status = apply_binary(op, out.value, rhs.value, out.value);
+        }
+        return out;
+    }
+};
+
+ActionResult<Evaluated> rain::parse_and_evaluate(TokenIter begin, TokenIter end, const SlotMap &slots, const Value *values) {
+    __eval_action__ action{slots, values};
+    return parse_with<ExprNode>(action, begin, end);
+}
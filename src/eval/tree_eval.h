@@ -0,0 +1,23 @@
+#pragma once
+
+#include "parser/syntax.h"
+#include "parser/ast_action.h"
+#include "eval/value.h"
+#include "eval/slot_map.h"
+
+namespace rain {
+    // 直接遍历语法树求值, 作为其他求值器的参照
+    // 标识符按名字在 slots 中查找, 其值为 values[slot]
+    // 返回值不为 OK 时 out 的值无意义, 可能是求值到一半的结果
+    EvalStatus evaluate_tree(const ExprNode *root, const SlotMap &slots, const Value *values, Value &out);
+
+    // 求值的结果, status 不为 OK 时 value 无意义
+    struct Evaluated {
+        EvalStatus status = EvalStatus::OK;
+        Value value = Value::of(static_cast<int64_t>(0));
+    };
+
+    // 不建立语法树, 在解析 ExprNode 的同时求值
+    // 解析成功时的结果与先解析再调用 evaluate_tree 相同
+    ActionResult<Evaluated> parse_and_evaluate(TokenIter begin, TokenIter end, const SlotMap &slots, const Value *values);
+}
@@ -0,0 +1,74 @@
+#include "eval/value.h"
+
+#include <charconv>
+
+using namespace rain;
+
+const char *rain::to_string(EvalStatus status) noexcept {
+    switch (status) {
+    case EvalStatus::OK: return "OK";
+    case EvalStatus::INT_OVERFLOW: return "integer overflow";
+    case EvalStatus::DIV_BY_ZERO: return "division by zero";
+    case EvalStatus::INVALID_LITERAL: return "invalid literal";
+    case EvalStatus::UNBOUND: return "unbound identifier";
+    case EvalStatus::UNSUPPORTED: return "unsupported operation";
+    }
+    return "<unknown>";
+}
+
+EvalStatus rain::parse_literal(const Token *tok, Value &out) {
+    std::string_view text = tok->content;
+
+    switch (tok->type) {
+    case TokenType::DEC_INTEGER:
+        return detail::parse_integer(text, 10, out);
+    case TokenType::HEX_INTEGER:
+        return detail::parse_integer(text.substr(2), 16, out);
+    case TokenType::BIN_INTEGER:
+        return detail::parse_integer(text.substr(2), 2, out);
+    case TokenType::OCT_INTEGER:
+        return detail::parse_integer(text.substr(1), 8, out);
+    case TokenType::FLOAT: {
+        double value;
+        auto res = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (res.ec != std::errc() || res.ptr != text.data() + text.size()) {
+            return EvalStatus::INVALID_LITERAL;
+        }
+        out = Value::of(value);
+        return EvalStatus::OK;
+    }
+    case TokenType::LITERAL_CHAR:
+        return detail::parse_char(text, out);
+    default:
+        return EvalStatus::UNSUPPORTED;
+    }
+}
+
+bool rain::literal_text(Value value, std::string &text, TokenType &type) {
+    if (value.kind == Value::INT) {
+        if (value.i < 0) {
+            return false;
+        }
+        text = std::format("{}", value.i);
+        type = TokenType::DEC_INTEGER;
+        return true;
+    }
+
+    if (! std::isfinite(value.f) || std::signbit(value.f)) {
+        return false;
+    }
+
+    // 最短的可往返定点表示, 不使用指数形式
+    char digits[400];
+    auto res = std::to_chars(digits, digits + sizeof(digits), value.f, std::chars_format::fixed);
+    if (res.ec != std::errc()) {
+        return false;
+    }
+
+    text.assign(digits, res.ptr);
+    if (text.find('.') == std::string::npos) {
+        text += ".0";
+    }
+    type = TokenType::FLOAT;
+    return true;
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include "util/util.h"
+#include "lexer/lexer.h"
+
+#include <cmath>
+
+namespace rain {
+    // 表达式求值使用的值
+    // 整数字面量为 64 位有符号整数, 浮点字面量为 double, 字符字面量取其码点
+    // 整数与浮点数混合运算时整数提升为浮点数
+    struct Value {
+        enum Kind : uint8_t {
+            INT   = 0,
+            FLOAT = 1
+        } kind;
+
+        union {
+            int64_t i;
+            double f;
+        };
+
+        static constexpr Value of(int64_t v) {
+            Value val;
+            val.kind = INT;
+            val.i = v;
+            return val;
+        }
+
+        static constexpr Value of(double v) {
+            Value val;
+            val.kind = FLOAT;
+            val.f = v;
+            return val;
+        }
+
+        double as_float() const {
+            return kind == INT ? static_cast<double>(i) : f;
+        }
+
+        bool operator==(const Value &rhs) const {
+            if (kind != rhs.kind) {
+                return false;
+            }
+            // NaN 与自身相等, 便于比较不同求值器的结果
+            return kind == INT ? i == rhs.i : (f == rhs.f || (std::isnan(f) && std::isnan(rhs.f)));
+        }
+
+        std::string repr() const {
+            return kind == INT ? std::format("{}", i) : std::format("{}", f);
+        }
+    };
+
+    enum class EvalStatus : uint8_t {
+        OK              = 0,
+        INT_OVERFLOW    = 1,    // 整数运算或字面量溢出
+        DIV_BY_ZERO     = 2,    // 整数除以 0 或对 0 取模
+        INVALID_LITERAL = 3,
+        UNBOUND         = 4,    // 标识符没有绑定值
+        UNSUPPORTED     = 5     // 不支持的运算或字面量 (如字符串)
+    };
+
+    const char *to_string(EvalStatus status) noexcept;
+
+    namespace detail {
+        constexpr int literal_digit_value(char ch) {
+            if ('0' <= ch && ch <= '9') return ch - '0';
+            if ('a' <= ch && ch <= 'f') return ch - 'a' + 10;
+            if ('A' <= ch && ch <= 'F') return ch - 'A' + 10;
+            return 64;
+        }
+
+        constexpr EvalStatus parse_integer(std::string_view digits, int base, Value &out) {
+            if (digits.empty()) {
+                return EvalStatus::INVALID_LITERAL;
+            }
+
+            int64_t value = 0;
+            for (char ch : digits) {
+                int digit = literal_digit_value(ch);
+                if (digit >= base) {
+                    return EvalStatus::INVALID_LITERAL;
+                }
+                if (__builtin_mul_overflow(value, base, &value) || __builtin_add_overflow(value, digit, &value)) {
+                    return EvalStatus::INT_OVERFLOW;
+                }
+            }
+
+            out = Value::of(value);
+            return EvalStatus::OK;
+        }
+
+        // 解码 'x' 或 '\n' 形式的字符字面量
+        constexpr EvalStatus parse_char(std::string_view text, Value &out) {
+            if (text.size() < 3 || text.front() != '\'' || text.back() != '\'') {
+                return EvalStatus::INVALID_LITERAL;
+            }
+            text = text.substr(1, text.size() - 2);
+
+            if (text[0] != '\\') {
+                // 复制一份再解码, 保证解码在字面量之内以 '\0' 结束
+                char seq[5] = {};
+                for (size_t i = 0 ; i < text.size() && i < 4 ; i ++) {
+                    seq[i] = text[i];
+                }
+                int length = 1;
+                uint32_t cp = utf8_decode(seq, length);
+                if (cp == UTF8_INVALID || static_cast<size_t>(length) != text.size()) {
+                    return EvalStatus::INVALID_LITERAL;
+                }
+                out = Value::of(static_cast<int64_t>(cp));
+                return EvalStatus::OK;
+            }
+
+            if (text.size() < 2) {
+                return EvalStatus::INVALID_LITERAL;
+            }
+
+            int64_t code = 0;
+            switch (text[1]) {
+            case 'a': code = '\a'; break;
+            case 'b': code = '\b'; break;
+            case 'f': code = '\f'; break;
+            case 'n': code = '\n'; break;
+            case 'r': code = '\r'; break;
+            case 't': code = '\t'; break;
+            case 'v': code = '\v'; break;
+            case '?': code = '?'; break;
+            case '\\': code = '\\'; break;
+            case '\'': code = '\''; break;
+            case '"': code = '"'; break;
+            case 'x': case 'X':
+                return parse_integer(text.substr(2), 16, out);
+            case 'u': case 'U':
+                return parse_integer(text.substr(2), 16, out);
+            default:
+                return parse_integer(text.substr(1), 8, out);
+            }
+
+            if (text.size() != 2) {
+                return EvalStatus::INVALID_LITERAL;
+            }
+            out = Value::of(code);
+            return EvalStatus::OK;
+        }
+    }
+
+    // 解析 DEC/HEX/OCT/BIN_INTEGER, FLOAT 与 LITERAL_CHAR 字面量
+    // 整数与字符字面量的解析是 constexpr 的, 编译期的片段 (eval/embedded.h) 使用同一份实现
+    EvalStatus parse_literal(const Token *tok, Value &out);
+
+    // 二元算术运算 + - * / %
+    // 整数: 溢出返回 INT_OVERFLOW, 除数为 0 返回 DIV_BY_ZERO
+    // 浮点: 遵循 IEEE 754, % 为 fmod
+    inline EvalStatus apply_binary(TokenType op, Value lhs, Value rhs, Value &out) {
+        if (lhs.kind == Value::INT && rhs.kind == Value::INT) {
+            int64_t a = lhs.i, b = rhs.i, r = 0;
+            switch (op) {
+            case TokenType::SIGN_ADD:
+                if (__builtin_add_overflow(a, b, &r)) return EvalStatus::INT_OVERFLOW;
+                break;
+            case TokenType::SIGN_SUB:
+                if (__builtin_sub_overflow(a, b, &r)) return EvalStatus::INT_OVERFLOW;
+                break;
+            case TokenType::SIGN_MUL:
+                if (__builtin_mul_overflow(a, b, &r)) return EvalStatus::INT_OVERFLOW;
+                break;
+            case TokenType::SIGN_DIV:
+                if (b == 0) return EvalStatus::DIV_BY_ZERO;
+                if (a == INT64_MIN && b == -1) return EvalStatus::INT_OVERFLOW;
+                r = a / b;
+                break;
+            case TokenType::SIGN_MOD:
+                if (b == 0) return EvalStatus::DIV_BY_ZERO;
+                r = (b == -1) ? 0 : a % b;
+                break;
+            default:
+                return EvalStatus::UNSUPPORTED;
+            }
+            out = Value::of(r);
+            return EvalStatus::OK;
+        }
+
+        double a = lhs.as_float(), b = rhs.as_float(), r = 0;
+        switch (op) {
+        case TokenType::SIGN_ADD: r = a + b; break;
+        case TokenType::SIGN_SUB: r = a - b; break;
+        case TokenType::SIGN_MUL: r = a * b; break;
+        case TokenType::SIGN_DIV: r = a / b; break;
+        case TokenType::SIGN_MOD: r = std::fmod(a, b); break;
+        default:
+            return EvalStatus::UNSUPPORTED;
+        }
+        out = Value::of(r);
+        return EvalStatus::OK;
+    }
+
+    // 生成能被词法分析器识别为单个字面量的文本
+    // 负数与非有限的浮点数无法写成一个字面量, 返回 false
+    bool literal_text(Value value, std::string &text, TokenType &type);
+}
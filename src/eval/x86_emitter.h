@@ -0,0 +1,183 @@
+#pragma once
+
+#include "util/util.h"
+
+namespace rain::x86 {
+    // JIT 用到的极小 x86-64 指令编码器
+    // 只覆盖 64 位寄存器间运算, [base + disp32] 形式的内存操作数与 rel32 跳转
+
+    enum Reg : uint8_t {
+        RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+        R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15
+    };
+
+    enum Cond : uint8_t {
+        OVERFLOW  = 0x0,
+        EQUAL     = 0x4,
+        NOT_EQUAL = 0x5
+    };
+
+    class Emitter {
+    public:
+        // 待回填的跳转, 记录 rel32 的位置
+        using Fixup = size_t;
+
+        std::vector<uint8_t> code;
+
+        size_t offset() const {
+            return code.size();
+        }
+
+        // mov dst, imm64
+        void mov(Reg dst, int64_t imm) {
+            if (imm >= INT32_MIN && imm <= INT32_MAX) {
+                // mov r/m64, imm32 (符号扩展)
+                rex(0, dst);
+                byte(0xC7);
+                modrm(3, 0, dst);
+                imm32(static_cast<int32_t>(imm));
+                return;
+            }
+            rex(0, dst);
+            byte(0xB8 + (dst & 7));
+            for (int i = 0 ; i < 8 ; i ++) {
+                byte(static_cast<uint8_t>(static_cast<uint64_t>(imm) >> (i * 8)));
+            }
+        }
+
+        // mov dst, src
+        void mov(Reg dst, Reg src) {
+            rex(src, dst);
+            byte(0x89);
+            modrm(3, src, dst);
+        }
+
+        // mov dst, [base + disp]
+        void load(Reg dst, Reg base, int32_t disp) {
+            rex(dst, base);
+            byte(0x8B);
+            mem(dst, base, disp);
+        }
+
+        // mov [base + disp], src
+        void store(Reg base, int32_t disp, Reg src) {
+            rex(src, base);
+            byte(0x89);
+            mem(src, base, disp);
+        }
+
+        void add(Reg dst, Reg src) {
+            rex(src, dst);
+            byte(0x01);
+            modrm(3, src, dst);
+        }
+
+        void sub(Reg dst, Reg src) {
+            rex(src, dst);
+            byte(0x29);
+            modrm(3, src, dst);
+        }
+
+        void imul(Reg dst, Reg src) {
+            rex(dst, src);
+            byte(0x0F);
+            byte(0xAF);
+            modrm(3, dst, src);
+        }
+
+        // rdx:rax / src, 商在 rax, 余数在 rdx
+        void cqo_idiv(Reg src) {
+            byte(0x48);
+            byte(0x99);
+            rex(0, src);
+            byte(0xF7);
+            modrm(3, 7, src);
+        }
+
+        void test(Reg a, Reg b) {
+            rex(b, a);
+            byte(0x85);
+            modrm(3, b, a);
+        }
+
+        // cmp reg, imm8
+        void cmp(Reg reg, int8_t imm) {
+            rex(0, reg);
+            byte(0x83);
+            modrm(3, 7, reg);
+            byte(static_cast<uint8_t>(imm));
+        }
+
+        // cmp byte [base + disp], imm8
+        void cmp_byte(Reg base, int32_t disp, int8_t imm) {
+            if (base >= R8) {
+                byte(0x41);
+            }
+            byte(0x80);
+            mem(7, base, disp);
+            byte(static_cast<uint8_t>(imm));
+        }
+
+        // sub rsp, imm32 / add rsp, imm32
+        void adjust_stack(int32_t delta) {
+            rex(0, RSP);
+            byte(0x81);
+            modrm(3, delta >= 0 ? 0 : 5, RSP);
+            imm32(delta >= 0 ? delta : -delta);
+        }
+
+        void mov32(Reg dst, int32_t imm) {
+            if (dst >= R8) {
+                byte(0x41);
+            }
+            byte(0xB8 + (dst & 7));
+            imm32(imm);
+        }
+
+        void ret() {
+            byte(0xC3);
+        }
+
+        // 条件跳转, 目标稍后用 bind 回填
+        Fixup jcc(Cond cond) {
+            byte(0x0F);
+            byte(0x80 + cond);
+            imm32(0);
+            return code.size() - 4;
+        }
+
+        void bind(Fixup fixup, size_t target) {
+            int32_t rel = static_cast<int32_t>(target - (fixup + 4));
+            memcpy(code.data() + fixup, &rel, sizeof(rel));
+        }
+
+    private:
+        void byte(uint8_t b) {
+            code.push_back(b);
+        }
+
+        void imm32(int32_t imm) {
+            uint8_t bytes[4];
+            memcpy(bytes, &imm, sizeof(imm));
+            code.insert(code.end(), bytes, bytes + 4);
+        }
+
+        // REX.W, 以及 ModRM 中 reg 与 rm 字段的扩展位
+        void rex(uint8_t reg, uint8_t rm) {
+            byte(0x48 | ((reg >> 3) << 2) | (rm >> 3));
+        }
+
+        void modrm(uint8_t mod, uint8_t reg, uint8_t rm) {
+            byte((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+        }
+
+        // [base + disp32], 以 rsp/r12 为基址时需要 SIB 字节
+        void mem(uint8_t reg, Reg base, int32_t disp) {
+            modrm(2, reg, base);
+            if ((base & 7) == RSP) {
+                byte(0x24);
+            }
+            imm32(disp);
+        }
+    };
+}
@@ -18,7 +18,7 @@ bytebuffer rain::readall(const char *filepath)
     assert(filesz = ftell(fp));
     assert(! fseek(fp, 0, SEEK_SET));
     
-    if ((buffer = new char[filesz]) == nullptr) {
+    if ((buffer = bytebuffer::allocate(filesz)) == nullptr) {
         throw std::bad_alloc();
     }
 
@@ -2,4 +2,4 @@
 
 using namespace rain;
 
-mem::Pool<PosInfo> PosInfo::pool = mem::Pool<PosInfo>(1000);
\ No newline at end of file
+thread_local mem::Pool<PosInfo> PosInfo::pool = mem::Pool<PosInfo>(1000);
\ No newline at end of file
@@ -4,7 +4,8 @@
 
 namespace rain {
     struct PosInfo {
-        static mem::Pool<PosInfo> pool;
+        // 每个线程一个, 由创建它的线程释放
+        static thread_local mem::Pool<PosInfo> pool;
 
         std::string path;
         int line;
@@ -14,6 +15,16 @@ namespace rain {
             : path(path), line(line), column(column)
         {
             pool.mark(this);
+            RAIN_MEM_ALLOC(POSITION, footprint());
+        }
+
+        ~PosInfo() {
+            RAIN_MEM_FREE(POSITION, footprint());
+        }
+
+        // 对象本身与 path 在堆上占用的字节数
+        [[nodiscard]] size_t footprint() const {
+            return sizeof(PosInfo) + mem::heap_bytes(path);
         }
     };
 }
\ No newline at end of file
@@ -0,0 +1,261 @@
+#include "file/prefetch.h"
+
+#include "file/helper.h"
+#include "util/trace.h"
+
+#include <cerrno>
+#include <cstring>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef RAIN_IO_URING
+#include <liburing.h>
+#endif
+
+using namespace rain;
+
+#ifdef RAIN_IO_URING
+struct SourcePrefetcher::Uring {
+    io_uring ring;
+    bool initialized = false;
+
+    ~Uring() {
+        if (initialized) {
+            io_uring_queue_exit(&ring);
+        }
+    }
+};
+#else
+struct SourcePrefetcher::Uring {
+};
+#endif
+
+SourcePrefetcher::SourcePrefetcher(size_t depth)
+    : depth(std::max<size_t>(depth, 1))
+{
+#ifdef RAIN_IO_URING
+    // 在容器等环境中 io_uring 可能被禁用, 此时使用读取线程
+    uring = std::make_unique<Uring>();
+    uring->initialized = io_uring_queue_init(static_cast<unsigned>(this->depth), &uring->ring, 0) == 0;
+    if (! uring->initialized) {
+        uring.reset();
+    }
+#endif
+    reader = std::thread([this]() {
+        trace::thread_name("prefetch");
+        read_loop();
+    });
+}
+
+SourcePrefetcher::~SourcePrefetcher() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    requested.notify_all();
+    reader.join();
+
+#if defined(__unix__)
+    for (Request &request : queue) {
+        if (request.fd >= 0) {
+            close(request.fd);
+        }
+    }
+#endif
+}
+
+void SourcePrefetcher::request(const std::string &path) {
+    {
+        std::lock_guard lock(mutex);
+        queue.push_back(Request{path});
+    }
+    requested.notify_one();
+}
+
+bytebuffer SourcePrefetcher::take(const std::string &path) {
+    RAIN_TRACE_SPAN("prefetch wait", path);
+    std::optional<bytebuffer> buffer;
+    std::string error;
+    {
+        std::unique_lock lock(mutex);
+        filled.wait(lock, [&]() { return ready.contains(path); });
+        auto it = ready.find(path);
+        if (it->second.buffer) {
+            buffer.emplace(std::move(*it->second.buffer));
+        }
+        error = std::move(it->second.error);
+        ready.erase(it);
+    }
+    // 腾出了一个位置
+    requested.notify_one();
+
+    if (! buffer) {
+        throw std::invalid_argument(error);
+    }
+    return std::move(*buffer);
+}
+
+void SourcePrefetcher::read_loop() {
+    while (true) {
+        // 对队列前 depth 个文件提示预读
+        // deque 的 push_back 不会使已有元素的引用失效, 只有本线程会移除元素, 因此可以在锁外处理
+        std::vector<Request *> to_advise;
+        size_t room;
+        {
+            std::unique_lock lock(mutex);
+            requested.wait(lock, [this]() { return stopping || (! queue.empty() && ready.size() < depth); });
+            if (stopping) {
+                return;
+            }
+            for (size_t i = 0 ; i < std::min(queue.size(), depth) ; i ++) {
+                if (! queue[i].advised) {
+                    queue[i].advised = true;
+                    to_advise.push_back(&queue[i]);
+                }
+            }
+            room = depth - ready.size();
+        }
+        for (Request *request : to_advise) {
+            advise(*request);
+        }
+
+        // 读取线程一次读一个文件, 其余文件由内核在后台预读; io_uring 一次发出所有空位的读取
+        std::vector<Request> batch;
+        {
+            std::lock_guard lock(mutex);
+            size_t count = uring != nullptr ? std::min(room, queue.size()) : 1;
+            for (size_t i = 0 ; i < count ; i ++) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+        }
+
+        std::vector<Filled> results(batch.size());
+        if (uring != nullptr) {
+            RAIN_TRACE_SPAN("prefetch batch");
+            read_batch(batch, results);
+        }
+        else {
+            RAIN_TRACE_SPAN("prefetch", batch.front().path);
+            read_one(batch.front(), results.front());
+        }
+
+        {
+            std::lock_guard lock(mutex);
+            for (size_t i = 0 ; i < batch.size() ; i ++) {
+                ready.emplace(batch[i].path, std::move(results[i]));
+            }
+        }
+        filled.notify_all();
+    }
+}
+
+void SourcePrefetcher::advise(Request &request) {
+#if defined(__unix__)
+    int fd = open(request.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return;
+    }
+    request.fd = fd;
+    request.size = st.st_size;
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+#endif
+}
+
+#if defined(__unix__)
+// 从 offset 处读完剩余部分, 文件在此期间变短时将缺少的部分填零, 返回实际读到的字节数
+static size_t __read_rest__(int fd, char *buffer, size_t offset, size_t size) {
+    while (offset < size) {
+        ssize_t n = pread(fd, buffer + offset, size - offset, offset);
+        if (n <= 0) {
+            memset(buffer + offset, 0, size - offset);
+            break;
+        }
+        offset += n;
+    }
+    return offset;
+}
+#endif
+
+void SourcePrefetcher::read_one(Request &request, Filled &result) {
+    try {
+#if defined(__unix__)
+        if (request.fd >= 0) {
+            char *buffer = bytebuffer::allocate(request.size);
+            size_t size = __read_rest__(request.fd, buffer, 0, request.size);
+            close(request.fd);
+            request.fd = -1;
+            result.buffer.emplace(size, buffer);
+            return;
+        }
+#endif
+        // 打不开时交给 readall, 得到相同的错误
+        result.buffer.emplace(readall(request.path.c_str()));
+    }
+    catch (const std::exception &e) {
+        result.error = e.what();
+    }
+}
+
+void SourcePrefetcher::read_batch(std::vector<Request> &batch, std::vector<Filled> &results) {
+#ifdef RAIN_IO_URING
+    std::vector<char *> buffers(batch.size(), nullptr);
+    size_t inflight = 0;
+    for (size_t i = 0 ; i < batch.size() ; i ++) {
+        if (batch[i].fd < 0 || batch[i].size == 0) {
+            read_one(batch[i], results[i]);
+            continue;
+        }
+        // 一批最多 depth 个读取, 不会超出提交队列
+        buffers[i] = bytebuffer::allocate(batch[i].size);
+        io_uring_sqe *sqe = io_uring_get_sqe(&uring->ring);
+        io_uring_prep_read(sqe, batch[i].fd, buffers[i], batch[i].size, 0);
+        io_uring_sqe_set_data64(sqe, i);
+        inflight ++;
+    }
+    io_uring_submit(&uring->ring);
+
+    std::vector<size_t> done(batch.size(), 0);
+    while (inflight > 0) {
+        io_uring_cqe *cqe;
+        int err = io_uring_wait_cqe(&uring->ring, &cqe);
+        if (err == -EINTR) {
+            continue;
+        }
+        if (err < 0) {
+            break;
+        }
+        size_t i = io_uring_cqe_get_data64(cqe);
+        done[i] = cqe->res > 0 ? cqe->res : 0;
+        io_uring_cqe_seen(&uring->ring, cqe);
+        inflight --;
+    }
+
+    // 短读或出错时用 pread 读完剩余部分
+    for (size_t i = 0 ; i < batch.size() ; i ++) {
+        if (buffers[i] == nullptr) {
+            continue;
+        }
+        size_t size = __read_rest__(batch[i].fd, buffers[i], done[i], batch[i].size);
+        close(batch[i].fd);
+        batch[i].fd = -1;
+        results[i].buffer.emplace(size, buffers[i]);
+    }
+#else
+    for (size_t i = 0 ; i < batch.size() ; i ++) {
+        read_one(batch[i], results[i]);
+    }
+#endif
+}
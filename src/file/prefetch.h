@@ -0,0 +1,80 @@
+#pragma once
+
+#include "util/util.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace rain {
+    // 后台预读源文件, 使文件 I/O 与词法分析重叠
+    //
+    // request 将路径排入读取队列, 读取线程先对队列前 depth 个文件提示内核预读 (posix_fadvise WILLNEED),
+    // 再逐个读入缓冲区; 以 RAIN_IO_URING 构建时改用 io_uring 同时发出这些文件的读取, 初始化失败时退回读取线程
+    // 读好的缓冲区由 take 取走, 未取走的缓冲区最多 depth 个, 读取线程在队列满时等待
+    //
+    // take 的顺序须与 request 的顺序大致相同, 且每个请求的路径恰好被取走一次, 否则读取线程会因队列满而停住
+    class SourcePrefetcher {
+    public:
+        explicit SourcePrefetcher(size_t depth);
+        ~SourcePrefetcher();
+
+        SourcePrefetcher(const SourcePrefetcher &) = delete;
+        SourcePrefetcher &operator=(const SourcePrefetcher &) = delete;
+
+        // 将 path 排入读取队列
+        void request(const std::string &path);
+
+        // 等待 path 读取完毕并取走缓冲区, 读取失败时抛出与 readall 相同的异常
+        bytebuffer take(const std::string &path);
+
+        // 使用的后端, "thread" 或 "io_uring"
+        [[nodiscard]] const char *backend() const {
+            return uring != nullptr ? "io_uring" : "thread";
+        }
+
+    private:
+        struct Request {
+            std::string path;
+            int fd = -1;
+            size_t size = 0;
+            bool advised = false;
+        };
+
+        struct Filled {
+            std::optional<bytebuffer> buffer;
+            std::string error;
+        };
+
+        size_t depth;
+
+        // io_uring 的状态, 未使用 io_uring 时为空
+        struct Uring;
+        std::unique_ptr<Uring> uring;
+
+        std::mutex mutex;
+        std::condition_variable requested;
+        std::condition_variable filled;
+        std::deque<Request> queue;
+        std::map<std::string, Filled> ready;
+        bool stopping = false;
+
+        std::thread reader;
+
+        void read_loop();
+
+        // 打开文件并提示内核预读, 失败时 fd 为 -1
+        static void advise(Request &request);
+
+        // 读取线程后端, 读取一个文件
+        static void read_one(Request &request, Filled &result);
+
+        // io_uring 后端, 同时读取一批文件
+        void read_batch(std::vector<Request> &batch, std::vector<Filled> &results);
+    };
+}
@@ -0,0 +1,261 @@
+#pragma once
+
+#include "lexer/token_type.h"
+#include "util/utf8.h"
+
+#include <cstddef>
+
+namespace rain {
+    // 数字, 标识符, 转义序列, 字符与字符串字面量的扫描函数
+    // 由 Lexer 与编译期的片段分析 (eval/embedded.h) 共用, 两者对同一段源码得到相同的 token 划分
+    //
+    // 输入以 '\0' 结尾, 扫描不会读到第一个 '\0' 之后, 因此既可以用于零填充的缓冲区, 也可以在常量求值中使用
+    // 扫描函数返回 token 的字节数, 错误通过 error(kind, offset, got) 报告
+    // offset 为出错处相对 token 起点的字节偏移, got 为该处的字符, 报告错误后扫描照常继续
+
+    enum class ScanError : uint8_t {
+        HEX_DIGIT = 0,      // 0x 之后没有十六进制数字
+        OCT_DIGIT,          // 八进制整数中的 8 或 9
+        BIN_DIGIT,          // 二进制整数中 0, 1 以外的数字, 或 0b 之后没有数字
+        HEX_ESCAPE,         // \x 之后不是两位十六进制数字
+        OCT_ESCAPE,         // \o 之后不是三位八进制数字
+        UNICODE_ESCAPE,     // \u, \U 之后不是 4 或 8 位十六进制数字
+        ESCAPE,             // 未知的转义序列
+        CHAR_MISSING,       // 空的字符字面量
+        CHAR_CLOSING,       // 字符字面量缺少右引号
+        STRING_CLOSING      // 字符串字面量缺少右引号
+    };
+
+    namespace detail {
+        constexpr bool is_dec_digit(char ch) {
+            return '0' <= ch && ch <= '9';
+        }
+
+        constexpr bool is_hex_digit(char ch) {
+            return is_dec_digit(ch) || ('a' <= ch && ch <= 'f') || ('A' <= ch && ch <= 'F');
+        }
+
+        constexpr bool is_oct_digit(char ch) {
+            return '0' <= ch && ch <= '7';
+        }
+
+        constexpr bool is_bin_digit(char ch) {
+            return ch == '0' || ch == '1';
+        }
+
+        constexpr bool is_ascii_alpha(char ch) {
+            return ('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z');
+        }
+    }
+
+    // p 处的字符能否出现在标识符中, 能则返回其字节数, 否则返回 0
+    // ASCII 直接判断, 其余按 XID_Start / XID_Continue 查表
+    constexpr int identifier_char(const char *p, bool start) {
+        char ch = p[0];
+        if (! (static_cast<unsigned char>(ch) & 0x80)) {
+            bool ok = detail::is_ascii_alpha(ch) || ch == '_' || (! start && detail::is_dec_digit(ch));
+            return ok ? 1 : 0;
+        }
+
+        int length = 1;
+        uint32_t cp = utf8_decode(p, length);
+        if (cp == UTF8_INVALID) {
+            return 0;
+        }
+        return (start ? is_xid_start(cp) : is_xid_continue(cp)) ? length : 0;
+    }
+
+    // p 处为标识符的第一个字符
+    constexpr size_t scan_identifier(const char *p) {
+        size_t i = 0;
+        int length;
+        while ((length = identifier_char(p + i, i == 0)) > 0) {
+            i += length;
+        }
+        return i;
+    }
+
+    // 以数字开头时按前两个字符判断整数的进制, 其它字符返回 NONE
+    // 十进制整数扫描后可能成为 FLOAT
+    constexpr TokenType number_type(const char *p) {
+        if (! detail::is_dec_digit(p[0])) {
+            return TokenType::NONE;
+        }
+        if (p[0] != '0') {
+            return TokenType::DEC_INTEGER;
+        }
+        if (detail::is_dec_digit(p[1])) {
+            return TokenType::OCT_INTEGER;
+        }
+        if (p[1] == 'x' || p[1] == 'X') {
+            return TokenType::HEX_INTEGER;
+        }
+        if (p[1] == 'b' || p[1] == 'B') {
+            return TokenType::BIN_INTEGER;
+        }
+        return TokenType::DEC_INTEGER;
+    }
+
+    // 十进制整数或浮点数, 有小数点时 type 置为 FLOAT
+    constexpr size_t scan_decimal(const char *p, TokenType &type) {
+        type = TokenType::DEC_INTEGER;
+        // 0 之后只能是小数部分, 例如 0.5
+        if (p[0] == '0' && p[1] != '.') {
+            return 1;
+        }
+
+        size_t i = 1;
+        while (detail::is_dec_digit(p[i])) {
+            i ++;
+        }
+        if (p[i] == '.') {
+            type = TokenType::FLOAT;
+            i ++;
+            while (detail::is_dec_digit(p[i])) {
+                i ++;
+            }
+        }
+        return i;
+    }
+
+    // p 处为 0x 或 0X
+    template<typename Error>
+    constexpr size_t scan_hex(const char *p, Error &&error) {
+        if (! detail::is_hex_digit(p[2])) {
+            error(ScanError::HEX_DIGIT, 2, p[2]);
+            return 2;
+        }
+
+        size_t i = 3;
+        while (detail::is_hex_digit(p[i])) {
+            i ++;
+        }
+        return i;
+    }
+
+    // p 处为 0 且其后是数字, 8 与 9 报错后继续扫描
+    template<typename Error>
+    constexpr size_t scan_octal(const char *p, Error &&error) {
+        size_t i = 1;
+        for (; detail::is_dec_digit(p[i]) ; i ++) {
+            if (! detail::is_oct_digit(p[i])) {
+                error(ScanError::OCT_DIGIT, i, p[i]);
+            }
+        }
+        return i;
+    }
+
+    // p 处为 0b 或 0B, 其后没有数字时与十六进制一样只取前缀
+    template<typename Error>
+    constexpr size_t scan_binary(const char *p, Error &&error) {
+        if (! detail::is_dec_digit(p[2])) {
+            error(ScanError::BIN_DIGIT, 2, p[2]);
+            return 2;
+        }
+
+        size_t i = 2;
+        for (; detail::is_dec_digit(p[i]) ; i ++) {
+            if (! detail::is_bin_digit(p[i])) {
+                error(ScanError::BIN_DIGIT, i, p[i]);
+            }
+        }
+        return i;
+    }
+
+    // token 中从 at 处的反斜杠开始的转义序列的长度, 错误的位置都记在反斜杠处
+    template<typename Error>
+    constexpr size_t scan_escape(const char *p, size_t at, Error &&error) {
+        const char *s = p + at;
+        char ch = s[1];
+        switch (ch) {
+        case 'a': case 'b': case 'f': case 'n':
+        case 'r': case 't': case 'v': case '?':
+        case '\\': case '\'': case '"':
+            return 2;
+        case 'x': case 'X':
+            // \xhh
+            if (! detail::is_hex_digit(s[2]) || ! detail::is_hex_digit(s[3])) {
+                error(ScanError::HEX_ESCAPE, at, ch);
+                return 2;
+            }
+            return 4;
+        case '0':
+            if (! detail::is_oct_digit(s[2])) {
+                return 2;
+            }
+            [[fallthrough]];
+        case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7':
+            // \ooo
+            if (! detail::is_oct_digit(s[2]) || ! detail::is_oct_digit(s[3])) {
+                error(ScanError::OCT_ESCAPE, at, ch);
+                return 2;
+            }
+            return 4;
+        case 'u': case 'U': {
+            // \uXXXX 或 \UXXXXXXXX
+            size_t digits = (ch == 'u') ? 4 : 8;
+            for (size_t i = 2 ; i < 2 + digits ; i ++) {
+                if (! detail::is_hex_digit(s[i])) {
+                    error(ScanError::UNICODE_ESCAPE, at, s[i]);
+                    return i;
+                }
+            }
+            return 2 + digits;
+        }
+        case '\0': case '\n':
+            // 结尾留给调用者处理
+            error(ScanError::ESCAPE, at, ch);
+            return 1;
+        default:
+            error(ScanError::ESCAPE, at, ch);
+            return 2;
+        }
+    }
+
+    // p 处为左双引号, 缺少右引号时在行尾或结尾处停止
+    template<typename Error>
+    constexpr size_t scan_string(const char *p, Error &&error) {
+        size_t i = 1;
+        while (true) {
+            char ch = p[i];
+            if (ch == '"') {
+                return i + 1;
+            }
+            if (ch == '\\') {
+                i += scan_escape(p, i, error);
+            }
+            else if (ch == '\0' || ch == '\n') {
+                error(ScanError::STRING_CLOSING, i, ch);
+                return i;
+            }
+            else {
+                i ++;
+            }
+        }
+    }
+
+    // p 处为左单引号, 字符是一个完整的码点或一个转义序列
+    template<typename Error>
+    constexpr size_t scan_char(const char *p, Error &&error) {
+        size_t i = 1;
+        char ch = p[i];
+        if (ch == '\\') {
+            i += scan_escape(p, i, error);
+        }
+        else if (ch == '\'' || ch == '\0' || ch == '\n') {
+            error(ScanError::CHAR_MISSING, i, ch);
+        }
+        else {
+            int length = 1;
+            utf8_decode(p + i, length);
+            i += length;
+        }
+
+        if (p[i] != '\'') {
+            error(ScanError::CHAR_CLOSING, i, p[i]);
+            return i;
+        }
+        return i + 1;
+    }
+}
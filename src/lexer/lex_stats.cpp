@@ -0,0 +1,70 @@
+#include "lexer/lex_stats.h"
+
+#ifdef RAIN_LEX_STATS
+
+using namespace rain;
+
+thread_local LexStats *LexStats::active = nullptr;
+
+const char *LexStats::phase_name(Phase phase) {
+    switch (phase) {
+    case PHASE_SKIP: return "__skip__";
+    case PHASE_SYMBOL: return "__symbol__";
+    case PHASE_NONSYMBOL: return "__nonsymbol__";
+    case PHASE_DEC_INTEGER_OR_FLOAT: return "__dec_integer_or_float__";
+    case PHASE_HEX_INTEGER: return "__hex_integer__";
+    case PHASE_OCT_INTEGER: return "__oct_integer__";
+    case PHASE_BIN_INTEGER: return "__bin_integer__";
+    case PHASE_IDENTIFIER_OR_KEYWORD: return "__identifier_or_keyword__";
+    case PHASE_LITERAL_STRING: return "__literal_string__";
+    case PHASE_LITERAL_CHAR: return "__literal_char__";
+    case PHASE_KEYWORD_LOOKUP: return "__keyword_trie__::lookup";
+    default: break;
+    }
+    return "<unknown>";
+}
+
+std::string LexStats::dump_text() const {
+    std::string out;
+    out += std::format("whitespace bytes: {}\n", whitespace_bytes);
+    out += std::format("comment bytes:    {}\n", comment_bytes);
+    out += std::format("keyword lookup:   {} hits, {} misses\n", keyword_hits, keyword_misses);
+    out += std::format("errors:           {}\n", errors);
+
+    out += "tokens:\n";
+    for (const auto &[type, count] : token_counts) {
+        out += std::format("  {:<20} {}\n", to_string(type), count);
+    }
+
+    out += "phases:\n";
+    for (int i = 0 ; i < PHASE_COUNT ; i ++) {
+        out += std::format("  {:<28} {:>10} calls {:>14} cycles\n",
+                           phase_name(static_cast<Phase>(i)), calls[i], cycles[i]);
+    }
+    return out;
+}
+
+std::string LexStats::dump_json() const {
+    std::string out = "{";
+    out += std::format("\"whitespace_bytes\":{},\"comment_bytes\":{},", whitespace_bytes, comment_bytes);
+    out += std::format("\"keyword_hits\":{},\"keyword_misses\":{},", keyword_hits, keyword_misses);
+    out += std::format("\"errors\":{},", errors);
+
+    out += "\"tokens\":{";
+    bool first = true;
+    for (const auto &[type, count] : token_counts) {
+        out += std::format("{}\"{}\":{}", first ? "" : ",", to_string(type), count);
+        first = false;
+    }
+    out += "},";
+
+    out += "\"phases\":{";
+    for (int i = 0 ; i < PHASE_COUNT ; i ++) {
+        out += std::format("{}\"{}\":{{\"calls\":{},\"cycles\":{}}}",
+                           i == 0 ? "" : ",", phase_name(static_cast<Phase>(i)), calls[i], cycles[i]);
+    }
+    out += "}}";
+    return out;
+}
+
+#endif
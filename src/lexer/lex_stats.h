@@ -0,0 +1,97 @@
+#pragma once
+
+// 词法分析统计, 仅在定义 RAIN_LEX_STATS 时编译
+// 未定义时 RAIN_LEX_STAT / RAIN_LEX_PHASE 展开为空, 不产生任何开销
+
+#ifdef RAIN_LEX_STATS
+
+#include "util/util.h"
+#include "lexer/token_type.h"
+
+#include <chrono>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace rain {
+    struct LexStats {
+        enum Phase {
+            PHASE_SKIP = 0,
+            PHASE_SYMBOL,
+            PHASE_NONSYMBOL,
+            PHASE_DEC_INTEGER_OR_FLOAT,
+            PHASE_HEX_INTEGER,
+            PHASE_OCT_INTEGER,
+            PHASE_BIN_INTEGER,
+            PHASE_IDENTIFIER_OR_KEYWORD,
+            PHASE_LITERAL_STRING,
+            PHASE_LITERAL_CHAR,
+            PHASE_KEYWORD_LOOKUP,
+            PHASE_COUNT
+        };
+
+        // 当前线程正在 produce 的 lexer 的统计
+        static thread_local LexStats *active;
+
+        size_t whitespace_bytes = 0;
+        size_t comment_bytes = 0;
+        std::map<TokenType, size_t> token_counts;
+        size_t keyword_hits = 0;
+        size_t keyword_misses = 0;
+        size_t errors = 0;
+
+        // 各个子 lexer 的调用次数与周期数 (包含其调用的子 lexer)
+        size_t calls[PHASE_COUNT] = {};
+        uint64_t cycles[PHASE_COUNT] = {};
+
+        static const char *phase_name(Phase phase);
+
+        static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+        }
+
+        std::string dump_text() const;
+        std::string dump_json() const;
+    };
+
+    class LexPhaseTimer {
+    private:
+        LexStats::Phase phase;
+        uint64_t begin;
+    public:
+        LexPhaseTimer(LexStats::Phase phase)
+            : phase(phase), begin(LexStats::now())
+        {
+        }
+
+        ~LexPhaseTimer() {
+            if (LexStats::active != nullptr) {
+                LexStats::active->calls[phase] += 1;
+                LexStats::active->cycles[phase] += LexStats::now() - begin;
+            }
+        }
+    };
+}
+
+#define RAIN_LEX_STAT(...)                                          \
+    do {                                                            \
+        if (rain::LexStats::active != nullptr) {                    \
+            rain::LexStats &stats = *rain::LexStats::active;        \
+            __VA_ARGS__;                                            \
+        }                                                           \
+    } while (0)
+
+#define RAIN_LEX_PHASE(phase) \
+    rain::LexPhaseTimer __lex_phase_timer__(rain::LexStats::phase)
+
+#else
+
+#define RAIN_LEX_STAT(...) ((void) 0)
+#define RAIN_LEX_PHASE(phase) ((void) 0)
+
+#endif
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "lexer/token_type.h"
+
+#include <string_view>
+
+namespace rain {
+    // 关键字与运算符的拼写表, 由 Lexer 与编译期的嵌入片段共用
+    struct Spelling {
+        const char *text;
+        TokenType type;
+    };
+
+    inline constexpr Spelling KEYWORD_TABLE[] = {
+        {"if",       TokenType::KEYWORD_IF},
+        {"else",     TokenType::KEYWORD_ELSE},
+        {"for",      TokenType::KEYWORD_FOR},
+        {"foreach",  TokenType::KEYWORD_FOREACH},
+        {"while",    TokenType::KEYWORD_WHILE},
+        {"return",   TokenType::KEYWORD_RETURN},
+        {"break",    TokenType::KEYWORD_BREAK},
+        {"continue", TokenType::KEYWORD_CONTINUE},
+        {"do",       TokenType::KEYWORD_DO},
+        {"byte",     TokenType::KEYWORD_BYTE},
+        {"short",    TokenType::KEYWORD_SHORT},
+        {"int",      TokenType::KEYWORD_INT},
+        {"long",     TokenType::KEYWORD_LONG},
+        {"float",    TokenType::KEYWORD_FLOAT},
+        {"double",   TokenType::KEYWORD_DOUBLE},
+        {"bool",     TokenType::KEYWORD_BOOL},
+        {"char",     TokenType::KEYWORD_CHAR},
+        {"void",     TokenType::KEYWORD_VOID},
+        {"unsigned", TokenType::KEYWORD_UNSIGNED},
+        {"signed",   TokenType::KEYWORD_SIGNED},
+        {"trait",    TokenType::KEYWORD_TRAIT},
+        {"struct",   TokenType::KEYWORD_STRUCT},
+        {"import",   TokenType::KEYWORD_IMPORT},
+        {"export",   TokenType::KEYWORD_EXPORT},
+        {"const",    TokenType::KEYWORD_CONST},
+        {"static",   TokenType::KEYWORD_STATIC},
+        {"template", TokenType::KEYWORD_TEMPLATE},
+        {"typedef",  TokenType::KEYWORD_TYPEDEF},
+        {"fn",       TokenType::KEYWORD_FN},
+        {"let",      TokenType::KEYWORD_LET},
+        {"true",     TokenType::KEYWORD_TRUE},
+        {"false",    TokenType::KEYWORD_FALSE},
+        {"null",     TokenType::KEYWORD_NULL}
+    };
+
+    // 新增运算符只需要加一行, 拼写最长 4 字节, 只含 ASCII
+    inline constexpr Spelling OPERATOR_TABLE[] = {
+        {"=",   TokenType::SIGN_ASSIGN},
+        {"==",  TokenType::SIGN_EQUAL},
+        {"=>",  TokenType::SIGN_ARROW},
+        {"<",   TokenType::SIGN_LT},
+        {"<=",  TokenType::SIGN_LTE},
+        {"<<",  TokenType::SIGN_LSHIFT},
+        {"<<=", TokenType::SIGN_LSHIFTAS},
+        {"<=>", TokenType::SIGN_SPACESHIP},
+        {">",   TokenType::SIGN_GT},
+        {">=",  TokenType::SIGN_GTE},
+        {">>",  TokenType::SIGN_RSHIFT},
+        {">>=", TokenType::SIGN_RSHIFTAS},
+        {"+",   TokenType::SIGN_ADD},
+        {"++",  TokenType::SIGN_INC},
+        {"+=",  TokenType::SIGN_ADDAS},
+        {"-",   TokenType::SIGN_SUB},
+        {"--",  TokenType::SIGN_DEC},
+        {"-=",  TokenType::SIGN_SUBAS},
+        {"->",  TokenType::SIGN_POINTER},
+        {"*",   TokenType::SIGN_MUL},
+        {"*=",  TokenType::SIGN_MULAS},
+        {"**",  TokenType::SIGN_POW},
+        {"**=", TokenType::SIGN_POWAS},
+        {"/",   TokenType::SIGN_DIV},
+        {"/=",  TokenType::SIGN_DIVAS},
+        {"%",   TokenType::SIGN_MOD},
+        {"%=",  TokenType::SIGN_MODAS},
+        {"|",   TokenType::SIGN_OR},
+        {"|=",  TokenType::SIGN_ORAS},
+        {"||",  TokenType::SIGN_SWOR},
+        {"&",   TokenType::SIGN_AND},
+        {"&=",  TokenType::SIGN_ANDAS},
+        {"&&",  TokenType::SIGN_SWAND},
+        {"^",   TokenType::SIGN_XOR},
+        {"^=",  TokenType::SIGN_XORAS},
+        {"!",   TokenType::SIGN_NOT},
+        {"!=",  TokenType::SIGN_NEQ},
+        {"#",   TokenType::SIGN_SHARP},
+        {"$",   TokenType::SIGN_DOLLAR},
+        {",",   TokenType::SIGN_COMMA},
+        {";",   TokenType::SIGN_SEMICOLON},
+        {":",   TokenType::SIGN_COLON},
+        {"::",  TokenType::SIGN_SCOPE},
+        {".",   TokenType::SIGN_DOT},
+        {"...", TokenType::SIGN_ELLIPSIS},
+        {"(",   TokenType::SIGN_LPAREN},
+        {")",   TokenType::SIGN_RPAREN},
+        {"{",   TokenType::SIGN_LBRACE},
+        {"}",   TokenType::SIGN_RBRACE},
+        {"[",   TokenType::SIGN_LBRACKET},
+        {"]",   TokenType::SIGN_RBRACKET},
+        {"~",   TokenType::SIGN_TILDE},
+        {"?",   TokenType::SIGN_QUESTION},
+        {"@",   TokenType::SIGN_AT}
+    };
+
+    // 逐项比较的查找, 供常量求值使用; 运行时的 Lexer 使用由同一张表构建的字典树与匹配器
+    constexpr TokenType lookup_keyword(std::string_view str) {
+        for (const Spelling &keyword : KEYWORD_TABLE) {
+            // 先比较首字节, 避免对每一项求长度
+            if (! str.empty() && str[0] == keyword.text[0] && str == keyword.text) {
+                return keyword.type;
+            }
+        }
+        return TokenType::NONE;
+    }
+
+    // str 开头的最长运算符, 没有时返回 NONE
+    constexpr TokenType match_operator(std::string_view str, size_t &length) {
+        TokenType type = TokenType::NONE;
+        length = 0;
+        for (const Spelling &op : OPERATOR_TABLE) {
+            if (str.empty() || str[0] != op.text[0]) {
+                continue;
+            }
+            std::string_view text = op.text;
+            if (text.size() > length && str.starts_with(text)) {
+                type = op.type;
+                length = text.size();
+            }
+        }
+        return type;
+    }
+}
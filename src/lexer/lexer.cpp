@@ -1,35 +1,28 @@
 #include "lexer/lexer.h"
+#include "lexer/lex_scan.h"
+#include "lexer/lex_stats.h"
+#include "lexer/lex_tables.h"
 #include "lexer.h"
 
-using namespace rain;
-
-mem::Pool<Token> Token::pool = mem::Pool<Token>(1000);
+#include <array>
+#include <bit>
 
-static bool isodigit(char ch) {
-    return '0' <= ch && ch <= '7';
-}
-
-static bool isbdigit(char ch) {
-    return ch == '0' || ch == '1';
-}
-
-static bool isidalpha(char ch) {
-    return isalpha(ch) || ch == '_';
-}
+using namespace rain;
 
-static bool isidalnum(char ch) {
-    return isalnum(ch) || ch == '_';
-}
+thread_local mem::Pool<Token> Token::pool = mem::Pool<Token>(1000);
 
-static bool __match__(bytebuffer &buf, std::string str) {
-    bool flag = true;
-    for (int i = 0 ; i < str.length() ; i ++) {
-        flag &= (buf.peer(i) == str[i]);
+// [p, p + n) 中的码点个数, 列号按码点计
+static int __columns__(const char *p, int n) {
+    int columns = 0;
+    for (int i = 0 ; i < n ; i ++) {
+        columns += ! utf8_is_continuation(p[i]);
     }
-    return flag;
+    return columns;
 }
 
-static void __skip__(bytebuffer &buf, Lexer::position &pos) {
+static void __skip__(bytecursor &cur, Lexer::position &pos) {
+    RAIN_LEX_PHASE(PHASE_SKIP);
+
     enum {
         INITIAL = 0,
         TERMINATE = 1,
@@ -40,13 +33,13 @@ static void __skip__(bytebuffer &buf, Lexer::position &pos) {
     Lexer::position pos_begin = pos;
 
     while (state != TERMINATE) {
-        char lookahead_1 = buf.peer(0), lookahead_2 = buf.peer(1);
+        char lookahead_1 = cur.peek<0>(), lookahead_2 = cur.peek<1>();
         int aheading = 1;
 
         switch (state)
         {
         case INITIAL: {
-            if (! isspace(lookahead_1)) {
+            if (! isspace(static_cast<unsigned char>(lookahead_1))) {
                 if (lookahead_1 != '/') {
                     state = TERMINATE;
                     aheading = 0;
@@ -55,11 +48,13 @@ static void __skip__(bytebuffer &buf, Lexer::position &pos) {
                 else if (lookahead_2 == '/') {
                     state = LINE_COMMENT;
                     aheading = 2;
+                    RAIN_LEX_STAT(stats.comment_bytes += aheading);
                     break;
                 }
                 else if (lookahead_2 == '*') {
                     state = MULLINE_COMMENT;
                     aheading = 2;
+                    RAIN_LEX_STAT(stats.comment_bytes += aheading);
                     break;
                 }
                 else {
@@ -68,19 +63,30 @@ static void __skip__(bytebuffer &buf, Lexer::position &pos) {
                     break;
                 }
             }
+            RAIN_LEX_STAT(stats.whitespace_bytes += aheading);
             break;
         }
         case LINE_COMMENT: {
             if (lookahead_1 == '\n') {
                 state = INITIAL;
             }
+            else if (lookahead_1 == '\0' && cur.at_end()) {
+                state = TERMINATE;
+                aheading = 0;
+            }
+            RAIN_LEX_STAT(stats.comment_bytes += aheading);
             break;
         }
         case MULLINE_COMMENT: {
-            if (lookahead_1 == '*' && lookahead_2 == '/') {
+            if (lookahead_1 == '\0' && cur.at_end()) {
+                state = TERMINATE;
+                aheading = 0;
+            }
+            else if (lookahead_1 == '*' && lookahead_2 == '/') {
                 state = INITIAL;
                 aheading = 2;
             }
+            RAIN_LEX_STAT(stats.comment_bytes += aheading);
             break;
         }
         default: {
@@ -88,645 +94,413 @@ static void __skip__(bytebuffer &buf, Lexer::position &pos) {
         }
         }
 
-        buf.ahead(aheading);
-        pos.column += aheading;
+        pos.column += __columns__(cur.raw(), aheading);
+        cur.advance(aheading);
 
         if (lookahead_1 == '\n') {
-            pos.column = 0;
+            pos.column = 1;
             pos.line ++;
         }
     }
 }
 
-static TokenType __dec_integer_or_float__(bytebuffer &buf, Lexer::position &pos, std::vector<LexError> &err) {
-    enum {
-        INITIAL = 0,
-        TERMINATE = 1,
-        DIGIT = 2,
-        FLOATS = 3
-    } state = INITIAL;
+// 前进 n 字节并更新位置, 规则与 __skip__ 相同
+static void __advance__(bytecursor &cur, Lexer::position &pos, int n) {
+    for (int i = 0 ; i < n ; i ++) {
+        if (cur.peek(i) == '\n') {
+            pos.column = 1;
+            pos.line ++;
+        }
+        else {
+            pos.column += ! utf8_is_continuation(cur.peek(i));
+        }
+    }
+    cur.advance(n);
+}
 
-    TokenType type = TokenType::DEC_INTEGER;
+// 无损模式下代替 __skip__, 跳过的部分逐段记入 out, 划分 token 的方式与 __skip__ 相同
+// trailing 为真时只扫描到行尾, 换行留给下一个 token 的前导 trivia
+static void __trivia__(bytecursor &cur, Lexer::position &pos, std::vector<Trivia> &out, bool trailing) {
+    RAIN_LEX_PHASE(PHASE_SKIP);
 
-    while (state != TERMINATE) {
-        char lookahead = buf.peer(0);
-        int aheading = 1;
+    while (true) {
+        size_t begin = cur.pos();
+        char ch = cur.peek<0>();
+        TriviaKind kind;
 
-        switch (state)
-        {
-        case INITIAL: {
-            assert(isdigit(lookahead));
-            if (lookahead == '0') {
-                state = TERMINATE;
+        if (ch == '\n') {
+            if (trailing) {
+                break;
             }
-            else {
-                state = DIGIT;
+            kind = TriviaKind::NEWLINE;
+            while (cur.peek<0>() == '\n') {
+                __advance__(cur, pos, 1);
             }
-            break;
         }
-        case DIGIT: {
-            if (! isdigit(lookahead)) {
-                if (lookahead == '.') {
-                    type = TokenType::FLOAT;
-                    state = FLOATS;
-                    break;
-                }
-                state = TERMINATE;
-                aheading = 0;
-                break;
+        else if (isspace(static_cast<unsigned char>(ch))) {
+            kind = TriviaKind::WHITESPACE;
+            while (cur.peek<0>() != '\n' && isspace(static_cast<unsigned char>(cur.peek<0>()))) {
+                __advance__(cur, pos, 1);
             }
         }
-        case FLOATS: {
-            if (! isdigit(lookahead)) {
-                state = TERMINATE;
-                aheading = 0;
-                break;
+        else if (ch == '/' && cur.peek<1>() == '/') {
+            kind = TriviaKind::LINE_COMMENT;
+            __advance__(cur, pos, 2);
+            while (cur.peek<0>() != '\n' && ! (cur.peek<0>() == '\0' && cur.at_end())) {
+                __advance__(cur, pos, 1);
+            }
+        }
+        else if (ch == '/' && cur.peek<1>() == '*') {
+            kind = TriviaKind::BLOCK_COMMENT;
+            __advance__(cur, pos, 2);
+            while (! (cur.peek<0>() == '\0' && cur.at_end())) {
+                if (cur.peek<0>() == '*' && cur.peek<1>() == '/') {
+                    __advance__(cur, pos, 2);
+                    break;
+                }
+                __advance__(cur, pos, 1);
             }
         }
-        default:
+        else {
             break;
         }
 
-        buf.ahead(aheading);
-        pos.column += aheading;
+        uint32_t length = static_cast<uint32_t>(cur.pos() - begin);
+        if (kind == TriviaKind::LINE_COMMENT || kind == TriviaKind::BLOCK_COMMENT) {
+            RAIN_LEX_STAT(stats.comment_bytes += length);
+        }
+        else {
+            RAIN_LEX_STAT(stats.whitespace_bytes += length);
+        }
+        out.push_back(Trivia{static_cast<uint32_t>(begin), length, kind});
     }
-
-    return type;
 }
 
-static void __hex_integer__(bytebuffer &buf, Lexer::position &pos, std::vector<LexError> &err) {
-    assert(__match__(buf, "0x"));
-    buf.ahead(2);
-
-    enum {
-        INITIAL = 0,
-        TERMINATE = 1,
-        DIGITS = 2
-    } state = INITIAL;
-
-    while (state != TERMINATE) {
-        char lookahead = buf.peer(0);
-        int aheading = 1;
-
-        switch (state)
-        {
-        case INITIAL: {
-            if (! isxdigit(lookahead)) {
-                err.emplace_back("[0-9a-fA-F]", lookahead, pos);
-                return;
-            }
-            state = DIGITS;
-            break;
-        }
-        case DIGITS: {
-            if (! isxdigit(lookahead)) {
-                state = TERMINATE;
-                aheading = 0;
-            }
-            break;
-        }
-        default:
-            break;
-        }
+// 扫描函数报告的错误, 位置为 token 起点之后 offset 字节处
+static auto __reporter__(const bytecursor &cur, Lexer::position &pos, std::vector<LexError> &err) {
+    return [begin = cur.raw(), &pos, &err](ScanError kind, size_t offset, char got) {
+        static constexpr const char *expected[] = {
+            "[0-9a-fA-F]",
+            "[0-7]",
+            "[01]",
+            "Valid hex digits for hex escape sequence",
+            "Valid octal digits for octal escape sequence",
+            "Valid hex digits for unicode escape sequence",
+            "Valid escape sequence",
+            "A character for char literal",
+            "Closing single quote (') for char literal",
+            "Closing double quote (\") for string literal"
+        };
+        Lexer::position at = pos;
+        at.column += __columns__(begin, static_cast<int>(offset));
+        err.emplace_back(expected[static_cast<size_t>(kind)], got, at);
+    };
+}
 
-        buf.ahead(aheading);
-        pos.column += aheading;
-    }
+// 跳过扫描得到的 n 字节, token 不跨行
+static void __consume__(bytecursor &cur, Lexer::position &pos, size_t n) {
+    pos.column += __columns__(cur.raw(), static_cast<int>(n));
+    cur.advance(n);
 }
 
-static void __oct_integer__(bytebuffer &buf, Lexer::position &pos, std::vector<LexError> &err) {
-    assert(__match__(buf, "0"));
-    buf.ahead(1);
+static TokenType __dec_integer_or_float__(bytecursor &cur, Lexer::position &pos, std::vector<LexError> &err) {
+    RAIN_LEX_PHASE(PHASE_DEC_INTEGER_OR_FLOAT);
 
-    enum {
-        INITIAL = 0,
-        TERMINATE = 1,
-        DIGITS = 2
-    } state = INITIAL;
-        
-    assert(isdigit(buf.peer(0)));
+    TokenType type;
+    __consume__(cur, pos, scan_decimal(cur.raw(), type));
+    return type;
+}
 
-    while (state != TERMINATE) {
-        char lookahead = buf.peer(0);
-        int aheading = 1;
+static void __hex_integer__(bytecursor &cur, Lexer::position &pos, std::vector<LexError> &err) {
+    RAIN_LEX_PHASE(PHASE_HEX_INTEGER);
 
-        switch (state)
-        {
-        case INITIAL: {
-            if (! isodigit(lookahead)) {
-                err.emplace_back("[0-7]", lookahead, pos);
-            }
-            // Continue process rest digits
-            state = DIGITS;
-            break;
-        }
-        case DIGITS: {
-            if (! isdigit(lookahead)) {
-                state = TERMINATE;
-                aheading = 0;
-                break;
-            }
+    __consume__(cur, pos, scan_hex(cur.raw(), __reporter__(cur, pos, err)));
+}
 
-            if (! isodigit(lookahead)) {
-                err.emplace_back("[0-7]", lookahead, pos);
-                // Continue process rest digits
-            }
-            break;
-        }
-        default:
-            break;
-        }
+static void __oct_integer__(bytecursor &cur, Lexer::position &pos, std::vector<LexError> &err) {
+    RAIN_LEX_PHASE(PHASE_OCT_INTEGER);
 
-        buf.ahead(aheading);
-        pos.column += aheading;
-    }
+    __consume__(cur, pos, scan_octal(cur.raw(), __reporter__(cur, pos, err)));
 }
 
-static void __bin_integer__(bytebuffer &buf, Lexer::position &pos, std::vector<LexError> &err) {
-    assert(__match__(buf, "0b"));
-    buf.ahead(2);
+static void __bin_integer__(bytecursor &cur, Lexer::position &pos, std::vector<LexError> &err) {
+    RAIN_LEX_PHASE(PHASE_BIN_INTEGER);
 
-    enum {
-        INITIAL = 0,
-        TERMINATE = 1,
-        DIGITS = 2
-    } state = INITIAL;
-        
-    assert(isdigit(buf.peer(0)));
+    __consume__(cur, pos, scan_binary(cur.raw(), __reporter__(cur, pos, err)));
+}
 
-    while (state != TERMINATE) {
-        char lookahead = buf.peer(0);
-        int aheading = 1;
+// 关键字字典树, 第一次使用时构建, 之后只读
+// 构建由函数内静态变量的初始化保证只发生一次, 因此多个 lexer 可以在不同线程中同时查询
+class __keyword_trie__ {
+public:
+    static const __keyword_trie__ &instance() {
+        static const __keyword_trie__ trie;
+        return trie;
+    }
 
-        switch (state)
-        {
-        case INITIAL: {
-            if (! isbdigit(lookahead)) {
-                err.emplace_back("[01]", lookahead, pos);
-            }
-            // Continue process rest digits
-            state = DIGITS;
-            break;
-        }
-        case DIGITS: {
-            if (! isdigit(lookahead)) {
-                state = TERMINATE;
-                aheading = 0;
-                break;
-            }
+    TokenType lookup(const std::string &str) const {
+        RAIN_LEX_PHASE(PHASE_KEYWORD_LOOKUP);
 
-            if (! isbdigit(lookahead)) {
-                err.emplace_back("[01]", lookahead, pos);
-                // Continue process rest digits
+        uint32_t node = 0;
+        for (char ch : str) {
+            auto it = nodes[node].children.find(ch);
+            if (it == nodes[node].children.end()) {
+                return TokenType::NONE;
             }
-            break;
-        }
-        default:
-            break;
+            node = it->second;
         }
-
-        buf.ahead(aheading);
-        pos.column += aheading;
+        return nodes[node].type;
     }
-}
 
-struct __lex_trie__ {
-    static mem::Pool<__lex_trie__> pool;
+private:
+    struct Node {
+        TokenType type = TokenType::NONE;
+        map<char, uint32_t> children;
+    };
 
-    TokenType type;
-    map<char, __lex_trie__*> children;
+    // 子节点以下标引用, 节点随 vector 一起释放
+    std::vector<Node> nodes;
 
-    __lex_trie__(TokenType type = TokenType::NONE)
-        : type(type), children()
-    {
-        pool.mark(this);
+    __keyword_trie__() {
+        RAIN_MEM_PHASE(SETUP);
+        nodes.emplace_back();
+        for (const Spelling &keyword : KEYWORD_TABLE) {
+            add(keyword.text, keyword.type);
+        }
+        RAIN_MEM_ALLOC(KEYWORD_TABLE, footprint());
     }
-} *__trie_root__ = nullptr;
-
-mem::Pool<__lex_trie__> __lex_trie__::pool = mem::Pool<__lex_trie__>(100);
 
-static void __add_keyword__(const std::string &keyword, TokenType type) {
-    __lex_trie__ *node = __trie_root__;
-    for (char ch : keyword) {
-        if (! node->children.contains(ch)) {
-            node->children[ch] = new __lex_trie__();
+    // 字典树占用的字节数, map 的每个节点按三个指针加颜色估算
+    // KEYWORD_TABLE 是静态数据, 不计入
+    size_t footprint() const {
+        constexpr size_t map_node = 4 * sizeof(void *);
+        size_t bytes = nodes.capacity() * sizeof(Node);
+        for (const Node &node : nodes) {
+            bytes += node.children.size() * (map_node + sizeof(std::pair<const char, uint32_t>));
         }
-        node = node->children[ch];
+        return bytes;
     }
-    node->type = type;
-}
 
-static TokenType __lookup_keyword__(std::string &str) {
-    __lex_trie__ *node = __trie_root__;
-    for (char ch : str) {
-        if (! node->children.contains(ch)) {
-            return TokenType::NONE;
+    void add(const std::string &keyword, TokenType type) {
+        uint32_t node = 0;
+        for (char ch : keyword) {
+            auto it = nodes[node].children.find(ch);
+            if (it == nodes[node].children.end()) {
+                uint32_t child = nodes.size();
+                nodes.emplace_back();
+                nodes[node].children.emplace(ch, child);
+                node = child;
+            } else {
+                node = it->second;
+            }
         }
-        node = node->children[ch];
+        nodes[node].type = type;
     }
-    return node->type;
-}
+};
 
-static void __identifier_or_keyword__(bytebuffer &buf, Lexer::position &pos, std::vector<LexError> &err) {
-    char lookahead1 = buf.peer();
+static void __identifier_or_keyword__(bytecursor &cur, Lexer::position &pos, std::vector<LexError> &err) {
+    RAIN_LEX_PHASE(PHASE_IDENTIFIER_OR_KEYWORD);
 
-    assert(isidalpha(lookahead1));
+    __consume__(cur, pos, scan_identifier(cur.raw()));
+}
 
-    while (isidalnum(lookahead1)) {
-        buf.ahead(1);
-        pos.column += 1;
+static void __literal_string__(bytecursor &cur, Lexer::position &pos, std::vector<LexError> &err) {
+    RAIN_LEX_PHASE(PHASE_LITERAL_STRING);
 
-        lookahead1 = buf.peer();
-    }
+    __consume__(cur, pos, scan_string(cur.raw(), __reporter__(cur, pos, err)));
 }
 
-static void __literal_string__(bytebuffer &buf, Lexer::position &pos, std::vector<LexError> &err) {
-    enum {
-        INITIAL         = 0,
-        TERMINATE       = 1,
-        CHARS           = 2,
-        ESCAPE          = 3
-    } state = INITIAL;
-    
-    assert(buf.peer() == '"');
+static void __literal_char__(bytecursor &cur, Lexer::position &pos, std::vector<LexError> &err) {
+    RAIN_LEX_PHASE(PHASE_LITERAL_CHAR);
 
-    while (state != TERMINATE) {
-        char lookahead = buf.peer(0);
-        int aheading = 1;
+    __consume__(cur, pos, scan_char(cur.raw(), __reporter__(cur, pos, err)));
+}
 
-        switch (state)
-        {
-        case INITIAL: {
-            // Consume opening "
-            buf.ahead(1);
-            pos.column += 1;
-            state = CHARS;
-            break;
-        }
-        case CHARS: {
-            if (lookahead == '"') {
-                state = TERMINATE;
-                break;
-            }
-            else if (lookahead == '\\') {
-                state = ESCAPE;
-                break;
+// 编译期由运算符表 (lexer/lex_tables.h) 生成的匹配器
+// 按首字节索引候选区间, 区间内按长度降序排列, 第一个匹配的候选就是最长匹配
+// 每个候选把拼写存成一个 32 位字和掩码, 匹配只需一次 4 字节读取和若干次比较
+class __operator_matcher__ {
+private:
+    static constexpr size_t COUNT = std::size(OPERATOR_TABLE);
+
+    struct Candidate {
+        uint32_t pattern = 0;
+        uint32_t mask = 0;
+        int length = 0;
+        TokenType type = TokenType::NONE;
+    };
+
+    std::array<Candidate, COUNT> candidates {};
+    std::array<uint8_t, 256> first {};
+    std::array<uint8_t, 256> count {};
+
+    static constexpr uint32_t shift(int i) {
+        return std::endian::native == std::endian::little ? 8 * i : 8 * (3 - i);
+    }
+
+public:
+    constexpr __operator_matcher__() {
+        for (size_t i = 0 ; i < COUNT ; i ++) {
+            Candidate cand;
+            const char *spelling = OPERATOR_TABLE[i].text;
+            while (spelling[cand.length] != '\0') {
+                if (cand.length == 4) {
+                    throw "operator spelling longer than 4 bytes";
+                }
+                cand.pattern |= static_cast<uint32_t>(static_cast<unsigned char>(spelling[cand.length])) << shift(cand.length);
+                cand.mask |= 0xFFu << shift(cand.length);
+                cand.length ++;
             }
-            else if (lookahead == '\0' || lookahead == '\n') {
-                err.emplace_back("Closing double quote (\") for string literal", lookahead, pos);
-                return;
+            cand.type = OPERATOR_TABLE[i].type;
+            candidates[i] = cand;
+        }
+
+        // 按 (首字节升序, 长度降序) 排序
+        auto before = [this](const Candidate &a, const Candidate &b) {
+            uint8_t fa = static_cast<uint8_t>((a.pattern >> shift(0)) & 0xFF);
+            uint8_t fb = static_cast<uint8_t>((b.pattern >> shift(0)) & 0xFF);
+            return fa != fb ? fa < fb : a.length > b.length;
+        };
+        for (size_t i = 1 ; i < COUNT ; i ++) {
+            for (size_t j = i ; j > 0 && before(candidates[j], candidates[j - 1]) ; j --) {
+                std::swap(candidates[j], candidates[j - 1]);
             }
-            break;
         }
-        case ESCAPE: {
-            char lookahead_2 = buf.peer(1);
-            switch (lookahead_2) {
-            case 'a': case 'b': case 'f': case 'n':
-            case 'r': case 't': case 'v': case '?':
-            case '\\': case '\'': case '"':
-                aheading = 1;
-                break;
-            case 'x': case 'X': {
-                // Hex escape sequence \xhh
-                if (! isxdigit(buf.peer(2)) || ! isxdigit(buf.peer(3))) {
-                    err.emplace_back("Valid hex digits for hex escape sequence", lookahead_2, pos);
-                }
-                aheading = 2;
-                break;
-            }
-            case '0':
-                if (! isodigit(buf.peer(2))) {
-                    aheading = 1;
-                    break;
-                }
-            case '1': case '2': case '3': case '4':
-            case '5': case '6': case '7':
-                // Octal escape sequence \ooo
-                if (! isodigit(buf.peer(2)) || ! isodigit(buf.peer(3))) {
-                    err.emplace_back("Valid octal digits for octal escape sequence", lookahead_2, pos);
-                }
-                aheading = 3;
-                break;
-            // Unicode escape sequence \uXXXX or \UXXXXXXXX
-            case 'u': case 'U': {
-                int hex_count = (lookahead_2 == 'u') ? 4 : 8;
-                for (int i = 2 ; i < 2 + hex_count ; i ++) {
-                    if (! isxdigit(buf.peer(i))) {
-                        err.emplace_back("Valid hex digits for unicode escape sequence", buf.peer(i), pos);
-                        break;
-                    }
-                }
-                aheading = 1 + hex_count;
+
+        for (size_t i = 0 ; i < COUNT ; i ++) {
+            uint8_t ch = static_cast<uint8_t>((candidates[i].pattern >> shift(0)) & 0xFF);
+            if (count[ch] == 0) {
+                first[ch] = static_cast<uint8_t>(i);
             }
-            default:
-                err.emplace_back("Valid escape sequence", lookahead_2, pos);
-                break;
+            else if (candidates[i].pattern == candidates[i - 1].pattern) {
+                throw "duplicate operator spelling";
             }
-            state = CHARS;
+            count[ch] ++;
         }
-        default:
-            break;
-        }
-
-        buf.ahead(aheading);
-        pos.column += aheading;
     }
-}
 
-static void __literal_char__(bytebuffer &buf, Lexer::position &pos, std::vector<LexError> &err) {
-        enum {
-        INITIAL   = 0,
-        TERMINATE = 1,
-        ESCAPE    = 2
-    } state = INITIAL;
-    
-    assert(buf.peer() == '\'');
+    // p 之后至少有 3 个可读字节 (bytebuffer 的零填充保证这一点)
+    TokenType match(const char *p, int &length) const {
+        uint8_t ch = static_cast<uint8_t>(*p);
+        if (count[ch] == 0) {
+            return TokenType::NONE;
+        }
 
-    while (state != TERMINATE) {
-        char lookahead = buf.peer(0);
-        int aheading = 1;
+        uint32_t word;
+        memcpy(&word, p, sizeof(word));
 
-        switch (state)
-        {
-        case INITIAL: {
-            // Consume opening '
-            buf.ahead(1);
-            pos.column += 1;
-            if (lookahead == '\\') {
-                state = ESCAPE;
-            }
-            else {
-                state = TERMINATE;
+        const Candidate *cand = &candidates[first[ch]];
+        const Candidate *end = cand + count[ch];
+        for (; cand != end ; cand ++) {
+            if ((word & cand->mask) == cand->pattern) {
+                length = cand->length;
+                return cand->type;
             }
-            break;
         }
-        case ESCAPE: {
-            char lookahead_2 = buf.peer(1);
-            switch (lookahead_2) {
-            case 'a': case 'b': case 'f': case 'n':
-            case 'r': case 't': case 'v': case '?':
-            case '\\': case '\'': case '"':
-                aheading = 2;
-                break;
-            case 'x': case 'X': {
-                // Hex escape sequence \xhh
-                if (! isxdigit(buf.peer(2)) || ! isxdigit(buf.peer(3))) {
-                    err.emplace_back("Valid hex digits for hex escape sequence", lookahead_2, pos);
-                }
-                aheading = 3;
-                break;
-            }
-            case '0':
-                if (! isodigit(buf.peer(2))) {
-                    aheading = 2;
-                    break;
-                }
-            case '1': case '2': case '3': case '4':
-            case '5': case '6': case '7':
-                // Octal escape sequence \ooo
-                if (! isodigit(buf.peer(2)) || ! isodigit(buf.peer(3))) {
-                    err.emplace_back("Valid octal digits for octal escape sequence", lookahead_2, pos);
-                }
-                aheading = 4;
-                break;
-            // Unicode escape sequence \uXXXX or \UXXXXXXXX
-            case 'u': case 'U': {
-                int hex_count = (lookahead_2 == 'u') ? 4 : 8;
-                for (int i = 2 ; i < 2 + hex_count ; i ++) {
-                    if (! isxdigit(buf.peer(i))) {
-                        err.emplace_back("Valid hex digits for unicode escape sequence", buf.peer(i), pos);
-                        break;
-                    }
-                }
-                aheading = 1 + hex_count;
-            }
-            default:
-                err.emplace_back("Valid escape sequence", lookahead_2, pos);
-                break;
-            }
-            state = TERMINATE;
-        }
-        default:
-            break;
-        }
-
-        buf.ahead(aheading);
-        pos.column += aheading;
+        // 长度为 1 的候选总是匹配, 不会到这里
+        return TokenType::NONE;
     }
-}
-
-static TokenType __symbol__(bytebuffer &buf, Lexer::position &pos, std::vector<LexError> &err) {
-    TokenType type = TokenType::NONE;
-    char lookahead1 = buf.peer(), lookahead2 = buf.peer(1);
-
-    int aheading = 0;
+};
 
-    bool variable = false, repeatable = false;
+static constexpr __operator_matcher__ __operators__ {};
 
-    switch (lookahead1)
-    {
-    case '=':
-        repeatable = true;
-        type = TokenType::SIGN_ASSIGN;
-        break;
-    case '>':
-        variable = repeatable = true;
-        type = TokenType::SIGN_GT;
-        break;
-    case '<':
-        variable = repeatable = true;
-        type = TokenType::SIGN_LT;
-        break;
-    case '+':
-        variable = repeatable = true;
-        type = TokenType::SIGN_ADD;
-        break;
-    case '-':
-        variable = repeatable = true;
-        type = lookahead2 == '>' ? TokenType::SIGN_POINTER : TokenType::SIGN_SUB;
-        break;
-    case '*':
-        variable = true;
-        type = TokenType::SIGN_MUL;
-        break;
-    case '/':
-        variable = true;
-        type = TokenType::SIGN_DIV;
-        break;
-    case '%':
-        variable = true;
-        type = TokenType::SIGN_MOD;
-        break;
-    case '|':
-        variable = repeatable = true;
-        type = TokenType::SIGN_OR;
-        break;
-    case '&':
-        variable = repeatable = true;
-        type = TokenType::SIGN_AND;
-        break;
-    case '^':
-        variable = true;
-        type = TokenType::SIGN_XOR;
-        break;
-    case '!':
-        variable = true;
-        type = TokenType::SIGN_NOT;
-        break;
-    case '#':
-        type = TokenType::SIGN_SHARP;
-        break;
-    case '$':
-        type = TokenType::SIGN_DOLLAR;
-        break;
-    case ',':
-        type = TokenType::SIGN_COMMA;
-        break;
-    case ';':
-        type = TokenType::SIGN_SEMICOLON;
-        break;
-    case ':':
-        type = TokenType::SIGN_COLON;
-        break;
-    case '.':
-        type = TokenType::SIGN_DOT;
-        break;
-    case '(':
-        type = TokenType::SIGN_LPAREN;
-        break;
-    case ')':
-        type = TokenType::SIGN_RPAREN;
-        break;
-    case '{':
-        type = TokenType::SIGN_LBRACE;
-        break;
-    case '}':
-        type = TokenType::SIGN_RBRACE;
-        break;
-    case '[':
-        type = TokenType::SIGN_LBRACKET;
-        break;
-    case ']':
-        type = TokenType::SIGN_RBRACKET;
-        break;
-    case '~':
-        type = TokenType::SIGN_TILDE;
-        break;
-    case '?':
-        type = TokenType::SIGN_QUESTION;
-        break;
-    case '@':
-        type = TokenType::SIGN_AT;
-        break;
-    default:
-        break;
-    }
+static TokenType __symbol__(bytecursor &cur, Lexer::position &pos, std::vector<LexError> &err) {
+    RAIN_LEX_PHASE(PHASE_SYMBOL);
 
+    int length = 0;
+    TokenType type = __operators__.match(cur.raw(), length);
     if (type == TokenType::NONE) {
         return type;
     }
 
-    aheading ++;
-
-    if (repeatable && (lookahead1 == lookahead2)) {
-        type |= TokenType::MASK_REPEAT;
-        variable = false;
-        if (lookahead1 == '>' || lookahead2 == '<') {
-            variable = true;
-            lookahead2 = buf.peer(2);
-        }
-        aheading ++;
-    }
-
-    if (variable && lookahead2 == '=') {
-        type |= TokenType::MASK_VARIANT;
-        aheading ++;
-    }
-
-    buf.ahead(aheading);
-    pos.column += aheading;
+    cur.advance(length);
+    pos.column += length;
     return type;
 }
 
-static TokenType __nonsymbol__(bytebuffer &buf, Lexer::position &pos, std::vector<LexError> &err) {
+static TokenType __nonsymbol__(bytecursor &cur, Lexer::position &pos, std::vector<LexError> &err) {
+    RAIN_LEX_PHASE(PHASE_NONSYMBOL);
+
     TokenType type = TokenType::NONE;
-    char lookahead1 = buf.peer(), lookahead2 = buf.peer(1);
-    
-    if (isdigit(lookahead1))
-    {
-        if (lookahead1 == '0') {
-            if (isdigit(lookahead2)) {
-                type = TokenType::OCT_INTEGER;
-            }
-            else if (lookahead2 == 'x' || lookahead2 == 'X') {
-                type = TokenType::HEX_INTEGER;
-            }
-            else if (lookahead2 == 'b' || lookahead2 == 'B') {
-                type = TokenType::BIN_INTEGER;
-            }
-            else {
-                type = TokenType::DEC_INTEGER;
-            }
-        }
-        else {
-            type = TokenType::DEC_INTEGER;
-        }
+    char lookahead = cur.peek<0>();
+
+    if (detail::is_dec_digit(lookahead)) {
+        type = number_type(cur.raw());
     }
-    else if (isidalpha(lookahead1)) {
+    else if (identifier_char(cur.raw(), true) > 0) {
         type = TokenType::IDENTIFIER;
     }
-    else if (lookahead1 == '"') {
+    else if (lookahead == '"') {
         type = TokenType::LITERAL_STRING;
     }
-    else if (lookahead1 == '\'') {
+    else if (lookahead == '\'') {
         type = TokenType::LITERAL_CHAR;
     }
 
     switch(type) {
     case TokenType::DEC_INTEGER:
         // type could be dec_integer / float
-        type = __dec_integer_or_float__(buf, pos, err);
+        type = __dec_integer_or_float__(cur, pos, err);
         break;
     case TokenType::BIN_INTEGER:
-        __bin_integer__(buf, pos, err);
+        __bin_integer__(cur, pos, err);
         break;
     case TokenType::HEX_INTEGER:
-        __hex_integer__(buf, pos, err);
+        __hex_integer__(cur, pos, err);
         break;
     case TokenType::OCT_INTEGER:
-        __oct_integer__(buf, pos, err);
+        __oct_integer__(cur, pos, err);
         break;
     case TokenType::IDENTIFIER:
-        __identifier_or_keyword__(buf, pos, err);
+        __identifier_or_keyword__(cur, pos, err);
         break;
     case TokenType::LITERAL_STRING:
-        __literal_string__(buf, pos, err);
+        __literal_string__(cur, pos, err);
         break;
     case TokenType::LITERAL_CHAR:
-        __literal_char__(buf, pos, err);
+        __literal_char__(cur, pos, err);
         break;
-    default:
-        throw std::runtime_error("Unreachable Token Type!");
+    default: {
+        // 不能开始任何 token 的字符, 整个码点 (或一个非法字节) 作为出错的 token
+        int length;
+        utf8_decode(cur.raw(), length);
+        cur.advance(length);
+        pos.column += 1;
         break;
     }
+    }
 
     return type;
 }
 
-static Token *generate(bytebuffer &buf, Lexer::position &pos, std::vector<LexError> &err) {
-    __skip__(buf, pos);
-    size_t begin = buf.pos();
+static Token *generate(bytecursor &cur, Lexer::position &pos, std::vector<LexError> &err, std::vector<Trivia> *trivia) {
+    if (trivia == nullptr) {
+        __skip__(cur, pos);
+    }
+    else {
+        __trivia__(cur, pos, *trivia, false);
+    }
+    size_t begin = cur.pos();
     Lexer::position begin_pos = pos;
 
-    TokenType type = __symbol__(buf, pos, err);
+    // The buffer is zero padded, so the end of input is just a '\0'
+    if (cur.peek<0>() == '\0' && cur.at_end()) {
+        return new Token(TokenType::ENDMARK, "", new PosInfo(begin_pos.path, begin_pos.line, begin_pos.column), begin);
+    }
+
+    TokenType type = __symbol__(cur, pos, err);
     
     if (type == TokenType::NONE) {
-       type =  __nonsymbol__(buf, pos, err);
+       type =  __nonsymbol__(cur, pos, err);
        if (type == TokenType::IDENTIFIER) {
-           std::string ident_str = buf.slice(begin);
-           TokenType keyword_type = __lookup_keyword__(ident_str);
+           std::string ident_str = cur.slice(begin);
+           TokenType keyword_type = __keyword_trie__::instance().lookup(ident_str);
            if (keyword_type != TokenType::NONE) {
                type = keyword_type;
+               RAIN_LEX_STAT(stats.keyword_hits ++);
+           }
+           else {
+               RAIN_LEX_STAT(stats.keyword_misses ++);
            }
        }
     }
@@ -735,75 +509,77 @@ static Token *generate(bytebuffer &buf, Lexer::position &pos, std::vector<LexErr
         err.emplace_back("Couldn't recognize any token", pos);
     }
 
-    return new Token(type, buf.slice(begin), new PosInfo(begin_pos.path, begin_pos.line, begin_pos.column));
+    return new Token(type, cur.slice(begin), new PosInfo(begin_pos.path, begin_pos.line, begin_pos.column), begin);
 }
 
-void Lexer::produce(int required)
-{ 
-    for (int i = 0 ; i < required ; i ++) {
-        std::vector<LexError> err;
+Token *Lexer::lex_one(bytecursor &cur) {
+    std::vector<LexError> err;
 
-        Token *tok = generate(this->buffer, this->pos, err);
-        
-        if (! err.empty()) {
-            tok->type |= TokenType::MASK_ERROR;
-        }
+    size_t first = this->trivia.size();
+    Token *tok = generate(cur, this->pos, err, this->keep_trivia ? &this->trivia : nullptr);
 
-        this->token_sequence.push_back(tok);
+    // 报告此次扫过的非法 UTF-8, 位置记在其后的 token 上
+    while (this->invalid_utf8 < cur.pos()) {
+        err.emplace_back("Invalid UTF-8 sequence", tok->pos);
+        size_t next = this->invalid_utf8 + 1;
+        this->invalid_utf8 = next + utf8_validate(this->buffer.data() + next, this->buffer.length() - next);
+    }
 
-        for (const auto &e : err) {
-            std::cout << std::format("[LEXER ERROR](file '{}', line {} col {}) {}", e.pos->path, e.pos->line, e.pos->column, e.msg) << std::endl;
+    RAIN_LEX_STAT(stats.token_counts[tok->type] ++);
+    RAIN_LEX_STAT(stats.errors += err.size());
+    
+    if (! err.empty()) {
+        tok->type |= TokenType::MASK_ERROR;
+    }
+
+    for (const auto &e : err) {
+        std::cout << std::format("[LEXER ERROR](file '{}', line {} col {}) {}", e.pos->path, e.pos->line, e.pos->column, e.msg) << std::endl;
+    }
+
+    // 尾随 trivia 在报告错误之后扫描, 其中的非法 UTF-8 与默认模式一样记在下一个 token 上
+    if (this->keep_trivia) {
+        tok->trivia = static_cast<uint32_t>(first);
+        this->trailing_begin.push_back(static_cast<uint32_t>(this->trivia.size()));
+        if (! (tok->type & TokenType::ENDMARK)) {
+            __trivia__(cur, this->pos, this->trivia, true);
         }
     }
+    return tok;
 }
 
-static std::map<std::string, TokenType> __keyword_map__ = {
-   {"if",       TokenType::KEYWORD_IF},
-   {"else",     TokenType::KEYWORD_ELSE},
-   {"for",      TokenType::KEYWORD_FOR},
-   {"foreach",  TokenType::KEYWORD_FOREACH},
-   {"while",    TokenType::KEYWORD_WHILE},
-   {"return",   TokenType::KEYWORD_RETURN},
-   {"break",    TokenType::KEYWORD_BREAK},
-   {"continue", TokenType::KEYWORD_CONTINUE},
-   {"do",       TokenType::KEYWORD_DO},
-   {"byte",     TokenType::KEYWORD_BYTE},
-   {"short",    TokenType::KEYWORD_SHORT},
-   {"int",      TokenType::KEYWORD_INT},
-   {"long",     TokenType::KEYWORD_LONG},
-   {"float",    TokenType::KEYWORD_FLOAT},
-   {"double",   TokenType::KEYWORD_DOUBLE},
-   {"bool",     TokenType::KEYWORD_BOOL},
-   {"char",     TokenType::KEYWORD_CHAR},
-   {"void",     TokenType::KEYWORD_VOID},
-   {"unsigned", TokenType::KEYWORD_UNSIGNED},
-   {"signed",   TokenType::KEYWORD_SIGNED},
-   {"trait",    TokenType::KEYWORD_TRAIT},
-   {"struct",   TokenType::KEYWORD_STRUCT},
-   {"import",   TokenType::KEYWORD_IMPORT},
-   {"export",   TokenType::KEYWORD_EXPORT},
-   {"const",    TokenType::KEYWORD_CONST},
-   {"static",   TokenType::KEYWORD_STATIC},
-   {"template", TokenType::KEYWORD_TEMPLATE},
-   {"typedef",  TokenType::KEYWORD_TYPEDEF},
-   {"fn",       TokenType::KEYWORD_FN},
-   {"let",      TokenType::KEYWORD_LET},
-   {"true",     TokenType::KEYWORD_TRUE},
-   {"false",    TokenType::KEYWORD_FALSE},
-   {"null",     TokenType::KEYWORD_NULL}
-};
-
-void rain::initialize_lexer_phase() {
-    __trie_root__ = new __lex_trie__();
+void Lexer::produce(int required)
+{ 
+    RAIN_MEM_PHASE(LEX);
+    bytecursor cur = this->buffer.scan();
 
-    for (const auto &pair : __keyword_map__) {
-        std::string keyword = pair.first;
-        TokenType type = pair.second;
+#ifdef RAIN_LEX_STATS
+    LexStats::active = &this->stats;
+#endif
 
-        __add_keyword__(keyword, type);
+    for (int i = 0 ; i < required ; i ++) {
+        this->token_sequence.push_back(lex_one(cur));
     }
+
+    this->buffer.sync(cur);
+
+#ifdef RAIN_LEX_STATS
+    LexStats::active = nullptr;
+#endif
 }
 
-void rain::terminate_lexer_phase() {
-    __lex_trie__::pool.cleanup();
-}
\ No newline at end of file
+Token *Lexer::pull() {
+    RAIN_MEM_PHASE(LEX);
+    bytecursor cur = this->buffer.scan();
+
+#ifdef RAIN_LEX_STATS
+    LexStats::active = &this->stats;
+#endif
+
+    Token *tok = lex_one(cur);
+    this->buffer.sync(cur);
+
+#ifdef RAIN_LEX_STATS
+    LexStats::active = nullptr;
+#endif
+    return tok;
+}
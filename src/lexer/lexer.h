@@ -3,19 +3,55 @@
 #include "util/util.h"
 #include "file/posinfo.h"
 #include "lexer/token_type.h"
+#include "lexer/lex_stats.h"
+#include "util/utf8.h"
+
+#include <span>
+#include <string_view>
 
 namespace rain {
+    enum class TriviaKind : uint8_t {
+        WHITESPACE = 0,     // 换行以外的空白
+        NEWLINE,            // 连续的换行
+        LINE_COMMENT,       // 不含结尾的换行
+        BLOCK_COMMENT
+    };
+
+    // 源码中的一段 trivia, 只记录位置, 内容通过 Lexer::text 取得
+    struct Trivia {
+        uint32_t offset;
+        uint32_t length;
+        TriviaKind kind;
+    };
+
     struct Token {
-        static mem::Pool<Token> pool;
+        // 每个线程一个, 由创建它的线程释放
+        // 需要在其他线程中使用时, 用 Pool::adopt 转交
+        static thread_local mem::Pool<Token> pool;
 
         TokenType type;
+        // 无损模式下前导 trivia 在 Lexer::trivia 中的起始下标, 默认模式下为 0
+        // 位于 type 之后的填充中, 不增加 token 的大小
+        uint32_t trivia = 0;
         std::string content;
         PosInfo *pos;
+        // token 在源码中的起始偏移
+        size_t offset;
 
-        Token(TokenType type, std::string content, PosInfo *pos = nullptr)
-            : type(type), content(content), pos(pos)
+        Token(TokenType type, std::string content, PosInfo *pos = nullptr, size_t offset = 0)
+            : type(type), content(content), pos(pos), offset(offset)
         {
             pool.mark(this);
+            RAIN_MEM_ALLOC(TOKEN, footprint());
+        }
+
+        ~Token() {
+            RAIN_MEM_FREE(TOKEN, footprint());
+        }
+
+        // 对象本身与 content 在堆上占用的字节数
+        [[nodiscard]] size_t footprint() const {
+            return sizeof(Token) + mem::heap_bytes(content);
         }
 
         std::string repr() const {
@@ -28,8 +64,9 @@ namespace rain {
         }
     };
 
-    void initialize_lexer_phase();
-    void terminate_lexer_phase();
+    // 词法分析器输出格式的版本号, 改变 token 划分方式时需要递增
+    // 用于使 token 缓存失效
+    constexpr uint32_t LEXER_VERSION = 5;
 
     class Lexer {
     private:
@@ -37,25 +74,85 @@ namespace rain {
 
         bytebuffer buffer;
 
+        // 下一个非法 UTF-8 序列的偏移, 没有时为 buffer.length()
+        size_t invalid_utf8;
+
+        // 是否记录 trivia
+        bool keep_trivia;
+
+        // 无损模式下按分析顺序记录每个 token 尾随 trivia 的起始下标, 默认模式下为空
+        std::vector<uint32_t> trailing_begin;
+
+        Token *lex_one(bytecursor &cur);
         void produce(int required = 1);
 
     public:
+        friend class TokenCache;
+
         std::vector<Token *> token_sequence;
+
+        // 无损模式下按源码顺序记录的全部 trivia
+        // 尾随 trivia 是 token 之后同一行内的空白与注释, 换行及其后的部分属于下一个 token 的前导 trivia
+        // 将每个 token 的前导 trivia, 自身与尾随 trivia 依次拼接即得到原始源码
+        std::vector<Trivia> trivia;
+
         struct position {
             std::string path;
             int line;
             int column;
         } pos;
 
-        Lexer(bytebuffer buf, std::string path = "")
-            : token_sequence(), token_ptr(0), buffer(std::move(buf)), pos({path, 1, 1})
+#ifdef RAIN_LEX_STATS
+        LexStats stats;
+#endif
+
+        // lossless 为真时记录 trivia, 默认模式与原来一样直接跳过
+        Lexer(bytebuffer buf, std::string path = "", bool lossless = false)
+            : token_sequence(), token_ptr(0), buffer(std::move(buf)), keep_trivia(lossless), pos({path, 1, 1})
         {
             token_sequence.reserve(1000);
-            initialize_lexer_phase();
+            invalid_utf8 = utf8_validate(buffer.data(), buffer.length());
         }
 
-        ~Lexer() {
-            terminate_lexer_phase();
+        [[nodiscard]] const bytebuffer &source() const {
+            return buffer;
+        }
+
+        [[nodiscard]] bool lossless() const {
+            return keep_trivia;
+        }
+
+        // index 为 token 在 token_sequence 中的下标, 只适用于无损模式下由 produce 分析的 token
+        [[nodiscard]] std::span<const Trivia> leading_trivia(size_t index) const {
+            uint32_t begin = token_sequence[index]->trivia;
+            return std::span<const Trivia>(trivia).subspan(begin, trailing_begin[index] - begin);
+        }
+
+        // 到下一个 token 的前导 trivia 为止
+        [[nodiscard]] std::span<const Trivia> trailing_trivia(size_t index) const {
+            size_t end = index + 1 < token_sequence.size() ? token_sequence[index + 1]->trivia : trivia.size();
+            return std::span<const Trivia>(trivia).subspan(trailing_begin[index], end - trailing_begin[index]);
+        }
+
+        // 源码中的视图, 不复制
+        [[nodiscard]] std::string_view text(const Trivia &trivia) const {
+            return std::string_view(buffer.data() + trivia.offset, trivia.length);
+        }
+
+        // 只适用于由本 lexer 产生的 token
+        [[nodiscard]] std::string_view text(const Token *tok) const {
+            return std::string_view(buffer.data() + tok->offset, tok->content.size());
+        }
+
+        // 分析下一个 token 并直接返回, 不加入 token_sequence
+        // 供 TokenStream 按需读取, 与 produce 共用同一个扫描位置
+        Token *pull();
+
+        // 一直分析到 ENDMARK, 不移动 token 指针
+        void produce_all() {
+            while (token_sequence.empty() || ! (token_sequence.back()->type & TokenType::ENDMARK)) {
+                produce();
+            }
         }
 
         [[nodiscard]] bool valid_ptr(int ptr) const {
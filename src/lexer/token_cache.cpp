@@ -0,0 +1,256 @@
+#include "lexer/token_cache.h"
+#include "util/hash.h"
+
+#include <cstdio>
+#include <algorithm>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace rain;
+
+static constexpr char __magic__[4] = {'R', 'T', 'K', 'C'};
+
+struct __cached_token__ {
+    TokenType type;
+    size_t offset;
+    size_t length;
+    int line;
+    int column;
+};
+
+static void __put_varint__(std::string &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static bool __get_varint__(const uint8_t *&ptr, const uint8_t *end, uint64_t &value) {
+    value = 0;
+    for (int shift = 0 ; shift < 64 ; shift += 7) {
+        if (ptr == end) {
+            return false;
+        }
+        uint8_t byte = *ptr++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (! (byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 校验并解码缓存文件, 任何一处不一致都视为未命中
+static bool __decode__(const uint8_t *data, size_t size, const bytebuffer &source, uint64_t hash,
+                       std::vector<__cached_token__> &tokens, Lexer::position &end_pos) {
+    TokenCacheHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, __magic__, sizeof(__magic__)) != 0
+        || header.format_version != TokenCache::FORMAT_VERSION
+        || header.lexer_version != LEXER_VERSION
+        || header.source_hash != hash
+        || header.source_size != source.length()
+        || header.type_table_count > 256) {
+        return false;
+    }
+
+    size_t types_begin = sizeof(header) + header.type_table_count * sizeof(uint16_t);
+    size_t spans_begin = types_begin + header.token_count;
+    if (spans_begin + header.spans_size != size) {
+        return false;
+    }
+
+    const uint8_t *table = data + sizeof(header);
+    const uint8_t *types = data + types_begin;
+    const uint8_t *ptr = data + spans_begin, *end = data + size;
+
+    tokens.clear();
+    tokens.reserve(header.token_count);
+
+    uint64_t offset = 0, line = 1;
+    for (uint32_t i = 0 ; i < header.token_count ; i ++) {
+        uint64_t gap, length, line_delta, column;
+        if (! __get_varint__(ptr, end, gap) || ! __get_varint__(ptr, end, length)
+            || ! __get_varint__(ptr, end, line_delta) || ! __get_varint__(ptr, end, column)) {
+            return false;
+        }
+
+        offset += gap;
+        line += line_delta;
+        if (offset + length > source.length() || types[i] >= header.type_table_count) {
+            return false;
+        }
+
+        uint16_t type;
+        memcpy(&type, table + types[i] * sizeof(uint16_t), sizeof(type));
+
+        tokens.push_back({static_cast<TokenType>(type), offset, length,
+                          static_cast<int>(line), static_cast<int>(column)});
+        offset += length;
+    }
+
+    if (ptr != end || tokens.empty() || ! (tokens.back().type & TokenType::ENDMARK)) {
+        return false;
+    }
+
+    end_pos.line = header.end_line;
+    end_pos.column = header.end_column;
+    return true;
+}
+
+uint64_t TokenCache::key(const bytebuffer &source) {
+    return hash_bytes(source.data(), source.length(), LEXER_VERSION);
+}
+
+std::string TokenCache::entry_path(uint64_t key) const {
+    return std::format("{}/{:016x}.rtk", directory, key);
+}
+
+bool TokenCache::load(Lexer &lexer) const {
+#if defined(__unix__)
+    // 缓存中没有 trivia, 无损模式总是重新分析
+    if (! lexer.token_sequence.empty() || lexer.lossless()) {
+        return false;
+    }
+
+    const bytebuffer &source = lexer.source();
+    uint64_t hash = key(source);
+
+    int fd = open(entry_path(hash).c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    std::vector<__cached_token__> tokens;
+    Lexer::position end_pos = lexer.pos;
+    bool ok = __decode__(static_cast<const uint8_t *>(map), size, source, hash, tokens, end_pos);
+    munmap(map, size);
+
+    if (! ok) {
+        return false;
+    }
+
+    for (const auto &tok : tokens) {
+        lexer.token_sequence.push_back(new Token(
+            tok.type,
+            std::string(source.data() + tok.offset, tok.length),
+            new PosInfo(lexer.pos.path, tok.line, tok.column),
+            tok.offset));
+    }
+
+    // 源码已经全部分析完毕
+    lexer.buffer.ahead(source.length());
+    lexer.pos.line = end_pos.line;
+    lexer.pos.column = end_pos.column;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool TokenCache::store(Lexer &lexer) const {
+    lexer.produce_all();
+
+    const bytebuffer &source = lexer.source();
+    const auto &sequence = lexer.token_sequence;
+
+    std::vector<uint16_t> table;
+    std::string types, spans;
+    types.reserve(sequence.size());
+    spans.reserve(sequence.size() * 4);
+
+    size_t offset = 0;
+    int line = 1;
+    for (const Token *tok : sequence) {
+        if (tok->type & TokenType::MASK_ERROR) {
+            return false;
+        }
+
+        uint16_t type = static_cast<uint16_t>(tok->type);
+        size_t index = std::find(table.begin(), table.end(), type) - table.begin();
+        if (index == table.size()) {
+            if (table.size() == 256) {
+                return false;
+            }
+            table.push_back(type);
+        }
+        types.push_back(static_cast<char>(index));
+
+        size_t begin = std::min(tok->offset, source.length());
+        int tok_line = tok->pos != nullptr ? tok->pos->line : line;
+        int tok_column = tok->pos != nullptr ? tok->pos->column : 0;
+        if (begin < offset || tok_line < line || tok_column < 0) {
+            return false;
+        }
+
+        __put_varint__(spans, begin - offset);
+        __put_varint__(spans, tok->content.size());
+        __put_varint__(spans, tok_line - line);
+        __put_varint__(spans, tok_column);
+
+        offset = begin + tok->content.size();
+        line = tok_line;
+    }
+
+    TokenCacheHeader header = {};
+    memcpy(header.magic, __magic__, sizeof(__magic__));
+    header.format_version = FORMAT_VERSION;
+    header.lexer_version = LEXER_VERSION;
+    header.token_count = static_cast<uint32_t>(sequence.size());
+    header.source_hash = key(source);
+    header.source_size = source.length();
+    header.type_table_count = static_cast<uint32_t>(table.size());
+    header.spans_size = static_cast<uint32_t>(spans.size());
+    header.end_line = lexer.pos.line;
+    header.end_column = lexer.pos.column;
+
+    std::string out;
+    out.reserve(sizeof(header) + table.size() * sizeof(uint16_t) + types.size() + spans.size());
+    out.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.append(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(uint16_t));
+    out += types;
+    out += spans;
+
+    // 先写临时文件再改名, 并发的编译不会读到写了一半的缓存
+    std::string path = entry_path(header.source_hash);
+#if defined(__unix__)
+    std::string temp = std::format("{}.{}.tmp", path, getpid());
+#else
+    std::string temp = path + ".tmp";
+#endif
+    FILE *fp = fopen(temp.c_str(), "wb");
+    if (fp == nullptr) {
+        return false;
+    }
+    bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+    ok &= fclose(fp) == 0;
+
+    if (! ok || std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "util/util.h"
+#include "lexer/lexer.h"
+
+namespace rain {
+    // 以源码内容为键的 token 缓存
+    // 键为 hash(源码字节, LEXER_VERSION), 一个键对应目录下的一个文件
+    //
+    // 文件格式 (小端):
+    //   TokenCacheHeader
+    //   uint16_t 类型表[type_table_count]     出现过的 TokenType
+    //   uint8_t  类型序列[token_count]        每个 token 在类型表中的下标
+    //   varint   span 序列                   每个 token 依次为:
+    //                                        与上一个 token 结尾的距离, 长度,
+    //                                        行号增量, 列号
+    // token 的内容直接从源码中切出, 不再单独保存
+    struct TokenCacheHeader {
+        char magic[4];
+        uint32_t format_version;
+        uint32_t lexer_version;
+        uint32_t token_count;
+        uint64_t source_hash;
+        uint64_t source_size;
+        uint32_t type_table_count;
+        uint32_t spans_size;
+        int32_t end_line;
+        int32_t end_column;
+    };
+
+    class TokenCache {
+    private:
+        std::string directory;
+
+        std::string entry_path(uint64_t key) const;
+    public:
+        static constexpr uint32_t FORMAT_VERSION = 1;
+
+        TokenCache(std::string directory)
+            : directory(std::move(directory))
+        {
+        }
+
+        static uint64_t key(const bytebuffer &source);
+
+        // 命中时将 token 序列装入尚未开始分析的 lexer, 失败则不改变 lexer
+        // 缓存不保存 trivia, 无损模式的 lexer 总是不命中
+        bool load(Lexer &lexer) const;
+
+        // 保存 lexer 的完整 token 序列, 含有错误的序列不缓存
+        bool store(Lexer &lexer) const;
+    };
+}
@@ -69,6 +69,12 @@ namespace rain {
         SIGN_LBRACKET  = MASK_SIGN    | 0x0024,         // [
         SIGN_RBRACKET  = MASK_SIGN    | 0x0025,         // ]
         SIGN_POINTER   = MASK_SIGN    | 0x0026,         // ->
+        SIGN_POW       = MASK_REPEAT  | SIGN_MUL,       // **
+        SIGN_POWAS     = MASK_VARIANT | SIGN_POW,       // **=
+        SIGN_SCOPE     = MASK_REPEAT  | SIGN_COLON,     // ::
+        SIGN_ELLIPSIS  = MASK_SIGN    | 0x0027,         // ...
+        SIGN_ARROW     = MASK_SIGN    | 0x0028,         // =>
+        SIGN_SPACESHIP = MASK_SIGN    | 0x0029,         // <=>
         KEYWORD_IF       = MASK_KEYWORD | 0x0001,         // if
         KEYWORD_ELSE     = MASK_KEYWORD | 0x0002,         // else
         KEYWORD_FOR      = MASK_KEYWORD | 0x0003,         // for
@@ -179,6 +185,13 @@ namespace rain {
         case TokenType::SIGN_RBRACE: return "SIGN_RBRACE";
         case TokenType::SIGN_LBRACKET: return "SIGN_LBRACKET";
         case TokenType::SIGN_RBRACKET: return "SIGN_RBRACKET";
+        case TokenType::SIGN_POINTER: return "SIGN_POINTER";
+        case TokenType::SIGN_POW: return "SIGN_POW";
+        case TokenType::SIGN_POWAS: return "SIGN_POWAS";
+        case TokenType::SIGN_SCOPE: return "SIGN_SCOPE";
+        case TokenType::SIGN_ELLIPSIS: return "SIGN_ELLIPSIS";
+        case TokenType::SIGN_ARROW: return "SIGN_ARROW";
+        case TokenType::SIGN_SPACESHIP: return "SIGN_SPACESHIP";
         case TokenType::KEYWORD_IF: return "KEYWORD_IF";
         case TokenType::KEYWORD_ELSE: return "KEYWORD_ELSE";
         case TokenType::KEYWORD_FOR: return "KEYWORD_FOR";
@@ -209,6 +222,9 @@ namespace rain {
         case TokenType::KEYWORD_TYPEDEF: return "KEYWORD_TYPEDEF";
         case TokenType::KEYWORD_FN: return "KEYWORD_FN";
         case TokenType::KEYWORD_LET: return "KEYWORD_LET";
+        case TokenType::KEYWORD_TRUE: return "KEYWORD_TRUE";
+        case TokenType::KEYWORD_FALSE: return "KEYWORD_FALSE";
+        case TokenType::KEYWORD_NULL: return "KEYWORD_NULL";
         case TokenType::ENDMARK: return "ENDMARK";
         }
         return "UNKNOWN_TOKEN";
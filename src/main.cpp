@@ -1,39 +1,641 @@
 #include <iostream>
+#include <thread>
 
 #include "lexer/lexer.h"
+#include "lexer/token_cache.h"
 #include "parser/syntax.h"
 #include "file/helper.h"
 #include "parser/ast_dot.h"
+#include "parser/ast_flat.h"
+#include "parser/syntax_flat.h"
+#include "parser/ast_visitor.h"
+#include "parser/parse_profile.h"
+#include "pass/const_fold.h"
+#include "pass/hash_cons.h"
+#include "eval/bytecode.h"
+#include "eval/eval_bench.h"
+#include "eval/tree_eval.h"
+#include "module/module_loader.h"
+#include "server/compile_server.h"
+#include "util/perf_counters.h"
+#include "util/trace.h"
+
+#include <chrono>
+#include <optional>
+
+// 在 threads 个线程中同时分析同一个文件, 检查各线程得到的 token 序列一致
+// 配合 RAIN_SANITIZE_THREAD 构建可以检查 lexer 之间没有共享的可变状态
+static bool lex_in_threads(const char *path, size_t threads) {
+    using Stream = std::vector<std::tuple<rain::TokenType, std::string, size_t>>;
+    std::vector<Stream> streams(threads);
+    std::vector<std::thread> workers;
+
+    for (size_t i = 0 ; i < threads ; i ++) {
+        workers.emplace_back([&, i]() {
+            rain::trace::thread_name(std::format("lexer {}", i));
+            RAIN_TRACE_SPAN("lex", path);
+            rain::Lexer lexer(rain::readall(path), path);
+            lexer.produce_all();
+            for (const rain::Token *tok : lexer.token_sequence) {
+                streams[i].emplace_back(tok->type, tok->content, tok->offset);
+            }
+            // token 属于本线程的池, 线程退出时释放
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+
+    for (size_t i = 1 ; i < threads ; i ++) {
+        if (streams[i] != streams[0]) {
+            std::cout << std::format("Thread {} produced a different token stream", i) << std::endl;
+            return false;
+        }
+    }
+    std::cout << std::format("{} threads produced identical streams of {} tokens", threads, streams[0].size()) << std::endl;
+    return true;
+}
+
+static bool flat_matches(const rain::FlatView<rain::ExprNode> &flat, const rain::AddExprNode *node);
+
+static const rain::Token *flat_literal_token(const rain::FlatView<rain::LiteralNode> &flat) {
+    return flat.visit([](auto terminal) { return terminal.token(); });
+}
+
+static bool flat_matches(const rain::FlatView<rain::PrimaryExprNode> &flat, const rain::PrimaryExprNode *node) {
+    if (flat.index() != node->index()) {
+        return false;
+    }
+    switch (node->index()) {
+    case 0: {
+        const rain::LiteralNode *literal = std::get<0>(node->child());
+        auto view = flat.get<0>();
+        return view.index() == literal->index()
+               && flat_literal_token(view) == std::visit([](auto *terminal) { return terminal->token(); }, literal->child());
+    }
+    case 1:
+        return flat.get<1>().token() == std::get<1>(node->child())->token();
+    default:
+        return flat_matches(flat.get<2>().get<1>(), std::get<1>(std::get<2>(node->child())->children()));
+    }
+}
+
+static bool flat_matches(const rain::FlatView<rain::MulExprNode> &flat, const rain::MulExprNode *node) {
+    auto flat_prims = flat.get_primary_exprs();
+    auto prims = node->get_primary_exprs();
+    if (flat.get_operators() != node->get_operators() || flat_prims.size() != prims.size()) {
+        return false;
+    }
+    for (size_t i = 0 ; i < prims.size() ; i ++) {
+        if (! flat_matches(flat_prims[i], prims[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 逐层比较加载的扁平 AST 与内存中的树, 终结符比较其引用的 token
+static bool flat_matches(const rain::FlatView<rain::ExprNode> &flat, const rain::AddExprNode *node) {
+    auto flat_terms = flat.get_terms();
+    auto terms = node->get_terms();
+    if (flat.get_operators() != node->get_operators() || flat_terms.size() != terms.size()) {
+        return false;
+    }
+    for (size_t i = 0 ; i < terms.size() ; i ++) {
+        if (! flat_matches(flat_terms[i], terms[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 加载 --load-ast 指定的文件并与这次解析得到的树比较, tokens 须与保存时相同
+static bool check_flat_ast(const std::string &path, const rain::ExprNode *root, const std::vector<rain::Token *> &tokens) {
+    try {
+        auto ast = rain::FlatAst::load<rain::ExprNode>(path, tokens);
+        if (! flat_matches(rain::FlatView<rain::ExprNode>(ast.get(), 0), root)) {
+            std::cout << std::format("{} doesn't match the parsed tree", path) << std::endl;
+            return false;
+        }
+        std::cout << std::format("Loaded {} nodes from {}, matching the parsed tree", ast->node_count(), path) << std::endl;
+        return true;
+    }
+    catch (const std::exception &e) {
+        std::cout << std::format("Couldn't load {}: {}", path, e.what()) << std::endl;
+        return false;
+    }
+}
+
+#ifdef RAIN_MEM_ACCOUNTING
+// 检查稳定状态下每个 token / 节点的 operator new 次数是否超出预算, 预算为 0 表示不检查
+// lex 阶段的分配平摊到 token 上, parse 阶段的分配平摊到节点上, 一次性的初始化计入 setup 阶段, 不参与检查
+static bool check_mem_budget(double per_token, double per_node) {
+    using namespace rain::mem;
+    bool ok = true;
+    auto check = [&](const char *what, Phase phase, Category category, double budget) {
+        size_t objects = Accounting::category(category).total_objects;
+        if (budget <= 0 || objects == 0) {
+            return;
+        }
+        double actual = static_cast<double>(Accounting::phase(phase).news) / objects;
+        bool within = actual <= budget;
+        std::cout << std::format("{} allocations per {}: {:.3f} (budget {:.3f}){}", Accounting::phase_name(phase), what, actual, budget, within ? "" : " OVER BUDGET") << std::endl;
+        ok = ok && within;
+    };
+    check("token", Phase::LEX, Category::TOKEN, per_token);
+    check("node", Phase::PARSE, Category::AST_NODE, per_node);
+    return ok;
+}
+#endif
+
+// 由 token 与 trivia 重建源码, 检查与原文逐字节相同
+static bool check_round_trip(const rain::Lexer &lexer) {
+    std::string rebuilt;
+    rebuilt.reserve(lexer.source().length());
+    for (size_t i = 0 ; i < lexer.token_sequence.size() ; i ++) {
+        for (const rain::Trivia &trivia : lexer.leading_trivia(i)) {
+            rebuilt += lexer.text(trivia);
+        }
+        rebuilt += lexer.text(lexer.token_sequence[i]);
+        for (const rain::Trivia &trivia : lexer.trailing_trivia(i)) {
+            rebuilt += lexer.text(trivia);
+        }
+    }
+
+    bool same = rebuilt == std::string_view(lexer.source().data(), lexer.source().length());
+    std::cout << std::format("Lossless round trip of {} tokens and {} trivia runs ({} bytes): {}",
+                             lexer.token_sequence.size(), lexer.trivia.size(), lexer.trivia.size() * sizeof(rain::Trivia),
+                             same ? "identical" : "MISMATCH") << std::endl;
+    return same;
+}
+
+// 在同一个 token 序列上以语义动作重新解析, 不建立语法树, 与语法树的结果比较
+// tree 为 nullptr 表示语法树的解析失败
+static bool run_action(const std::string &action, rain::TokenStream &stream, const rain::ExprNode *tree, rain::TokenIter tree_end) {
+#ifdef RAIN_MEM_ACCOUNTING
+    size_t news = rain::mem::Accounting::phase(rain::mem::Accounting::current()).news;
+#endif
+    auto begin = std::chrono::steady_clock::now();
+    bool same;
+    std::string outcome;
+
+    if (action == "validate") {
+        rain::ValidateAction validate;
+        auto result = rain::parse_with<rain::ExprNode>(validate, stream.begin(), stream.end());
+        same = result.success == (tree != nullptr) && result.end == tree_end;
+        outcome = result.success ? "valid" : "invalid";
+    }
+    else if (action == "eval") {
+        // 没有变量绑定, 标识符求值为 unbound
+        rain::SlotMap slots;
+        auto result = rain::parse_and_evaluate(stream.begin(), stream.end(), slots, nullptr);
+        if (result.success) {
+            outcome = result.val.status == rain::EvalStatus::OK ? result.val.value.repr() : rain::to_string(result.val.status);
+        } else {
+            outcome = "parse failed";
+        }
+
+        same = result.success == (tree != nullptr) && result.end == tree_end;
+        if (same && tree != nullptr) {
+            rain::Value value;
+            rain::EvalStatus status = rain::evaluate_tree(tree, slots, nullptr, value);
+            same = status == result.val.status && (status != rain::EvalStatus::OK || value == result.val.value);
+        }
+    }
+    else {
+        std::cout << std::format("Unknown action '{}', expected validate or eval", action) << std::endl;
+        return false;
+    }
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << std::format("Action {}: {} in {:.3f} ms, {} the tree", action, outcome, elapsed, same ? "agrees with" : "DISAGREES with") << std::endl;
+#ifdef RAIN_MEM_ACCOUNTING
+    std::cout << std::format("Action {}: {} operator new calls", action, rain::mem::Accounting::phase(rain::mem::Accounting::current()).news - news) << std::endl;
+#endif
+    return same;
+}
+
+// --perf 未开启时返回空, 不读取计数器
+static std::optional<rain::PerfPhases::Scope> perf_scope(std::optional<rain::PerfPhases> &perf, const char *name, const char *unit) {
+    if (! perf) {
+        return std::nullopt;
+    }
+    return std::optional<rain::PerfPhases::Scope>(std::in_place, *perf, name, unit);
+}
+
+// 在 main 返回时写出追踪文件, 提前返回的路径同样覆盖
+struct trace_output {
+    std::string path;
+
+    ~trace_output() {
+#ifdef RAIN_TRACE
+        if (path.empty()) {
+            return;
+        }
+        long long spans = rain::trace::write_json(path);
+        if (spans < 0) {
+            std::cout << "Couldn't write " << path << std::endl;
+        } else {
+            std::cout << std::format("Wrote {} trace spans to {}", spans, path) << std::endl;
+        }
+#endif
+    }
+};
+
+struct node_counter {
+    size_t count = 0;
+
+    template<typename Node>
+    void pre(const Node *node, size_t depth) {
+        count ++;
+    }
+};
+
+// 用 threads 个线程加载 path 及其导入的所有模块, 报告各模块的结果与导入图中的环
+// prefetch 大于 0 时在后台预读, 最多领先 prefetch 个文件
+static bool load_modules(const char *path, size_t threads, size_t prefetch) {
+    auto begin = std::chrono::steady_clock::now();
+    rain::ModuleLoader loader(threads, prefetch);
+    loader.load(path);
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+    bool ok = true;
+    std::vector<const rain::Module *> modules = loader.modules();
+    for (const rain::Module *module : modules) {
+        if (! module->error.empty()) {
+            std::cout << module->error << std::endl;
+            ok = false;
+        }
+        else {
+            std::cout << std::format("{}: {} tokens, {} imports", module->path, module->tokens.size(), module->imports.size()) << std::endl;
+        }
+    }
+    for (const auto &cycle : loader.cycles()) {
+        std::string chain;
+        for (const std::string &step : cycle) {
+            chain += chain.empty() ? step : " -> " + step;
+        }
+        std::cout << "Import cycle: " << chain << std::endl;
+        ok = false;
+    }
+    std::cout << std::format("Loaded {} modules with {} threads in {:.3f} ms", modules.size(), threads, elapsed) << std::endl;
+    if (prefetch > 0) {
+        std::cout << std::format("Prefetched up to {} files ahead through the {} backend", prefetch, loader.prefetch_backend()) << std::endl;
+    }
+    return ok;
+}
+
+int main(int argc, char **argv){
+    const char *path = "./text.txt";
+    std::string lex_stats;
+    std::string token_cache;
+    std::string emit_ast;
+    std::string load_ast;
+    bool fold = false;
+    bool hash_cons = false;
+    bool parse_profile = false;
+    bool mem_report = false;
+    double mem_budget_token = 0;
+    double mem_budget_node = 0;
+    bool perf_report = false;
+    bool lossless = false;
+    std::string action;
+    bool dump_bytecode = false;
+    size_t eval_bench = 0;
+    size_t batch_bench = 0;
+    size_t lex_threads = 0;
+    size_t module_threads = 0;
+    size_t prefetch = 0;
+    std::string serve;
+    std::string client;
+    std::string request = "check";
+    std::string trace_path;
+    rain::DotOptions dot_options;
+
+    for (int i = 1 ; i < argc ; i ++) {
+        std::string_view arg = argv[i];
+        if (arg == "--lex-stats" || arg == "--lex-stats=text") {
+            lex_stats = "text";
+        }
+        else if (arg == "--lex-stats=json") {
+            lex_stats = "json";
+        }
+        else if (arg.starts_with("--token-cache=")) {
+            token_cache = arg.substr(strlen("--token-cache="));
+        }
+        else if (arg.starts_with("--emit-ast=")) {
+            emit_ast = arg.substr(strlen("--emit-ast="));
+        }
+        else if (arg.starts_with("--load-ast=")) {
+            load_ast = arg.substr(strlen("--load-ast="));
+        }
+        else if (arg == "--parse-profile") {
+            parse_profile = true;
+        }
+        else if (arg == "--mem-report") {
+            mem_report = true;
+        }
+        else if (arg.starts_with("--mem-budget-token=")) {
+            mem_budget_token = std::stod(std::string(arg.substr(strlen("--mem-budget-token="))));
+        }
+        else if (arg.starts_with("--mem-budget-node=")) {
+            mem_budget_node = std::stod(std::string(arg.substr(strlen("--mem-budget-node="))));
+        }
+        else if (arg == "--trace" && i + 1 < argc) {
+            trace_path = argv[++ i];
+        }
+        else if (arg.starts_with("--trace=")) {
+            trace_path = arg.substr(strlen("--trace="));
+        }
+        else if (arg.starts_with("--action=")) {
+            action = arg.substr(strlen("--action="));
+        }
+        else if (arg == "--lossless") {
+            lossless = true;
+        }
+        else if (arg == "--perf") {
+            perf_report = true;
+        }
+        else if (arg == "--hash-cons") {
+            hash_cons = true;
+        }
+        else if (arg == "--fold") {
+            fold = true;
+        }
+        else if (arg == "--dump-bytecode") {
+            dump_bytecode = true;
+        }
+        else if (arg == "--eval-bench") {
+            eval_bench = 1000000;
+        }
+        else if (arg.starts_with("--eval-bench=")) {
+            eval_bench = std::stoul(std::string(arg.substr(strlen("--eval-bench="))));
+        }
+        else if (arg == "--batch-bench") {
+            batch_bench = 10000000;
+        }
+        else if (arg.starts_with("--batch-bench=")) {
+            batch_bench = std::stoul(std::string(arg.substr(strlen("--batch-bench="))));
+        }
+        else if (arg.starts_with("--lex-threads=")) {
+            lex_threads = std::stoul(std::string(arg.substr(strlen("--lex-threads="))));
+        }
+        else if (arg == "--modules") {
+            module_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        else if (arg.starts_with("--modules=")) {
+            module_threads = std::stoul(std::string(arg.substr(strlen("--modules="))));
+        }
+        else if (arg.starts_with("--prefetch=")) {
+            prefetch = std::stoul(std::string(arg.substr(strlen("--prefetch="))));
+        }
+        else if (arg.starts_with("--serve=")) {
+            serve = arg.substr(strlen("--serve="));
+        }
+        else if (arg.starts_with("--client=")) {
+            client = arg.substr(strlen("--client="));
+        }
+        else if (arg.starts_with("--request=")) {
+            request = arg.substr(strlen("--request="));
+        }
+        else if (arg.starts_with("--dot-depth=")) {
+            dot_options.max_depth = std::stoul(std::string(arg.substr(strlen("--dot-depth="))));
+        }
+        else if (arg == "--dot-collapse") {
+            dot_options.collapse_chains = true;
+        }
+        else if (arg.starts_with("--dot-sample=")) {
+            dot_options.sample_stride = std::max(1ul, std::stoul(std::string(arg.substr(strlen("--dot-sample=")))));
+        }
+        else if (arg.starts_with("--dot-max-children=")) {
+            dot_options.max_children = std::stoul(std::string(arg.substr(strlen("--dot-max-children="))));
+        }
+        else {
+            path = argv[i];
+        }
+    }
+
+    trace_output trace{trace_path};
+    if (! trace_path.empty()) {
+#ifdef RAIN_TRACE
+        rain::trace::start();
+        rain::trace::thread_name("main");
+#else
+        std::cout << "--trace requires a build with RAIN_TRACE enabled" << std::endl;
+#endif
+    }
+
+    if (! serve.empty()) {
+        rain::CompileServer server(serve);
+        if (! server.serve()) {
+            std::cout << "Couldn't listen on " << serve << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // 路径在客户端规范化, 服务端与客户端的工作目录可以不同
+    if (! client.empty()) {
+        bool with_path = request != "stats" && request != "stop";
+        auto response = rain::send_request(client, with_path ? request + " " + rain::ModuleLoader::canonical(path) : request);
+        if (! response) {
+            std::cout << "Couldn't connect to " << client << std::endl;
+            return 1;
+        }
+        std::cout << response->substr(response->find('\n') + 1);
+        return response->starts_with("ok\n") ? 0 : 1;
+    }
+
+    if (eval_bench > 0) {
+        return rain::run_eval_bench(eval_bench) ? 0 : 1;
+    }
+
+    if (batch_bench > 0) {
+        return rain::run_batch_bench(batch_bench) ? 0 : 1;
+    }
+
+    if (lex_threads > 0) {
+        return lex_in_threads(path, lex_threads) ? 0 : 1;
+    }
+
+    if (module_threads > 0) {
+        return load_modules(path, module_threads, prefetch) ? 0 : 1;
+    }
+
+    std::optional<rain::PerfPhases> perf;
+    if (perf_report) {
+        perf.emplace();
+    }
+
+    rain::bytebuffer source = [&]() {
+        RAIN_TRACE_SPAN("read", path);
+        auto scope = perf_scope(perf, "read", "bytes");
+        rain::bytebuffer buffer = rain::readall(path);
+        if (scope) {
+            scope->units(buffer.length());
+        }
+        return buffer;
+    }();
+    rain::Lexer lexer(std::move(source), path, lossless);
+
+    // token 缓存与 --emit-ast, --load-ast 需要完整的 token 序列, 其余情况边分析边读取
+    // --perf 也先完成词法分析, 使 lex 与 parse 分别计数
+    // --action 需要从头再解析一次
+    bool materialize = ! token_cache.empty() || ! emit_ast.empty() || ! load_ast.empty() || perf_report || lossless || ! action.empty();
+    if (! token_cache.empty()) {
+        RAIN_MEM_PHASE(LEX);
+        RAIN_TRACE_SPAN("token cache", token_cache);
+        rain::TokenCache cache(token_cache);
+        if (! cache.load(lexer)) {
+            cache.store(lexer);
+        }
+    }
+    if (materialize) {
+        RAIN_TRACE_SPAN("lex", path);
+        auto scope = perf_scope(perf, "lex", "tokens");
+        lexer.produce_all();
+        if (scope) {
+            scope->units(lexer.token_sequence.size());
+        }
+    }
+    bool round_trip = ! lossless || check_round_trip(lexer);
+    rain::TokenStream stream = materialize ? rain::TokenStream(lexer.token_sequence) : rain::TokenStream(lexer);
 
-int main(int, char**){
-    rain::Lexer lexer(rain::readall("./text.txt"));
-    rain::Token *tok = lexer.peer();
     constexpr int tokcnt = 9;
     for (int i = 0 ; i < tokcnt ; i ++) {
+        rain::Token *tok = *(stream.begin() + i);
         if (tok->type & rain::TokenType::MASK_ERROR) {
             std::cout << "Got an Error Token!" << std::endl;
         }
         else {
             std::cout << std::format("[{}](type: {}, content: \"{}\")", i + 1, tok->type, tok->content) << std::endl;
         }
-        if (i < tokcnt - 1)
-            tok = lexer.next();
     }
 
-    assert(lexer.rewind(tokcnt - 1));
+    // 驻留后的节点归 table 所有, 在 main 结束时释放
+    rain::HashConsTable table;
+    auto res = [&]() {
+        RAIN_MEM_PHASE(PARSE);
+        RAIN_TRACE_SPAN("parse", path);
+        auto scope = perf_scope(perf, "parse", "nodes");
+        return rain::parse_rule<rain::ExprNode>(stream.begin(), stream.end());
+    }();
 
-    auto res = rain::ExprNode::parse(lexer.token_sequence.begin(), lexer.token_sequence.end());
+    bool action_agrees = action.empty() || run_action(action, stream, res.success ? res.val : nullptr, res.end);
+    bool flat_agrees = load_ast.empty();
+
+    // 节点数在 parse 阶段结束后统计, 不计入该阶段
+    node_counter nodes;
+    if (perf && res.success) {
+        rain::walk_iterative(static_cast<const rain::ExprNode *>(res.val), nodes);
+        perf->units(nodes.count);
+    }
 
     if (res.success) {
         std::cout << "Parsed successfully!" << std::endl;
-        std::cout << res.end - lexer.token_sequence.begin() << std::endl;
-        rain::generate_ast_dot_to_file("ast.dot", res.val);
+        std::cout << res.end - stream.begin() << std::endl;
+        if (! materialize) {
+            std::cout << std::format("Peak token window: {}", stream.peak_window()) << std::endl;
+        }
+        // 折叠新建的字面量 token, 保存扁平 AST 时接在 lexer 的 token 序列之后
+        std::vector<rain::Token *> folded_tokens;
+        if (fold) {
+            RAIN_MEM_PHASE(PASS);
+            RAIN_TRACE_SPAN("fold");
+            rain::FoldStats stats = rain::fold_constants(res.val);
+            std::cout << std::format("Folded {} subtrees, eliminated {} nodes", stats.folded, stats.eliminated) << std::endl;
+            for (const auto &diag : stats.diagnostics) {
+                std::cout << std::format("{}:{}:{}: {}", diag.at->pos->path, diag.at->pos->line, diag.at->pos->column, rain::to_string(diag.status)) << std::endl;
+            }
+            folded_tokens = std::move(stats.created);
+        }
+        // 改写树的 pass 都要在驻留之前完成
+        if (hash_cons) {
+            RAIN_MEM_PHASE(PASS);
+            RAIN_TRACE_SPAN("hash cons");
+            res.val = table.intern(res.val);
+            std::cout << std::format("Interned into {} unique nodes ({} bytes), merged {} duplicates, root hash {:016x}",
+                                     table.size(), table.node_bytes(), table.merged(), table.hash(res.val)) << std::endl;
+        }
+        if (dump_bytecode) {
+            RAIN_MEM_PHASE(CODEGEN);
+            RAIN_TRACE_SPAN("codegen");
+            rain::SlotMap slots;
+            rain::Program program;
+            rain::EvalStatus status = rain::compile(res.val, slots, program);
+            if (status == rain::EvalStatus::OK) {
+                std::cout << program.dump(slots);
+            } else {
+                std::cout << "Compile failed: " << rain::to_string(status) << std::endl;
+            }
+        }
+        {
+            RAIN_TRACE_SPAN("dot");
+            auto scope = perf_scope(perf, "dot", "nodes");
+            rain::generate_ast_dot_to_file("ast.dot", res.val, dot_options);
+            if (scope) {
+                scope->units(nodes.count);
+            }
+        }
+        std::vector<rain::Token *> tokens = lexer.token_sequence;
+        tokens.insert(tokens.end(), folded_tokens.begin(), folded_tokens.end());
+        if (! emit_ast.empty()) {
+            try {
+                if (! rain::save_flat_ast(emit_ast, res.val, tokens)) {
+                    std::cout << "Couldn't write " << emit_ast << std::endl;
+                }
+            }
+            catch (const std::exception &e) {
+                std::cout << std::format("Couldn't write {}: {}", emit_ast, e.what()) << std::endl;
+            }
+        }
+        if (! load_ast.empty()) {
+            flat_agrees = check_flat_ast(load_ast, res.val, tokens);
+        }
     } else {
         std::cout << "Parse failed!" << std::endl;
     }
 
+    if (perf) {
+        std::cout << perf->dump_text();
+    }
+
+    if (parse_profile) {
+#ifdef RAIN_PARSE_PROFILE
+        std::cout << rain::CountingParsePolicy::dump_text();
+#else
+        std::cout << "--parse-profile requires a build with RAIN_PARSE_PROFILE enabled" << std::endl;
+#endif
+    }
+
+    if (! lex_stats.empty()) {
+#ifdef RAIN_LEX_STATS
+        // 统计整个文件, 而不只是上面 parse 用到的部分
+        // 拉取模式下 stream 已读到 ENDMARK 时文件已分析完, 再调用 produce_all 会多分析一个 ENDMARK
+        if (! stream.pulled_endmark()) {
+            lexer.produce_all();
+        }
+        std::cout << (lex_stats == "json" ? lexer.stats.dump_json() : lexer.stats.dump_text()) << std::endl;
+#else
+        std::cout << "--lex-stats requires a build with RAIN_LEX_STATS enabled" << std::endl;
+#endif
+    }
+
+    // 在释放 token 之前报告, 此时的存活字节即整个编译过程保留下来的内存
+    bool within_budget = true;
+    if (mem_report || mem_budget_token > 0 || mem_budget_node > 0) {
+#ifdef RAIN_MEM_ACCOUNTING
+        if (mem_report) {
+            std::cout << rain::mem::Accounting::dump_text();
+        }
+        within_budget = check_mem_budget(mem_budget_token, mem_budget_node);
+#else
+        std::cout << "--mem-report and --mem-budget-* require a build with RAIN_MEM_ACCOUNTING enabled" << std::endl;
+#endif
+    }
+
     rain::Token::pool.cleanup();
     rain::PosInfo::pool.cleanup();
 
-    return 0;
+    return within_budget && round_trip && action_agrees && flat_agrees ? 0 : 1;
 }
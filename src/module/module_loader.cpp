@@ -0,0 +1,235 @@
+#include "module/module_loader.h"
+
+#include "file/helper.h"
+#include "parser/ast_visitor.h"
+#include "util/trace.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+
+using namespace rain;
+
+Module::~Module() {
+    if (ast != nullptr) {
+        destroy_tree(ast);
+    }
+}
+
+ModuleLoader::ModuleLoader(size_t threads, size_t prefetch) {
+    if (prefetch > 0) {
+        prefetcher = std::make_unique<SourcePrefetcher>(prefetch);
+    }
+    threads = std::max<size_t>(threads, 1);
+    for (size_t i = 0 ; i < threads ; i ++) {
+        workers.emplace_back([this, i]() {
+            trace::thread_name(std::format("loader {}", i));
+            work();
+        });
+    }
+}
+
+ModuleLoader::~ModuleLoader() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+std::string ModuleLoader::canonical(const std::string &path) {
+    std::error_code ec;
+    std::filesystem::path result = std::filesystem::weakly_canonical(path, ec);
+    return ec ? path : result.string();
+}
+
+const Module *ModuleLoader::load(const std::string &entry) {
+    Module *module = schedule(canonical(entry));
+
+    std::unique_lock lock(mutex);
+    all_done.wait(lock, [this]() { return pending == 0; });
+    return module;
+}
+
+const Module *ModuleLoader::find(const std::string &path) const {
+    std::lock_guard lock(mutex);
+    auto it = cache.find(canonical(path));
+    return it != cache.end() ? it->second.get() : nullptr;
+}
+
+std::vector<const Module *> ModuleLoader::modules() const {
+    std::lock_guard lock(mutex);
+    std::vector<const Module *> result;
+    for (const auto &[path, module] : cache) {
+        result.push_back(module.get());
+    }
+    return result;
+}
+
+std::vector<std::vector<std::string>> ModuleLoader::cycles() const {
+    std::lock_guard lock(mutex);
+
+    enum Color { WHITE, GRAY, BLACK };
+    std::map<std::string, Color> color;
+    std::vector<std::string> stack;
+    std::vector<std::vector<std::string>> result;
+
+    // 深度优先搜索, 指向栈中 (GRAY) 模块的边即构成一个环
+    std::function<void(const std::string &)> visit = [&](const std::string &path) {
+        color[path] = GRAY;
+        stack.push_back(path);
+
+        auto it = cache.find(path);
+        if (it != cache.end()) {
+            for (const std::string &target : it->second->imports) {
+                if (color[target] == WHITE) {
+                    visit(target);
+                }
+                else if (color[target] == GRAY) {
+                    auto begin = std::find(stack.begin(), stack.end(), target);
+                    std::vector<std::string> cycle(begin, stack.end());
+                    cycle.push_back(target);
+                    result.push_back(std::move(cycle));
+                }
+            }
+        }
+
+        stack.pop_back();
+        color[path] = BLACK;
+    };
+
+    for (const auto &[path, module] : cache) {
+        if (color[path] == WHITE) {
+            visit(path);
+        }
+    }
+    return result;
+}
+
+Module *ModuleLoader::schedule(const std::string &path) {
+    Module *module;
+    {
+        std::lock_guard lock(mutex);
+        auto it = cache.find(path);
+        if (it != cache.end()) {
+            return it->second.get();
+        }
+        module = cache.emplace(path, std::make_unique<Module>(path)).first->second.get();
+        queue.push_back(module);
+        pending ++;
+        // 与 queue 在同一把锁下排队, 分析线程取走缓冲区的顺序与读取的顺序一致
+        if (prefetcher != nullptr) {
+            prefetcher->request(path);
+        }
+    }
+    work_ready.notify_one();
+    return module;
+}
+
+void ModuleLoader::work() {
+    while (true) {
+        Module *module;
+        {
+            std::unique_lock lock(mutex);
+            work_ready.wait(lock, [this]() { return stopping || ! queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            module = queue.front();
+            queue.pop_front();
+        }
+
+        try {
+            bytebuffer source = [&]() {
+                if (prefetcher != nullptr) {
+                    return prefetcher->take(module->path);
+                }
+                RAIN_TRACE_SPAN("read", module->path);
+                return readall(module->path.c_str());
+            }();
+            analyze_module(*module, std::move(source), [this](const std::string &path) { schedule(path); });
+        }
+        catch (const std::exception &e) {
+            module->error = std::format("{}: {}", module->path, e.what());
+        }
+
+        bool done;
+        {
+            std::lock_guard lock(mutex);
+            done = -- pending == 0;
+        }
+        if (done) {
+            all_done.notify_all();
+        }
+    }
+}
+
+void rain::analyze_module(Module &module, bytebuffer source, const std::function<void(const std::string &)> &on_import) {
+    std::filesystem::path dir = std::filesystem::path(module.path).parent_path();
+
+    try {
+        Lexer lexer(std::move(source), module.path);
+
+        {
+            RAIN_TRACE_SPAN("lex", module.path);
+            Token *tok = lexer.pull();
+            while (true) {
+                if (tok->type != TokenType::KEYWORD_IMPORT) {
+                    module.tokens.push_back(tok);
+                    if (tok->type & TokenType::ENDMARK) {
+                        break;
+                    }
+                    tok = lexer.pull();
+                    continue;
+                }
+
+                Token *target = lexer.pull();
+                if (target->type != TokenType::LITERAL_STRING || target->content.size() < 2) {
+                    module.error = std::format("{}:{}:{}: import expects a string literal",
+                                               tok->pos->path, tok->pos->line, tok->pos->column);
+                    module.tokens.push_back(tok);
+                    tok = target;
+                    continue;
+                }
+
+                // 去掉引号, 相对于导入者所在的目录解析
+                std::string name = target->content.substr(1, target->content.size() - 2);
+                std::string path = ModuleLoader::canonical((dir / name).string());
+                module.imports.push_back(path);
+                on_import(path);
+
+                tok = lexer.pull();
+                if (tok->type == TokenType::SIGN_SEMICOLON) {
+                    tok = lexer.pull();
+                }
+            }
+        }
+
+        if (module.error.empty() && module.tokens.size() > 1) {
+            RAIN_MEM_PHASE(PARSE);
+            RAIN_TRACE_SPAN("parse", module.path);
+            TokenStream stream(module.tokens);
+            auto res = parse_rule<ExprNode>(stream.begin(), stream.end());
+            if (res.success && (*res.end)->type & TokenType::ENDMARK) {
+                module.ast = res.val;
+            }
+            else {
+                Token *at = res.success ? *res.end : module.tokens.front();
+                module.error = std::format("{}:{}:{}: parse failed", at->pos->path, at->pos->line, at->pos->column);
+                if (res.success) {
+                    destroy_tree(res.val);
+                }
+            }
+        }
+    }
+    catch (const std::exception &e) {
+        module.error = std::format("{}: {}", module.path, e.what());
+    }
+
+    // 本线程一次只分析一个模块, 池中的对象都属于这个模块
+    module.token_pool.adopt(Token::pool);
+    module.pos_pool.adopt(PosInfo::pool);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "parser/syntax.h"
+#include "file/prefetch.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace rain {
+    // 一个源文件的词法与语法分析结果
+    // 由加载它的线程填写, ModuleLoader::load 返回之后不再修改, 可以在线程间共享
+    struct Module {
+        // 规范化后的路径, 作为缓存的键
+        std::string path;
+        // 被导入模块的规范化路径, 按出现顺序
+        std::vector<std::string> imports;
+        // 去掉 import 声明之后的 token, 以 ENDMARK 结尾
+        std::vector<Token *> tokens;
+        // 只有 import 声明或分析失败时为 nullptr
+        ExprNode *ast = nullptr;
+        // 读取或分析失败的原因, 成功时为空
+        std::string error;
+
+        // 分析本模块的线程创建的 token 与位置, 随模块一起释放
+        mem::Pool<Token> token_pool;
+        mem::Pool<PosInfo> pos_pool;
+
+        explicit Module(std::string path)
+            : path(std::move(path))
+        {
+        }
+
+        Module(const Module &) = delete;
+        Module &operator=(const Module &) = delete;
+
+        ~Module();
+    };
+
+    // 分析 source 并填写 module, 每读到一条 import 就以被导入文件的规范化路径调用 on_import
+    // import "path" [;] 不进入 module.tokens, 路径相对于 module.path 所在的目录
+    // 当前线程的 Token::pool 与 PosInfo::pool 会转交给 module
+    void analyze_module(Module &module, bytebuffer source, const std::function<void(const std::string &)> &on_import);
+
+    // 并行加载导入图
+    //
+    // 词法分析时每读到一条 import "path" 就把目标文件交给线程池, 而不等到整个文件分析完毕,
+    // 因此宽的依赖图的加载时间接近关键路径的长度
+    // 每个模块按规范化路径只分析一次, 结果保存在共享的缓存中
+    //
+    // prefetch 大于 0 时由 SourcePrefetcher 在后台读取调度的文件, 最多领先分析线程 prefetch 个文件
+    class ModuleLoader {
+    public:
+        explicit ModuleLoader(size_t threads, size_t prefetch = 0);
+        ~ModuleLoader();
+
+        ModuleLoader(const ModuleLoader &) = delete;
+        ModuleLoader &operator=(const ModuleLoader &) = delete;
+
+        // 加载 entry 及其传递导入的所有模块, 阻塞直到全部完成
+        // 已经在缓存中的模块不会再次分析
+        const Module *load(const std::string &entry);
+
+        // 按路径查找已加载的模块, 路径会先规范化
+        [[nodiscard]] const Module *find(const std::string &path) const;
+
+        // 缓存中的所有模块, 按路径排序
+        [[nodiscard]] std::vector<const Module *> modules() const;
+
+        // 导入图中的环, 每个环是一串路径, 首尾为同一个模块
+        [[nodiscard]] std::vector<std::vector<std::string>> cycles() const;
+
+        static std::string canonical(const std::string &path);
+
+        // 预读使用的后端, 未开启预读时为空
+        [[nodiscard]] const char *prefetch_backend() const {
+            return prefetcher != nullptr ? prefetcher->backend() : nullptr;
+        }
+
+    private:
+        mutable std::mutex mutex;
+        std::condition_variable work_ready;
+        std::condition_variable all_done;
+
+        std::map<std::string, std::unique_ptr<Module>> cache;
+        std::deque<Module *> queue;
+        // 已调度但尚未分析完毕的模块数
+        size_t pending = 0;
+        bool stopping = false;
+
+        // 须在 workers 之前构造, 在其之后析构
+        std::unique_ptr<SourcePrefetcher> prefetcher;
+        std::vector<std::thread> workers;
+
+        // path 须已规范化, 不在缓存中时加入缓存并调度, 返回缓存中的模块
+        Module *schedule(const std::string &path);
+        void work();
+    };
+}
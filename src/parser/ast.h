@@ -1,33 +1,137 @@
 #pragma once
 
 #include "lexer/lexer.h"
+#include "parser/token_stream.h"
+#include "parser/parse_profile.h"
 #include <type_traits>
 #include <tuple>
 #include <variant>
 
 namespace rain {
-    using TokenIter = std::vector<Token *>::const_iterator;
-
     // 存储parse结果
-    template<typename T>
-    struct ParseResult {
+    // 以 Action 解析时 val 为该规则在 Action 下的值, 建立语法树时为节点指针 (见 ParseResult)
+    template<typename V>
+    struct ActionResult {
         bool success;
-        T *val;
+        V val;
         TokenIter end;
 
-        ParseResult(bool success, T *val, TokenIter end)
-            : success(success), val(val), end(end)
+        ActionResult(bool success, V val, TokenIter end)
+            : success(success), val(std::move(val)), end(end)
         {
-        } 
+        }
+
+        static ActionResult failed(TokenIter end) {
+            return ActionResult(false, V(), end);
+        }
+    };
+
+    template<typename T>
+    using ParseResult = ActionResult<T *>;
+
+    template<TokenType T>
+    class TerminalNode;
+    template<TokenType T>
+    class DiscardTerminalNode;
+    template<typename T>
+    class ClosureNode;
+    template<typename... Nodes>
+    class ConnectionNode;
+    template<typename... Nodes>
+    class OptionsNode;
+
+    namespace detail {
+        // 从语法类 (如 AddExprNode) 推导其组合子基类
+        template<TokenType T>
+        TerminalNode<T> structural_base(const TerminalNode<T> *);
+        template<TokenType T>
+        DiscardTerminalNode<T> structural_base(const DiscardTerminalNode<T> *);
+        template<typename T>
+        ClosureNode<T> structural_base(const ClosureNode<T> *);
+        template<typename... Nodes>
+        ConnectionNode<Nodes...> structural_base(const ConnectionNode<Nodes...> *);
+        template<typename... Nodes>
+        OptionsNode<Nodes...> structural_base(const OptionsNode<Nodes...> *);
+
+        template<typename T>
+        using structural_t = decltype(structural_base(static_cast<const T *>(nullptr)));
+    }
+
+    // 组合子的 parse 只有一份, 每条规则成功时由 ActionBuilder<Action> 从子规则的结果构造该规则的值
+    // 默认的 BuildTreeAction 在堆上建立语法树节点, 其它 Action 见 ast_action.h
+    struct BuildTreeAction {};
+
+    template<typename Action>
+    struct ActionBuilder;
+
+    template<>
+    struct ActionBuilder<BuildTreeAction> {
+        template<typename Node>
+        using value = Node *;
+
+        template<typename T>
+        using items = std::vector<T *>;
+
+        template<typename Policy>
+        static void allocated() {
+            Policy::allocated();
+        }
+
+        // 节点引用 token, 由 stream 保留
+        template<typename Node>
+        static Node *terminal(TokenIter it) {
+            it.source()->retain(it.position());
+            return new Node(*it);
+        }
+
+        template<typename Node>
+        static Node *discard() {
+            return nullptr;
+        }
+
+        template<typename Node, typename T>
+        static Node *closure(std::vector<T *> &&children) {
+            return new Node(std::move(children));
+        }
+
+        template<typename Node, typename... Ts>
+        static Node *connection(std::tuple<Ts *...> &&children) {
+            return new Node(std::move(children));
+        }
+
+        // 清理已经解析的节点
+        template<typename... Ts>
+        static void release(const std::tuple<Ts *...> &children) {
+            std::apply([](auto *... ptrs) {
+                (delete ptrs, ...);
+            }, children);
+        }
 
-        static ParseResult<T> failed(TokenIter end) {
-            return ParseResult<T>(false, nullptr, end);
+        template<typename Node, size_t Index, typename Child>
+        static Node *option(Child *child) {
+            std::remove_cvref_t<decltype(std::declval<const Node &>().child())> v;
+            v.template emplace<Index>(child);
+            return new Node(std::move(v), Index);
+        }
+
+        // 语法类的节点即其组合子基类的节点
+        template<typename Rule, typename Attr>
+        static Rule *reduce(BuildTreeAction &, Attr *attr) {
+            return static_cast<Rule *>(attr);
         }
     };
 
+    template<typename Node, typename Action>
+    using action_value_t = typename ActionBuilder<Action>::template value<Node>;
+
+    // 以 Action 解析一个子规则, 由 Policy 记录这次尝试
+    // 语法类先按其组合子基类解析, 再交给 ActionBuilder::reduce
+    template<typename Rule, typename Policy = ParsePolicy, typename Action>
+    ActionResult<action_value_t<Rule, Action>> parse_rule(Action &action, TokenIter begin, TokenIter end);
+
     // 终结符
     template<TokenType T>
-    class TerminalNode {
+    class TerminalNode : public mem::Tracked<TerminalNode<T>, mem::Category::AST_NODE> {
     protected:
         const Token *_token;
     public:
@@ -43,11 +147,17 @@ namespace rain {
             return begin != end && (*begin)->type == T;
         }
         static ParseResult<TerminalNode> parse(TokenIter begin, TokenIter end) {
-            Token *tok = *begin;
+            BuildTreeAction action;
+            return parse(begin, end, action);
+        }
+        template<typename Action, typename Policy = ParsePolicy>
+        static ActionResult<action_value_t<TerminalNode, Action>> parse(TokenIter begin, TokenIter end, Action &action) {
+            using Builder = ActionBuilder<Action>;
             if (begin != end && (*begin)->type == T) {
-                return ParseResult<TerminalNode>(true, new TerminalNode(*begin), begin + 1);
+                Builder::template allocated<Policy>();
+                return ActionResult<action_value_t<TerminalNode, Action>>(true, Builder::template terminal<TerminalNode>(begin), begin + 1);
             }
-            return ParseResult<TerminalNode>::failed(end);
+            return ActionResult<action_value_t<TerminalNode, Action>>::failed(end);
         }
     };
 
@@ -62,45 +172,63 @@ namespace rain {
             return begin != end && (*begin)->type == T;
         }
         static ParseResult<DiscardTerminalNode> parse(TokenIter begin, TokenIter end) {
-            Token *tok = *begin;
+            BuildTreeAction action;
+            return parse(begin, end, action);
+        }
+        template<typename Action, typename Policy = ParsePolicy>
+        static ActionResult<action_value_t<DiscardTerminalNode, Action>> parse(TokenIter begin, TokenIter end, Action &action) {
+            using Builder = ActionBuilder<Action>;
             if (begin != end && (*begin)->type == T) {
-                return ParseResult<DiscardTerminalNode>(true, nullptr, begin + 1);
+                return ActionResult<action_value_t<DiscardTerminalNode, Action>>(true, Builder::template discard<DiscardTerminalNode>(), begin + 1);
             }
-            return ParseResult<DiscardTerminalNode>::failed(end);
+            return ActionResult<action_value_t<DiscardTerminalNode, Action>>::failed(end);
         }
     };
     
     // 闭包节点 (0次或多次)
     template<typename T>
-    class ClosureNode {
+    class ClosureNode : public mem::Tracked<ClosureNode<T>, mem::Category::AST_NODE> {
     public:
         ClosureNode(std::vector<T*>&& children) : _children(std::move(children)) {}
     
         const std::vector<T*>& children() const { return _children; }
+        std::vector<T*>& children() { return _children; }
     
         static bool lookahead(TokenIter begin, TokenIter end)
         {
             return T::lookahead(begin, end);
         }
         static ParseResult<ClosureNode<T>> parse(TokenIter begin, TokenIter end) {
-            std::vector<T*> children;
+            BuildTreeAction action;
+            return parse(begin, end, action);
+        }
+        template<typename Action, typename Policy = ParsePolicy>
+        static ActionResult<action_value_t<ClosureNode, Action>> parse(TokenIter begin, TokenIter end, Action &action) {
+            using Builder = ActionBuilder<Action>;
+            typename Builder::template items<T> children;
             TokenIter current = begin;
+            // 失败时回到 current, 之前的 token 不会再用到
+            auto checkpoint = begin.source()->checkpoint(begin);
             
             // 未读到头
             while (current != end) {
                 // 先进行lookahead测试
                 if (! T::lookahead(current, end))
                     break;
-                auto result = T::parse(current, end);
+                auto result = parse_rule<T, Policy>(action, current, end);
                 // parse失败
-                if (! result.success)
+                if (! result.success) {
+                    Policy::backtrack();
                     break;
+                }
 
-                children.push_back(result.val);
+                children.push_back(std::move(result.val));
                 current = result.end;
+                checkpoint.move(current);
             }
         
-            return ParseResult<ClosureNode<T>>(true, new ClosureNode<T>(std::move(children)), current);
+            Builder::template allocated<Policy>();
+            return ActionResult<action_value_t<ClosureNode, Action>>(true, Builder::template closure<ClosureNode>(std::move(children)), current);
     }
 
     private:
@@ -109,18 +237,25 @@ namespace rain {
     
     // 连接节点 - 匹配一系列连续的节点
     template<typename... Nodes>
-    class ConnectionNode {
+    class ConnectionNode : public mem::Tracked<ConnectionNode<Nodes...>, mem::Category::AST_NODE> {
     public:
         ConnectionNode(std::tuple<Nodes*...>&& children) : _children(std::move(children)) {}
         
         const std::tuple<Nodes*...>& children() const { return _children; }
+        std::tuple<Nodes*...>& children() { return _children; }
         
         static bool lookahead(TokenIter begin, TokenIter end) {
             return lookahead_impl<0>(begin, end);
         }
         
         static ParseResult<ConnectionNode> parse(TokenIter begin, TokenIter end) {
-            return parse_impl<0>(begin, end, std::make_tuple());
+            BuildTreeAction action;
+            return parse(begin, end, action);
+        }
+
+        template<typename Action, typename Policy = ParsePolicy>
+        static ActionResult<action_value_t<ConnectionNode, Action>> parse(TokenIter begin, TokenIter end, Action &action) {
+            return parse_impl<0, Policy>(action, begin, end, std::make_tuple());
         }
 
     private:
@@ -142,55 +277,49 @@ namespace rain {
         }
         
         // 从Index处进行parse
-        // ParsedNode说明已经parse了多少
-        template<size_t Index, typename... ParsedNodes>
-        static ParseResult<ConnectionNode> parse_impl(TokenIter begin, TokenIter end, std::tuple<ParsedNodes...>&& current_tuple) {
+        // ParsedValues说明已经parse了多少
+        template<size_t Index, typename Policy, typename Action, typename... ParsedValues>
+        static ActionResult<action_value_t<ConnectionNode, Action>> parse_impl(Action &action, TokenIter begin, TokenIter end, std::tuple<ParsedValues...>&& current_tuple) {
+            using Builder = ActionBuilder<Action>;
             if constexpr (Index == sizeof...(Nodes)) {
                 // 所有节点都解析成功，创建ConnectionNode
-                return ParseResult<ConnectionNode>(
+                Builder::template allocated<Policy>();
+                return ActionResult<action_value_t<ConnectionNode, Action>>(
                     true, 
-                    new ConnectionNode(std::move(current_tuple)),
+                    Builder::template connection<ConnectionNode>(std::move(current_tuple)),
                     begin
                 );
             } else {
                 // 提取现在应该使用的Node
                 using CurrentType = std::tuple_element_t<Index, std::tuple<Nodes...>>;
-                auto result = CurrentType::parse(begin, end);
+                auto result = parse_rule<CurrentType, Policy>(action, begin, end);
                 
                 if (!result.success) {
-                    // 清理已经解析的节点
-                    cleanup_tuple(current_tuple);
-                    return ParseResult<ConnectionNode>::failed(begin);
+                    Builder::release(current_tuple);
+                    return ActionResult<action_value_t<ConnectionNode, Action>>::failed(begin);
                 }
                 
-                // 将当前解析的节点添加到元组中，继续解析下一个
+                // 将当前解析的结果添加到元组中，继续解析下一个
                 auto new_tuple = std::tuple_cat(
                     std::move(current_tuple),
-                    std::make_tuple(result.val)
+                    std::make_tuple(std::move(result.val))
                 );
                 
                 // 递归解析剩余节点
-                return parse_impl<Index + 1, ParsedNodes..., CurrentType*>(result.end, end, std::move(new_tuple));
+                return parse_impl<Index + 1, Policy>(action, result.end, end, std::move(new_tuple));
             }
         }
-        
-        // 辅助函数：清理元组中的节点指针
-        template<typename... Ts>
-        static void cleanup_tuple(const std::tuple<Ts*...>& tuple) {
-            std::apply([](auto*... ptrs) {
-                (delete ptrs, ...);
-            }, tuple);
-        }
     };
     
     // 选择节点 - 从一系列候选节点中选择第一个能成功解析的
     template<typename... Nodes>
-    class OptionsNode {
+    class OptionsNode : public mem::Tracked<OptionsNode<Nodes...>, mem::Category::AST_NODE> {
     public:
         OptionsNode(std::variant<Nodes*...>&& child, size_t index)
             : _child(std::move(child)), _index(index) {}
 
         const std::variant<Nodes*...>& child() const { return _child; }
+        std::variant<Nodes*...>& child() { return _child; }
         size_t index() const { return _index; }
 
         static bool lookahead(TokenIter begin, TokenIter end) {
@@ -198,7 +327,15 @@ namespace rain {
         }
 
         static ParseResult<OptionsNode> parse(TokenIter begin, TokenIter end) {
-            return parse_impl<0>(begin, end);
+            BuildTreeAction action;
+            return parse(begin, end, action);
+        }
+
+        template<typename Action, typename Policy = ParsePolicy>
+        static ActionResult<action_value_t<OptionsNode, Action>> parse(TokenIter begin, TokenIter end, Action &action) {
+            // 每个候选都从 begin 开始尝试
+            auto checkpoint = begin.source()->checkpoint(begin);
+            return parse_impl<0, Policy>(action, begin, end);
         }
 
     private:
@@ -216,28 +353,47 @@ namespace rain {
             return false;
         }
 
-        template<size_t Index>
-        static ParseResult<OptionsNode> parse_impl(TokenIter begin, TokenIter end) {
+        template<size_t Index, typename Policy, typename Action>
+        static ActionResult<action_value_t<OptionsNode, Action>> parse_impl(Action &action, TokenIter begin, TokenIter end) {
+            using Builder = ActionBuilder<Action>;
             if constexpr (Index == sizeof...(Nodes)) {
-                return ParseResult<OptionsNode>::failed(end);
+                return ActionResult<action_value_t<OptionsNode, Action>>::failed(end);
             } else {
                 using CurrentType = std::tuple_element_t<Index, std::tuple<Nodes...>>;
 
                 // 先通过 lookahead 快速排除不可能的候选
                 if (!CurrentType::lookahead(begin, end)) {
-                    return parse_impl<Index + 1>(begin, end);
+                    return parse_impl<Index + 1, Policy>(action, begin, end);
                 }
 
-                auto result = CurrentType::parse(begin, end);
+                auto result = parse_rule<CurrentType, Policy>(action, begin, end);
                 if (result.success) {
-                    std::variant<Nodes*...> v;
-                    v.template emplace<Index>(result.val);
-                    return ParseResult<OptionsNode>(true, new OptionsNode(std::move(v), Index), result.end);
+                    Builder::template allocated<Policy>();
+                    return ActionResult<action_value_t<OptionsNode, Action>>(
+                        true, Builder::template option<OptionsNode, Index>(std::move(result.val)), result.end);
                 }
 
                 // 尝试下一个候选
-                return parse_impl<Index + 1>(begin, end);
+                Policy::backtrack();
+                return parse_impl<Index + 1, Policy>(action, begin, end);
             }
         }
     };
-}
\ No newline at end of file
+
+    template<typename Rule, typename Policy, typename Action>
+    ActionResult<action_value_t<Rule, Action>> parse_rule(Action &action, TokenIter begin, TokenIter end) {
+        using Structural = detail::structural_t<Rule>;
+        typename Policy::template Scope<Rule> scope(begin);
+        auto result = Structural::template parse<Action, Policy>(begin, end, action);
+        if (! result.success) {
+            return ActionResult<action_value_t<Rule, Action>>::failed(result.end);
+        }
+        scope.success(result.end);
+        if constexpr (std::is_same_v<Structural, Rule>) {
+            return result;
+        } else {
+            return ActionResult<action_value_t<Rule, Action>>(
+                true, ActionBuilder<Action>::template reduce<Rule>(action, std::move(result.val)), result.end);
+        }
+    }
+}
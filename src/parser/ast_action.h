@@ -0,0 +1,161 @@
+#pragma once
+
+#include "parser/ast_visitor.h"
+
+#include <variant>
+
+namespace rain {
+    // 带语义动作的 parse: 使用 ast.h 中组合子的 parse, 但不建立语法树, 而是在每条规则成功时调用 Action 计算用户定义的值
+    //
+    // Action 需要提供:
+    //   using value_type = V;
+    //   V reduce(std::type_identity<Rule>, Attr &&attr)
+    //       语法类 (如 MulExprNode) 解析成功时调用, attr 为其组合子基类的结果, 可以用模板统一处理多个规则
+    //       ExprNode 这样继承自另一个语法类的规则同样直接以组合子基类的结果调用
+    // 可选:
+    //   template<typename Item> using closure = C;
+    //       ClosureNode 的结果类型, 需要支持默认构造与 push_back, 默认为 std::vector<Item>
+    //   static constexpr bool keep_tokens = false;
+    //       reduce 与 closure 都不读取终结符的 token 时声明, 拉取模式下这些 token 离开回溯范围即被释放
+    //       默认与语法树一样保留所有匹配到终结符的 token
+    //
+    // 组合子的结果都是值, 不在堆上分配节点:
+    //   TerminalNode<T>         const Token *
+    //   DiscardTerminalNode<T>  std::monostate
+    //   ClosureNode<T>          Action::closure<Item> 或 std::vector<Item>
+    //   ConnectionNode<Ns...>   std::tuple<...>
+    //   OptionsNode<Ns...>      std::variant<...>, 按候选的下标构造
+    //   语法类                  V, 需要支持默认构造
+    //
+    // lookahead, 回溯与 ParsePolicy 的统计都来自同一份 parse, 失败的候选的值直接丢弃
+    // 因此 reduce 不应有副作用, 例如直接向共享的字节码缓冲区写入指令
+
+    namespace detail {
+        template<typename Action, typename Item>
+        struct action_closure {
+            using type = std::vector<Item>;
+        };
+
+        template<typename Action, typename Item>
+            requires requires { typename Action::template closure<Item>; }
+        struct action_closure<Action, Item> {
+            using type = typename Action::template closure<Item>;
+        };
+
+        template<typename Action>
+        struct action_keep_tokens : std::true_type {};
+
+        template<typename Action>
+            requires requires { Action::keep_tokens; }
+        struct action_keep_tokens<Action> : std::bool_constant<Action::keep_tokens> {};
+
+        // 语法类的结果为 Action::value_type, 组合子的结果见上
+        template<typename Node, typename Action>
+        struct action_value {
+            using type = typename Action::value_type;
+        };
+
+        template<TokenType T, typename Action>
+        struct action_value<TerminalNode<T>, Action> {
+            using type = const Token *;
+        };
+
+        template<TokenType T, typename Action>
+        struct action_value<DiscardTerminalNode<T>, Action> {
+            using type = std::monostate;
+        };
+
+        template<typename T, typename Action>
+        struct action_value<ClosureNode<T>, Action> {
+            using type = typename action_closure<Action, typename action_value<T, Action>::type>::type;
+        };
+
+        template<typename... Nodes, typename Action>
+        struct action_value<ConnectionNode<Nodes...>, Action> {
+            using type = std::tuple<typename action_value<Nodes, Action>::type...>;
+        };
+
+        template<typename... Nodes, typename Action>
+        struct action_value<OptionsNode<Nodes...>, Action> {
+            using type = std::variant<typename action_value<Nodes, Action>::type...>;
+        };
+    }
+
+    // 除 BuildTreeAction 之外的 Action 都按上面的规则构造值
+    template<typename Action>
+    struct ActionBuilder {
+        template<typename Node>
+        using value = typename detail::action_value<Node, Action>::type;
+
+        template<typename T>
+        using items = value<ClosureNode<T>>;
+
+        template<typename Policy>
+        static void allocated() {
+        }
+
+        template<typename Node>
+        static value<Node> terminal(TokenIter it) {
+            if constexpr (detail::action_keep_tokens<Action>::value) {
+                it.source()->retain(it.position());
+            }
+            return *it;
+        }
+
+        template<typename Node>
+        static value<Node> discard() {
+            return {};
+        }
+
+        template<typename Node, typename Items>
+        static value<Node> closure(Items &&items) {
+            return std::move(items);
+        }
+
+        template<typename Node, typename Children>
+        static value<Node> connection(Children &&children) {
+            return std::move(children);
+        }
+
+        template<typename Children>
+        static void release(const Children &) {
+        }
+
+        template<typename Node, size_t Index, typename Child>
+        static value<Node> option(Child &&child) {
+            return value<Node>(std::in_place_index<Index>, std::move(child));
+        }
+
+        template<typename Rule, typename Attr>
+        static value<Rule> reduce(Action &action, Attr &&attr) {
+            return action.reduce(std::type_identity<Rule>(), std::move(attr));
+        }
+    };
+
+    // 以 Action 解析一个规则, 与 parse_rule 一样由 Policy 记录这次尝试
+    template<typename Rule, typename Policy = ParsePolicy, typename Action>
+    ActionResult<action_value_t<Rule, Action>> parse_with(Action &action, TokenIter begin, TokenIter end) {
+        return parse_rule<Rule, Policy>(action, begin, end);
+    }
+
+    // 只检查输入是否符合文法, 不分配任何节点, 重复项只计数
+    struct ValidateAction {
+        struct value_type {};
+
+        static constexpr bool keep_tokens = false;
+
+        template<typename Item>
+        struct closure {
+            size_t count = 0;
+
+            void push_back(Item &&) {
+                count ++;
+            }
+        };
+
+        template<typename Rule, typename Attr>
+        value_type reduce(std::type_identity<Rule>, Attr &&) {
+            return {};
+        }
+    };
+}
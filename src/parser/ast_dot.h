@@ -3,20 +3,16 @@
 #pragma once
 
 #include "parser/ast.h"
+#include "parser/ast_visitor.h"
 #include "lexer/lexer.h"
-#include <ostream>
+#include "util/type_name.h"
+#include <charconv>
 #include <fstream>
+#include <limits>
+#include <ostream>
 #include <string>
-#include <type_traits>
-#include <tuple>
-#include <variant>
+#include <string_view>
 #include <vector>
-#include <sstream>
-#include <typeinfo>
-#if defined(__GNUG__)
-#include <cxxabi.h>
-#include <cstdlib>
-#endif
 
 namespace rain {
 
@@ -25,235 +21,242 @@ namespace rain {
 //   #include "parser/ast_dot.h"
 //   rain::generate_ast_dot_to_file("ast.dot", root_ptr);
 
-namespace detail {
-
-inline std::string escape_label(const std::string &s) {
-    std::string out;
-    out.reserve(s.size() + 10);
-    for (char c : s) {
-        switch (c) {
-            case '"': out += "\\\""; break;
-            case '\n': out += "\n"; break;
-            case '\r': out += "\\r"; break;
-            case '\t': out += "\\t"; break;
-            case '<': out += "\\<"; break;
-            case '>': out += "\\>"; break;
-            case '|': out += "\\|"; break;
-            case '{': out += "\\{"; break;
-            case '}': out += "\\}"; break;
-            case '\\': out += "\\\\"; break;
-            default: out += c; break;
-        }
-    }
-    return out;
-}
-
-// Traits to detect member functions
-template<typename T, typename = void>
-struct has_children_method : std::false_type {};
-template<typename T>
-struct has_children_method<T, std::void_t<decltype(std::declval<const T&>().children())>> : std::true_type {};
-
-template<typename T, typename = void>
-struct has_child_method : std::false_type {};
-template<typename T>
-struct has_child_method<T, std::void_t<decltype(std::declval<const T&>().child()), decltype(std::declval<const T&>().index())>> : std::true_type {};
-
-template<typename T, typename = void>
-struct has_token_method : std::false_type {};
-template<typename T>
-struct has_token_method<T, std::void_t<decltype(std::declval<const T&>().token())>> : std::true_type {};
+struct DotOptions {
+    // Subtrees deeper than this are not emitted
+    size_t max_depth = std::numeric_limits<size_t>::max();
+    // Skip Options/Connection/Closure wrappers that have a single child
+    bool collapse_chains = false;
+    // Emit only every n-th child of a closure
+    size_t sample_stride = 1;
+    // Emit at most this many children of a closure
+    size_t max_children = std::numeric_limits<size_t>::max();
+};
 
-// Helpers to detect tuple/vector types
-template<typename T>
-struct is_tuple : std::false_type {};
-template<typename... Ts>
-struct is_tuple<std::tuple<Ts...>> : std::true_type {};
+namespace detail {
 
+// Number of children of a ConnectionNode that are not discarded
 template<typename T>
-struct is_vector : std::false_type {};
-template<typename U>
-struct is_vector<std::vector<U>> : std::true_type {};
+struct kept_children;
+template<typename... Nodes>
+struct kept_children<ConnectionNode<Nodes...>>
+    : std::integral_constant<size_t, ((node_kind_v<Nodes> != NodeKind::DISCARD) + ... + 0)> {};
 
 // Dot generator class
+// Labels are escaped straight into one large buffer which is flushed in big chunks
 class DotGen {
 public:
-    DotGen(std::ostream &out) : out(out), next_id(0) {
-        out << "digraph AST {\n";
-        out << "  node [shape=box, fontname=\"Consolas\"];\n";
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+    DotGen(std::ostream &out, DotOptions options = {}) : out(out), options(options), next_id(0) {
+        buffer.reserve(BUFFER_SIZE);
+        append("digraph AST {\n");
+        append("  node [shape=box, fontname=\"Consolas\"];\n");
     }
 
     ~DotGen() {
-        out << "}\n";
+        append("}\n");
+        flush();
     }
 
+    // Emit the subtree rooted at node, returns the id of its top-most emitted node
     template<typename Node>
     int visit(Node* node) {
-        if (node == nullptr)
-            return -1;
-
-        // Dispatch based on available API on Node
-        if constexpr (has_token_method<Node>::value) {
-            return visit_terminal(node);
-        } else if constexpr (has_child_method<Node>::value) {
-            return visit_options(node);
-        } else if constexpr (has_children_method<Node>::value) {
-            // children() can be tuple (ConnectionNode) or vector (ClosureNode)
-            using ChildrenT = decltype(node->children());
-            using PlainChildrenT = std::remove_cvref_t<ChildrenT>;
-            if constexpr (is_tuple<PlainChildrenT>::value) {
-                return visit_tuple_node(node);
-            } else if constexpr (is_vector<PlainChildrenT>::value) {
-                return visit_vector_node(node);
-            } else {
-                // unknown children container -> emit readable type name
-                return emit_type<Node>();
+        root_id = -1;
+        frames.clear();
+        walk_iterative(static_cast<const Node *>(node), *this);
+        return root_id;
+    }
+
+    template<typename Node>
+    VisitAction pre(const Node *node, size_t depth) {
+        constexpr NodeKind kind = node_kind_v<Node>;
+        Frame *parent = frames.empty() ? nullptr : &frames.back();
+
+        if (depth > options.max_depth) {
+            if (parent != nullptr) {
+                parent->elided ++;
             }
-        } else {
-            return emit_type<Node>();
+            return VisitAction::SKIP;
         }
-    }
 
-private:
-    std::ostream &out;
-    int next_id;
+        if (parent != nullptr && parent->kind == NodeKind::CLOSURE) {
+            size_t index = parent->seen ++;
+            if (index >= options.max_children || index % options.sample_stride != 0) {
+                parent->elided ++;
+                return VisitAction::SKIP;
+            }
+        }
 
-    int emit_node(const std::string &label) {
-        int id = next_id++;
-        out << "  node" << id << " [label=\"" << escape_label(label) << "\"];\n";
-        return id;
-    }
+        int link = parent != nullptr ? parent->link : -1;
+        if (! transparent(node, parent)) {
+            int id = emit_node(node);
+            if (link >= 0) {
+                emit_edge(link, id);
+            }
+            if (root_id < 0) {
+                root_id = id;
+            }
+            link = id;
+        }
 
-    int emit_leaf(const std::string &label) {
-        return emit_node(label);
+        frames.push_back({kind, link, 0, 0});
+        return VisitAction::CONTINUE;
     }
 
-    template<typename T>
-    int emit_type() {
-        return emit_node(type_name<T>());
+    template<typename Node>
+    void post(const Node *node, size_t depth) {
+        Frame frame = frames.back();
+        frames.pop_back();
+
+        if (frame.elided > 0 && frame.link >= 0) {
+            int id = next_id ++;
+            append("  node");
+            append_number(id);
+            append(" [label=\"... ");
+            append_number(frame.elided);
+            append(" elided\", style=dashed];\n");
+            emit_edge(frame.link, id);
+        }
     }
 
-    // Try to produce a readable type name. On GNU toolchains use __cxa_demangle.
-    template<typename T>
-    static std::string type_name() {
-#if defined(__GNUG__)
-        int status = 0;
-        const char *name = typeid(T).name();
-        char *dem = abi::__cxa_demangle(name, nullptr, nullptr, &status);
-        std::string ret = (status == 0 && dem != nullptr) ? dem : name;
-        free(dem);
-        return ret;
-#else
-        return typeid(T).name();
-#endif
-    }
+private:
+    struct Frame {
+        NodeKind kind;
+        // Id that children link to, -1 if nothing above was emitted
+        int link;
+        size_t seen;
+        size_t elided;
+    };
 
-    template<typename T>
-    int visit_terminal(T* node) {
-        const Token *tok = node->token();
-        std::string lbl = std::string("Terminal") + "\n" + (tok ? tok->content : "<null>");
-        int id = emit_node(lbl);
-        return id;
+    std::ostream &out;
+    DotOptions options;
+    int next_id;
+    int root_id = -1;
+    std::string buffer;
+    std::vector<Frame> frames;
+
+    void flush() {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
     }
 
-    template<typename T>
-    int visit_options(T* node) {
-        std::string lbl = std::string("Options") + "\nindex=" + std::to_string(node->index());
-        int id = emit_node(lbl);
-
-        const auto &v = node->child();
-        std::visit([&](auto ptr){
-            using ChildT = std::decay_t<decltype(ptr)>;
-            if (ptr != nullptr) {
-                int cid = visit(ptr);
-                if (cid >= 0) {
-                    out << "  node" << id << " -> node" << cid << "\n";
-                }
-            }
-        }, v);
+    void append(std::string_view s) {
+        if (buffer.size() + s.size() > BUFFER_SIZE) {
+            flush();
+        }
+        buffer.append(s);
+    }
 
-        return id;
+    template<typename Integer>
+    void append_number(Integer value) {
+        char digits[24];
+        auto res = std::to_chars(digits, digits + sizeof(digits), value);
+        append(std::string_view(digits, res.ptr - digits));
     }
 
-    template<typename T>
-    int visit_vector_node(T* node) {
-        // ClosureNode: children() -> vector<T*>
-        int id = emit_node("Closure");
-        const auto &vec = node->children();
-        for (const auto &child : vec) {
-            if (child) {
-                int cid = visit(child);
-                if (cid >= 0) out << "  node" << id << " -> node" << cid << "\n";
+    void append_escaped(std::string_view s) {
+        // Every character expands to at most two
+        if (buffer.size() + 2 * s.size() > BUFFER_SIZE) {
+            flush();
+        }
+        for (char c : s) {
+            switch (c) {
+                case '"': buffer += "\\\""; break;
+                case '\n': buffer += "\\n"; break;
+                case '\r': buffer += "\\r"; break;
+                case '\t': buffer += "\\t"; break;
+                case '<': buffer += "\\<"; break;
+                case '>': buffer += "\\>"; break;
+                case '|': buffer += "\\|"; break;
+                case '{': buffer += "\\{"; break;
+                case '}': buffer += "\\}"; break;
+                case '\\': buffer += "\\\\"; break;
+                default: buffer += c; break;
             }
         }
-        return id;
     }
 
-    template<typename T>
-    int visit_tuple_node(T* node) {
-        // ConnectionNode: children() -> tuple<...>
-        // Use concrete type name for better label if tuple parse fails to detect
-        int id = emit_node("Connection");
-        const auto &tpl = node->children();
-        visit_tuple_elements(id, tpl, std::make_index_sequence<std::tuple_size_v<std::remove_cv_t<std::remove_reference_t<decltype(tpl)>>>>{});
-        return id;
-    }
+    template<typename Node>
+    bool transparent(const Node *node, const Frame *parent) const {
+        constexpr NodeKind kind = node_kind_v<Node>;
 
-    template<typename Tuple, size_t... Is>
-    void visit_tuple_elements(int parent_id, const Tuple &tpl, std::index_sequence<Is...>) {
-        // Expand the parameter pack to visit each child in tuple
-        (visit_tuple_element< std::remove_pointer_t<std::tuple_element_t<Is, Tuple>> >(parent_id, std::get<Is>(tpl)), ...);
+        // Closures and options directly inside a connection are linked to the connection
+        if (parent != nullptr && parent->kind == NodeKind::CONNECTION
+            && (kind == NodeKind::CLOSURE || kind == NodeKind::OPTIONS)) {
+            return true;
+        }
+
+        if (! options.collapse_chains) {
+            return false;
+        }
+
+        if constexpr (kind == NodeKind::OPTIONS) {
+            return true;
+        } else if constexpr (kind == NodeKind::CONNECTION) {
+            return kept_children<structural_t<Node>>::value == 1;
+        } else if constexpr (kind == NodeKind::CLOSURE) {
+            return node->children().size() <= 1;
+        } else {
+            return false;
+        }
     }
 
-    // Handle a single tuple element. ElemT is the pointed-to node type (e.g., PrimaryExprNode, ClosureNode<...>, OptionsNode<...>)
-    template<typename ElemT>
-    void visit_tuple_element(int parent_id, ElemT* childptr) {
-        if (! childptr) return;
-
-        // If ElemT has children() and that children() is a vector -> it's a ClosureNode specialization
-        if constexpr (has_children_method<ElemT>::value) {
-            using ChildrenT = decltype(std::declval<const ElemT&>().children());
-            using PlainChildrenT = std::remove_cvref_t<ChildrenT>;
-            if constexpr (is_vector<PlainChildrenT>::value) {
-                // ClosureNode: link parent directly to each inner child's node
-                const auto &vec = childptr->children();
-                for (const auto &inner : vec) {
-                    if (inner) {
-                        int cid = visit(inner);
-                        if (cid >= 0) out << "  node" << parent_id << " -> node" << cid << "\n";
-                    }
-                }
-                return;
-            }
+    template<typename Node>
+    int emit_node(const Node *node) {
+        constexpr NodeKind kind = node_kind_v<Node>;
+
+        int id = next_id ++;
+        append("  node");
+        append_number(id);
+        append(" [label=\"");
+
+        // Named rules are labelled by their type name, computed once at compile time
+        if constexpr (is_named_rule_v<Node>) {
+            append_escaped(short_type_name_v<Node>);
+            append("\\n");
         }
 
-        // If ElemT has child()/index() (OptionsNode), link parent directly to the chosen option
-        if constexpr (has_child_method<ElemT>::value) {
-            const auto &v = childptr->child();
-            std::visit([&](auto ptr){
-                if (ptr) {
-                    int cid = visit(ptr);
-                    if (cid >= 0) out << "  node" << parent_id << " -> node" << cid << "\n";
-                }
-            }, v);
-            return;
+        if constexpr (kind == NodeKind::TERMINAL) {
+            const Token *tok = node->token();
+            append("Terminal\\n");
+            append_escaped(tok ? std::string_view(tok->content) : std::string_view("<null>"));
+        } else if constexpr (kind == NodeKind::OPTIONS) {
+            append("Options\\nindex=");
+            append_number(node->index());
+        } else if constexpr (kind == NodeKind::CLOSURE) {
+            append("Closure");
+        } else {
+            append("Connection");
         }
 
-        // Default: regular node, visit and link
-        int cid = visit(childptr);
-        if (cid >= 0) out << "  node" << parent_id << " -> node" << cid << "\n";
+        append("\"];\n");
+        return id;
+    }
+
+    void emit_edge(int from, int to) {
+        append("  node");
+        append_number(from);
+        append(" -> node");
+        append_number(to);
+        append("\n");
     }
 };
 
 } // namespace detail
 
+// Public helper to write an AST rooted at `root` (any node type) into `out`.
+template<typename Root>
+inline void generate_ast_dot(std::ostream &out, Root *root, DotOptions options = {}) {
+    detail::DotGen gen(out, options);
+    gen.visit(root);
+}
+
 // Public helper to write an AST rooted at `root` (any node type) into `path`.
 template<typename Root>
-inline void generate_ast_dot_to_file(const std::string &path, Root *root) {
-    std::ofstream ofs(path);
+inline void generate_ast_dot_to_file(const std::string &path, Root *root, DotOptions options = {}) {
+    std::ofstream ofs(path, std::ios::binary);
     if (! ofs) return;
-    detail::DotGen gen(ofs);
-    gen.visit(root);
+    generate_ast_dot(ofs, root, options);
 }
 
 } // namespace rain
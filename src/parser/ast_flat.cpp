@@ -0,0 +1,153 @@
+#include "parser/ast_flat.h"
+#include "util/hash.h"
+
+#include <cstdio>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace rain;
+
+static constexpr char __magic__[4] = {'R', 'A', 'S', 'T'};
+
+uint64_t rain::detail::hash_tokens(const std::vector<Token *> &tokens, size_t count) {
+    uint64_t hash = count;
+    for (size_t i = 0 ; i < count ; i ++) {
+        hash = hash_combine(hash, static_cast<uint64_t>(tokens[i]->type));
+        hash = hash_combine(hash, hash_bytes(tokens[i]->content.data(), tokens[i]->content.size()));
+    }
+    return hash;
+}
+
+bool rain::detail::write_flat_file(const std::string &path, const FlatWriter &writer, const std::vector<Token *> &tokens) {
+    FlatHeader header = {};
+    memcpy(header.magic, __magic__, sizeof(__magic__));
+    header.version = FlatAst::VERSION;
+    header.node_count = writer.nodes.size();
+    header.edge_count = writer.edges.size();
+    header.token_count = writer.token_count;
+    header.token_hash = hash_tokens(tokens, writer.token_count);
+
+    // 拼成一块后一次写出
+    std::string out;
+    out.reserve(sizeof(header) + writer.nodes.size() * sizeof(FlatNode) + writer.edges.size() * sizeof(int32_t));
+    out.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.append(reinterpret_cast<const char *>(writer.nodes.data()), writer.nodes.size() * sizeof(FlatNode));
+    out.append(reinterpret_cast<const char *>(writer.edges.data()), writer.edges.size() * sizeof(int32_t));
+
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (fp == nullptr) {
+        return false;
+    }
+    bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+    ok &= fclose(fp) == 0;
+    return ok;
+}
+
+FlatAst::~FlatAst() {
+#if defined(__unix__)
+    if (mapped) {
+        munmap(const_cast<char *>(data), size);
+        return;
+    }
+#endif
+    delete[] data;
+}
+
+std::unique_ptr<FlatAst> FlatAst::map_file(const std::string &path, const std::vector<Token *> &tokens) {
+    std::unique_ptr<FlatAst> ast(new FlatAst());
+    ast->tokens = &tokens;
+
+#if defined(__unix__)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::invalid_argument("flat AST file doesn't exist");
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        throw std::runtime_error("flat AST file is empty");
+    }
+
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        throw std::runtime_error("couldn't map flat AST file");
+    }
+
+    ast->data = static_cast<const char *>(map);
+    ast->size = st.st_size;
+    ast->mapped = true;
+#else
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == nullptr) {
+        throw std::invalid_argument("flat AST file doesn't exist");
+    }
+    fseek(fp, 0, SEEK_END);
+    ast->size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *buffer = new char[ast->size];
+    ast->data = buffer;
+    if (fread(buffer, 1, ast->size, fp) != ast->size) {
+        fclose(fp);
+        throw std::runtime_error("couldn't read flat AST file");
+    }
+    fclose(fp);
+#endif
+
+    ast->validate();
+    return ast;
+}
+
+// 检查所有下标都在范围内, 节点的结构由 load 按语法检查
+void FlatAst::validate() {
+    if (size < sizeof(FlatHeader)) {
+        throw std::runtime_error("flat AST file is truncated");
+    }
+
+    header = reinterpret_cast<const FlatHeader *>(data);
+    if (memcmp(header->magic, __magic__, sizeof(__magic__)) != 0 || header->version != VERSION) {
+        throw std::runtime_error("not a flat AST file of this version");
+    }
+
+    size_t expected = sizeof(FlatHeader)
+                      + static_cast<size_t>(header->node_count) * sizeof(FlatNode)
+                      + static_cast<size_t>(header->edge_count) * sizeof(int32_t);
+    if (header->node_count == 0 || expected != size) {
+        throw std::runtime_error("flat AST file has an inconsistent size");
+    }
+    if (header->token_count > tokens->size()) {
+        throw std::runtime_error("flat AST references more tokens than were given");
+    }
+    if (header->token_hash != detail::hash_tokens(*tokens, header->token_count)) {
+        throw std::runtime_error("flat AST was saved with a different token sequence");
+    }
+
+    nodes = reinterpret_cast<const FlatNode *>(data + sizeof(FlatHeader));
+    edges = reinterpret_cast<const int32_t *>(nodes + header->node_count);
+
+    for (uint32_t i = 0 ; i < header->node_count ; i ++) {
+        const FlatNode &n = nodes[i];
+        if (n.kind == NodeKind::TERMINAL) {
+            if (n.payload >= header->token_count) {
+                throw std::runtime_error("flat AST token index out of range");
+            }
+            continue;
+        }
+        if (n.kind > NodeKind::OPTIONS || static_cast<size_t>(n.payload) + n.count > header->edge_count) {
+            throw std::runtime_error("flat AST node is malformed");
+        }
+        for (uint32_t j = 0 ; j < n.count ; j ++) {
+            int64_t target = static_cast<int64_t>(i) + edges[n.payload + j];
+            // 前序排列, 子节点一定在父节点之后
+            if (edges[n.payload + j] != 0 && (target <= i || target >= header->node_count)) {
+                throw std::runtime_error("flat AST child index out of range");
+            }
+        }
+    }
+}
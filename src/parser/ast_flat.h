@@ -0,0 +1,377 @@
+#pragma once
+
+#include "parser/ast.h"
+#include "parser/ast_visitor.h"
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+
+namespace rain {
+    // 与位置无关的二进制 AST 格式
+    //
+    // 文件格式 (小端):
+    //   FlatHeader
+    //   FlatNode 节点表[node_count]       前序排列, 根节点下标为 0
+    //   int32_t  子节点表[edge_count]     子节点下标相对父节点下标的偏移, 0 表示空 (被丢弃的终结符)
+    //
+    // 终结符只保存其在 token 序列中的下标, 加载时需要提供同一份 token 序列
+    // 头部记录所引用 token 的哈希, 加载时提供的序列与保存时不同则拒绝加载
+    // 加载后直接在映射的内存上访问, 不需要修正任何指针
+
+    struct FlatHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t node_count;
+        uint32_t edge_count;
+        uint32_t token_count;
+        uint32_t reserved;
+        // 前 token_count 个 token 的类型与内容的哈希
+        uint64_t token_hash;
+    };
+
+    struct FlatNode {
+        NodeKind kind;
+        uint8_t reserved;
+        // OptionsNode 选中的候选
+        uint16_t option;
+        // 子节点数, 终结符为 0
+        uint32_t count;
+        // 终结符: token 下标; 其它: 在子节点表中的起始位置
+        uint32_t payload;
+    };
+
+    static_assert(sizeof(FlatNode) == 12);
+
+    namespace detail {
+        // 前序写出节点, 父节点先于子节点
+        class FlatWriter {
+        public:
+            std::vector<FlatNode> nodes;
+            std::vector<int32_t> edges;
+            std::unordered_map<const Token *, uint32_t> token_index;
+            uint32_t token_count = 0;
+
+            FlatWriter(const std::vector<Token *> &tokens) {
+                token_index.reserve(tokens.size());
+                for (uint32_t i = 0 ; i < tokens.size() ; i ++) {
+                    token_index.emplace(tokens[i], i);
+                }
+            }
+
+            template<TokenType T>
+            uint32_t write(const TerminalNode<T> *node) {
+                auto it = token_index.find(node->token());
+                if (it == token_index.end()) {
+                    throw std::invalid_argument("AST references a token outside of the token sequence");
+                }
+                token_count = std::max(token_count, it->second + 1);
+                return push(NodeKind::TERMINAL, 0, 0, it->second);
+            }
+
+            template<TokenType T>
+            uint32_t write(const DiscardTerminalNode<T> *node) {
+                return 0;
+            }
+
+            template<typename T>
+            uint32_t write(const ClosureNode<T> *node) {
+                const auto &children = node->children();
+                uint32_t self = begin(NodeKind::CLOSURE, 0, children.size());
+                uint32_t edge = nodes[self].payload;
+                for (size_t i = 0 ; i < children.size() ; i ++) {
+                    link(self, edge + i, children[i]);
+                }
+                return self;
+            }
+
+            template<typename... Nodes>
+            uint32_t write(const ConnectionNode<Nodes...> *node) {
+                uint32_t self = begin(NodeKind::CONNECTION, 0, sizeof...(Nodes));
+                uint32_t edge = nodes[self].payload;
+                std::apply([&](auto*... children) {
+                    uint32_t i = 0;
+                    (link(self, edge + i ++, children), ...);
+                }, node->children());
+                return self;
+            }
+
+            template<typename... Nodes>
+            uint32_t write(const OptionsNode<Nodes...> *node) {
+                uint32_t self = begin(NodeKind::OPTIONS, node->index(), 1);
+                uint32_t edge = nodes[self].payload;
+                std::visit([&](auto *child) {
+                    link(self, edge, child);
+                }, node->child());
+                return self;
+            }
+
+        private:
+            uint32_t push(NodeKind kind, uint16_t option, uint32_t count, uint32_t payload) {
+                nodes.push_back({kind, 0, option, count, payload});
+                return nodes.size() - 1;
+            }
+
+            // 创建节点并为其子节点预留位置
+            uint32_t begin(NodeKind kind, size_t option, size_t count) {
+                uint32_t self = push(kind, static_cast<uint16_t>(option), count, edges.size());
+                edges.resize(edges.size() + count, 0);
+                return self;
+            }
+
+            template<typename Child>
+            void link(uint32_t self, uint32_t edge, const Child *child) {
+                if (child == nullptr) {
+                    return;
+                }
+                uint32_t index = write(child);
+                if (index != 0) {
+                    edges[edge] = static_cast<int32_t>(index - self);
+                }
+            }
+        };
+
+        uint64_t hash_tokens(const std::vector<Token *> &tokens, size_t count);
+
+        bool write_flat_file(const std::string &path, const FlatWriter &writer, const std::vector<Token *> &tokens);
+    }
+
+    // 加载后的扁平 AST, 持有映射的内存
+    class FlatAst {
+    private:
+        const char *data = nullptr;
+        size_t size = 0;
+        bool mapped = false;
+        const FlatHeader *header = nullptr;
+        const FlatNode *nodes = nullptr;
+        const int32_t *edges = nullptr;
+        const std::vector<Token *> *tokens = nullptr;
+
+        FlatAst() = default;
+        static std::unique_ptr<FlatAst> map_file(const std::string &path, const std::vector<Token *> &tokens);
+        void validate();
+
+        [[noreturn]] static void mismatch() {
+            throw std::runtime_error("flat AST doesn't match the grammar");
+        }
+
+        // 按 Node 的结构检查 index 处的节点及其子树, 每个节点只能被引用一次
+        template<typename Node>
+        void check_shape(uint32_t index, std::vector<bool> &seen) const {
+            using Structural = detail::structural_t<Node>;
+            const FlatNode &n = nodes[index];
+            if (n.kind != detail::node_kind<Structural>::value || seen[index]) {
+                mismatch();
+            }
+            seen[index] = true;
+            check_children(static_cast<const Structural *>(nullptr), index, seen);
+        }
+
+        template<TokenType T>
+        void check_children(const TerminalNode<T> *, uint32_t index, std::vector<bool> &seen) const {
+            if (nodes[index].count != 0) {
+                mismatch();
+            }
+        }
+
+        template<typename T>
+        void check_children(const ClosureNode<T> *, uint32_t index, std::vector<bool> &seen) const {
+            for (uint32_t i = 0 ; i < nodes[index].count ; i ++) {
+                check_edge<T>(index, i, seen);
+            }
+        }
+
+        template<typename... Nodes>
+        void check_children(const ConnectionNode<Nodes...> *, uint32_t index, std::vector<bool> &seen) const {
+            if (nodes[index].count != sizeof...(Nodes)) {
+                mismatch();
+            }
+            uint32_t i = 0;
+            (check_edge<Nodes>(index, i ++, seen), ...);
+        }
+
+        template<typename... Nodes>
+        void check_children(const OptionsNode<Nodes...> *, uint32_t index, std::vector<bool> &seen) const {
+            const FlatNode &n = nodes[index];
+            if (n.count != 1 || n.option >= sizeof...(Nodes)) {
+                mismatch();
+            }
+            [&]<size_t... I>(std::index_sequence<I...>) {
+                ((n.option == I ? check_edge<Nodes>(index, 0, seen) : void()), ...);
+            }(std::index_sequence_for<Nodes...>());
+        }
+
+        // 只有被丢弃的终结符对应空的子节点
+        template<typename Child>
+        void check_edge(uint32_t index, uint32_t i, std::vector<bool> &seen) const {
+            uint32_t target = child(index, i);
+            if constexpr (detail::node_kind<detail::structural_t<Child>>::value == NodeKind::DISCARD) {
+                if (target != 0) {
+                    mismatch();
+                }
+            } else {
+                if (target == 0) {
+                    mismatch();
+                }
+                check_shape<Child>(target, seen);
+            }
+        }
+    public:
+        static constexpr uint32_t VERSION = 2;
+
+        FlatAst(const FlatAst &) = delete;
+        FlatAst &operator=(const FlatAst &) = delete;
+        ~FlatAst();
+
+        // tokens 必须是保存时使用的 token 序列, 且在 FlatAst 销毁前保持有效
+        // 除下标范围外还从根节点按 Root 的结构检查整棵树, 不符合时抛出 runtime_error, 之后 FlatView<Root> 的访问不再做检查
+        template<typename Root>
+        static std::unique_ptr<FlatAst> load(const std::string &path, const std::vector<Token *> &tokens) {
+            std::unique_ptr<FlatAst> ast = map_file(path, tokens);
+            std::vector<bool> seen(ast->node_count(), false);
+            ast->check_shape<Root>(0, seen);
+            if (std::find(seen.begin(), seen.end(), false) != seen.end()) {
+                throw std::runtime_error("flat AST has unreachable nodes");
+            }
+            return ast;
+        }
+
+        uint32_t node_count() const {
+            return header->node_count;
+        }
+
+        const FlatNode &node(uint32_t index) const {
+            return nodes[index];
+        }
+
+        // 第 i 个子节点的下标, 不存在时返回 0
+        uint32_t child(uint32_t index, uint32_t i) const {
+            int32_t rel = edges[nodes[index].payload + i];
+            return rel == 0 ? 0 : index + rel;
+        }
+
+        const Token *token(uint32_t index) const {
+            return (*tokens)[index];
+        }
+    };
+
+    // 只读视图, 结构与 ast.h 中的节点一一对应
+    template<typename T>
+    class FlatView : public FlatView<detail::structural_t<T>> {
+    public:
+        using FlatView<detail::structural_t<T>>::FlatView;
+    };
+
+    class FlatViewBase {
+    protected:
+        const FlatAst *_ast;
+        uint32_t _index;
+
+        const FlatNode &node() const {
+            return _ast->node(_index);
+        }
+    public:
+        FlatViewBase(const FlatAst *ast, uint32_t index)
+            : _ast(ast), _index(index)
+        {
+        }
+
+        uint32_t id() const {
+            return _index;
+        }
+    };
+
+    template<TokenType T>
+    class FlatView<TerminalNode<T>> : public FlatViewBase {
+    public:
+        using FlatViewBase::FlatViewBase;
+
+        uint32_t token_index() const {
+            assert(node().kind == NodeKind::TERMINAL);
+            return node().payload;
+        }
+
+        const Token *token() const {
+            return _ast->token(token_index());
+        }
+    };
+
+    template<typename T>
+    class FlatView<ClosureNode<T>> : public FlatViewBase {
+    public:
+        using FlatViewBase::FlatViewBase;
+
+        size_t size() const {
+            assert(node().kind == NodeKind::CLOSURE);
+            return node().count;
+        }
+
+        FlatView<T> operator[](size_t i) const {
+            return FlatView<T>(_ast, _ast->child(_index, i));
+        }
+
+        std::vector<FlatView<T>> children() const {
+            std::vector<FlatView<T>> views;
+            views.reserve(size());
+            for (size_t i = 0 ; i < size() ; i ++) {
+                views.push_back((*this)[i]);
+            }
+            return views;
+        }
+    };
+
+    template<typename... Nodes>
+    class FlatView<ConnectionNode<Nodes...>> : public FlatViewBase {
+    public:
+        using FlatViewBase::FlatViewBase;
+
+        template<size_t Index>
+        FlatView<std::tuple_element_t<Index, std::tuple<Nodes...>>> get() const {
+            assert(node().kind == NodeKind::CONNECTION);
+            return FlatView<std::tuple_element_t<Index, std::tuple<Nodes...>>>(_ast, _ast->child(_index, Index));
+        }
+    };
+
+    template<typename... Nodes>
+    class FlatView<OptionsNode<Nodes...>> : public FlatViewBase {
+    public:
+        using FlatViewBase::FlatViewBase;
+
+        size_t index() const {
+            assert(node().kind == NodeKind::OPTIONS);
+            return node().option;
+        }
+
+        template<size_t Index>
+        FlatView<std::tuple_element_t<Index, std::tuple<Nodes...>>> get() const {
+            assert(index() == Index);
+            return FlatView<std::tuple_element_t<Index, std::tuple<Nodes...>>>(_ast, _ast->child(_index, 0));
+        }
+
+        // 对选中的候选调用 fn
+        template<typename Fn>
+        decltype(auto) visit(Fn &&fn) const {
+            return visit_impl<0>(std::forward<Fn>(fn));
+        }
+
+    private:
+        template<size_t Index, typename Fn>
+        decltype(auto) visit_impl(Fn &&fn) const {
+            if constexpr (Index + 1 == sizeof...(Nodes)) {
+                return fn(get<Index>());
+            } else {
+                if (index() == Index) {
+                    return fn(get<Index>());
+                }
+                return visit_impl<Index + 1>(std::forward<Fn>(fn));
+            }
+        }
+    };
+
+    template<typename Root>
+    bool save_flat_ast(const std::string &path, const Root *root, const std::vector<Token *> &tokens) {
+        detail::FlatWriter writer(tokens);
+        writer.write(static_cast<const detail::structural_t<Root> *>(root));
+        return detail::write_flat_file(path, writer, tokens);
+    }
+}
@@ -0,0 +1,278 @@
+#pragma once
+
+#include "parser/ast.h"
+
+namespace rain {
+    // ast.h 中组合子的静态访问框架
+    //
+    // 访问者可以定义以下任意成员, 未定义的直接跳过:
+    //   pre(const Node *node, size_t depth)    进入节点, 返回 void 或 VisitAction
+    //   post(const Node *node, size_t depth)   离开节点, 返回 void 或 VisitAction
+    // Node 是节点的静态类型 (如 MulExprNode, ClosureNode<...>), 可以为某个规则单独重载
+    // 被丢弃的终结符 (DiscardTerminalNode) 不会被访问
+    //
+    // 所有分派都在编译期完成:
+    //   walk            递归遍历, 可全部内联
+    //   walk_iterative  使用显式栈遍历, 不受调用栈深度限制
+
+    enum class VisitAction {
+        CONTINUE,   // 继续访问子节点
+        SKIP,       // 跳过子节点, 不调用 post
+        STOP        // 终止整个遍历
+    };
+
+    enum class NodeKind : uint8_t {
+        TERMINAL   = 0,
+        CLOSURE    = 1,
+        CONNECTION = 2,
+        OPTIONS    = 3,
+        DISCARD    = 4
+    };
+
+    namespace detail {
+        template<typename T>
+        struct node_kind;
+        template<TokenType T>
+        struct node_kind<TerminalNode<T>> : std::integral_constant<NodeKind, NodeKind::TERMINAL> {};
+        template<TokenType T>
+        struct node_kind<DiscardTerminalNode<T>> : std::integral_constant<NodeKind, NodeKind::DISCARD> {};
+        template<typename T>
+        struct node_kind<ClosureNode<T>> : std::integral_constant<NodeKind, NodeKind::CLOSURE> {};
+        template<typename... Nodes>
+        struct node_kind<ConnectionNode<Nodes...>> : std::integral_constant<NodeKind, NodeKind::CONNECTION> {};
+        template<typename... Nodes>
+        struct node_kind<OptionsNode<Nodes...>> : std::integral_constant<NodeKind, NodeKind::OPTIONS> {};
+
+        template<typename Result>
+        constexpr VisitAction to_action(Result &&result) {
+            if constexpr (std::is_same_v<std::remove_cvref_t<Result>, VisitAction>) {
+                return result;
+            } else {
+                return result ? VisitAction::CONTINUE : VisitAction::SKIP;
+            }
+        }
+
+        template<typename Visitor, typename Node>
+        inline VisitAction call_pre(Visitor &visitor, const Node *node, size_t depth) {
+            if constexpr (requires { visitor.pre(node, depth); }) {
+                if constexpr (std::is_void_v<decltype(visitor.pre(node, depth))>) {
+                    visitor.pre(node, depth);
+                    return VisitAction::CONTINUE;
+                } else {
+                    return to_action(visitor.pre(node, depth));
+                }
+            }
+            return VisitAction::CONTINUE;
+        }
+
+        template<typename Visitor, typename Node>
+        inline VisitAction call_post(Visitor &visitor, const Node *node, size_t depth) {
+            if constexpr (requires { visitor.post(node, depth); }) {
+                if constexpr (std::is_void_v<decltype(visitor.post(node, depth))>) {
+                    visitor.post(node, depth);
+                } else if (to_action(visitor.post(node, depth)) == VisitAction::STOP) {
+                    return VisitAction::STOP;
+                }
+            }
+            return VisitAction::CONTINUE;
+        }
+
+        // 递归遍历
+        template<typename Visitor>
+        class RecursiveWalker {
+        public:
+            Visitor &visitor;
+
+            RecursiveWalker(Visitor &visitor)
+                : visitor(visitor)
+            {
+            }
+
+            // 返回 false 表示遍历被终止
+            template<typename Node>
+            bool walk(const Node *node, size_t depth) {
+                if constexpr (node_kind<structural_t<Node>>::value == NodeKind::DISCARD) {
+                    return true;
+                } else {
+                    if (node == nullptr) {
+                        return true;
+                    }
+
+                    VisitAction action = call_pre(visitor, node, depth);
+                    if (action != VisitAction::CONTINUE) {
+                        return action != VisitAction::STOP;
+                    }
+
+                    if (! children(static_cast<const structural_t<Node> *>(node), depth + 1)) {
+                        return false;
+                    }
+
+                    return call_post(visitor, node, depth) != VisitAction::STOP;
+                }
+            }
+
+        private:
+            template<TokenType T>
+            bool children(const TerminalNode<T> *node, size_t depth) {
+                return true;
+            }
+
+            template<typename T>
+            bool children(const ClosureNode<T> *node, size_t depth) {
+                for (const T *child : node->children()) {
+                    if (! walk(child, depth)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            template<typename... Nodes>
+            bool children(const ConnectionNode<Nodes...> *node, size_t depth) {
+                return std::apply([&](auto*... child) {
+                    return (walk(child, depth) && ...);
+                }, node->children());
+            }
+
+            template<typename... Nodes>
+            bool children(const OptionsNode<Nodes...> *node, size_t depth) {
+                return std::visit([&](auto *child) {
+                    return walk(child, depth);
+                }, node->child());
+            }
+        };
+
+        // 使用显式栈的遍历
+        // 栈中每一帧保存节点指针和该静态类型对应的处理函数
+        template<typename Visitor>
+        class IterativeWalker {
+        public:
+            Visitor &visitor;
+
+            IterativeWalker(Visitor &visitor)
+                : visitor(visitor)
+            {
+            }
+
+            template<typename Node>
+            bool run(const Node *root) {
+                stack.clear();
+                push(root, 0);
+
+                while (! stack.empty()) {
+                    Frame frame = stack.back();
+                    stack.pop_back();
+                    if (! frame.step(*this, frame)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+        private:
+            struct Frame {
+                const void *node;
+                size_t depth;
+                bool leaving;
+                bool (*step)(IterativeWalker &, const Frame &);
+            };
+
+            std::vector<Frame> stack;
+
+            template<typename Node>
+            static bool step(IterativeWalker &walker, const Frame &frame) {
+                const Node *node = static_cast<const Node *>(frame.node);
+
+                if (frame.leaving) {
+                    return call_post(walker.visitor, node, frame.depth) != VisitAction::STOP;
+                }
+
+                VisitAction action = call_pre(walker.visitor, node, frame.depth);
+                if (action != VisitAction::CONTINUE) {
+                    return action != VisitAction::STOP;
+                }
+
+                walker.stack.push_back({node, frame.depth, true, &step<Node>});
+                walker.push_children(static_cast<const structural_t<Node> *>(node), frame.depth + 1);
+                return true;
+            }
+
+            template<typename Node>
+            void push(const Node *node, size_t depth) {
+                if constexpr (node_kind<structural_t<Node>>::value != NodeKind::DISCARD) {
+                    if (node != nullptr) {
+                        stack.push_back({node, depth, false, &step<Node>});
+                    }
+                }
+            }
+
+            // 子节点逆序入栈, 使出栈顺序与递归遍历一致
+            template<TokenType T>
+            void push_children(const TerminalNode<T> *node, size_t depth) {
+            }
+
+            template<typename T>
+            void push_children(const ClosureNode<T> *node, size_t depth) {
+                const auto &children = node->children();
+                for (auto it = children.rbegin() ; it != children.rend() ; ++ it) {
+                    push(*it, depth);
+                }
+            }
+
+            template<typename... Nodes>
+            void push_children(const ConnectionNode<Nodes...> *node, size_t depth) {
+                push_reversed(node->children(), depth, std::index_sequence_for<Nodes...>{});
+            }
+
+            template<typename Tuple, size_t... Is>
+            void push_reversed(const Tuple &tpl, size_t depth, std::index_sequence<Is...>) {
+                constexpr size_t N = sizeof...(Is);
+                (push(std::get<N - 1 - Is>(tpl), depth), ...);
+            }
+
+            template<typename... Nodes>
+            void push_children(const OptionsNode<Nodes...> *node, size_t depth) {
+                std::visit([&](auto *child) {
+                    push(child, depth);
+                }, node->child());
+            }
+        };
+    }
+
+    namespace detail {
+        struct TreeDeleter {
+            template<typename Node>
+            void post(const Node *node, size_t depth) {
+                delete node;
+            }
+        };
+    }
+
+    template<typename Node>
+    inline constexpr NodeKind node_kind_v = detail::node_kind<detail::structural_t<Node>>::value;
+
+    // 是否为 syntax.h 中具名的规则, 而不是裸的组合子
+    template<typename Node>
+    inline constexpr bool is_named_rule_v = ! std::is_same_v<Node, detail::structural_t<Node>>;
+
+    // 递归遍历以 root 为根的子树, 返回 false 表示被访问者终止
+    template<typename Node, typename Visitor>
+    inline bool walk(const Node *root, Visitor &&visitor) {
+        detail::RecursiveWalker<std::remove_reference_t<Visitor>> walker(visitor);
+        return walker.walk(root, 0);
+    }
+
+    // 与 walk 的访问顺序相同, 但使用堆上的显式栈
+    template<typename Node, typename Visitor>
+    inline bool walk_iterative(const Node *root, Visitor &&visitor) {
+        detail::IterativeWalker<std::remove_reference_t<Visitor>> walker(visitor);
+        return walker.run(root);
+    }
+
+    // 释放以 root 为根的整棵树, 子节点先于父节点释放
+    template<typename Node>
+    inline void destroy_tree(Node *root) {
+        detail::TreeDeleter deleter;
+        walk_iterative(static_cast<const Node *>(root), deleter);
+    }
+}
@@ -0,0 +1,102 @@
+#include "parser/parse_profile.h"
+
+#ifdef RAIN_PARSE_PROFILE
+
+#include <algorithm>
+#include <format>
+#include <mutex>
+
+using namespace rain;
+
+// 规则编号在所有线程间共享, 计数在各线程内独立
+static std::mutex __rule_mutex__;
+static std::vector<std::string_view> __rule_names__;
+
+size_t CountingParsePolicy::register_rule(std::string_view name) {
+    std::lock_guard lock(__rule_mutex__);
+    __rule_names__.push_back(name);
+    return __rule_names__.size() - 1;
+}
+
+std::vector<RuleProfile> &CountingParsePolicy::profiles() {
+    static thread_local std::vector<RuleProfile> profiles;
+    return profiles;
+}
+
+std::vector<CountingParsePolicy::Frame> &CountingParsePolicy::frames() {
+    static thread_local std::vector<Frame> frames;
+    return frames;
+}
+
+void CountingParsePolicy::enter(size_t id) {
+    std::vector<RuleProfile> &all = profiles();
+    if (id >= all.size()) {
+        all.resize(id + 1);
+    }
+    all[id].attempts ++;
+    frames().push_back({id, 0});
+}
+
+void CountingParsePolicy::leave(uint64_t cycles) {
+    std::vector<Frame> &stack = frames();
+    Frame frame = stack.back();
+    stack.pop_back();
+
+    // 子规则的周期计入父规则的 child_cycles, 使每条规则只统计自身的开销
+    profiles()[frame.id].cycles += cycles - std::min(cycles, frame.child_cycles);
+    if (! stack.empty()) {
+        stack.back().child_cycles += cycles;
+    }
+}
+
+std::vector<RuleProfile> CountingParsePolicy::report() {
+    std::vector<RuleProfile> result;
+    {
+        std::lock_guard lock(__rule_mutex__);
+        for (size_t id = 0 ; id < profiles().size() ; id ++) {
+            if (profiles()[id].attempts == 0) {
+                continue;
+            }
+            result.push_back(profiles()[id]);
+            result.back().name = __rule_names__[id];
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const RuleProfile &a, const RuleProfile &b) {
+        return a.cycles > b.cycles;
+    });
+    return result;
+}
+
+// 去掉类型名中的 rain:: 前缀, 组合子嵌套时名字会很长
+static std::string __short_name__(std::string_view name) {
+    std::string out;
+    constexpr std::string_view prefix = "rain::";
+    for (size_t i = 0 ; i < name.size() ; ) {
+        if (name.substr(i, prefix.size()) == prefix) {
+            i += prefix.size();
+        } else {
+            out += name[i ++];
+        }
+    }
+    return out;
+}
+
+std::string CountingParsePolicy::dump_text() {
+    std::vector<RuleProfile> rules = report();
+    uint64_t total = 0;
+    for (const RuleProfile &rule : rules) {
+        total += rule.cycles;
+    }
+
+    std::string out = std::format("{:>14} {:>6} {:>10} {:>10} {:>10} {:>10} {:>10}  rule\n",
+                                  "cycles", "%", "attempts", "successes", "backtracks", "tokens", "nodes");
+    for (const RuleProfile &rule : rules) {
+        out += std::format("{:>14} {:>6.2f} {:>10} {:>10} {:>10} {:>10} {:>10}  {}\n",
+                           rule.cycles, total == 0 ? 0.0 : 100.0 * rule.cycles / total,
+                           rule.attempts, rule.successes, rule.backtracks, rule.tokens, rule.nodes,
+                           __short_name__(rule.name));
+    }
+    return out;
+}
+
+#endif
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "parser/token_stream.h"
+#include "util/type_name.h"
+
+// 按规则统计 parse 的开销
+// ast.h 中的组合子通过 parse_rule<Rule> 解析子规则, 并在回溯与分配节点时通知 ParsePolicy
+// 定义 RAIN_PARSE_PROFILE 时 ParsePolicy 为 CountingParsePolicy, 否则为 NullParsePolicy, 所有调用内联为空
+
+#ifdef RAIN_PARSE_PROFILE
+#include <chrono>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace rain {
+    // 不做任何统计
+    struct NullParsePolicy {
+        template<typename Rule>
+        struct Scope {
+            Scope(TokenIter begin) {}
+            void success(TokenIter end) {}
+        };
+
+        static void backtrack() {}
+        static void allocated() {}
+    };
+
+#ifdef RAIN_PARSE_PROFILE
+    struct RuleProfile {
+        std::string_view name;
+        size_t attempts = 0;
+        size_t successes = 0;
+        size_t backtracks = 0;  // 失败的候选 (OptionsNode) 或失败的重复项 (ClosureNode)
+        size_t tokens = 0;      // 成功时消耗的 token 数
+        size_t nodes = 0;       // 本规则直接分配的节点, 包括之后因回溯释放的
+        uint64_t cycles = 0;    // 不含子规则的周期数
+    };
+
+    // 统计当前线程的 parse
+    class CountingParsePolicy {
+    public:
+        template<typename Rule>
+        class Scope {
+        private:
+            size_t id;
+            uint64_t begin_cycles;
+            TokenIter begin;
+        public:
+            Scope(TokenIter begin)
+                : id(rule_id<Rule>()), begin_cycles(now()), begin(begin)
+            {
+                enter(id);
+            }
+
+            ~Scope() {
+                leave(now() - begin_cycles);
+            }
+
+            void success(TokenIter end) {
+                RuleProfile &profile = profiles()[id];
+                profile.successes ++;
+                profile.tokens += end - begin;
+            }
+        };
+
+        static void backtrack() {
+            if (! frames().empty()) {
+                profiles()[frames().back().id].backtracks ++;
+            }
+        }
+
+        static void allocated() {
+            if (! frames().empty()) {
+                profiles()[frames().back().id].nodes ++;
+            }
+        }
+
+        // 当前线程中所有被尝试过的规则, 按周期数降序
+        static std::vector<RuleProfile> report();
+        static std::string dump_text();
+
+    private:
+        struct Frame {
+            size_t id;
+            uint64_t child_cycles;
+        };
+
+        // 均为当前线程的数据
+        static std::vector<RuleProfile> &profiles();
+        static std::vector<Frame> &frames();
+
+        static size_t register_rule(std::string_view name);
+
+        template<typename Rule>
+        static size_t rule_id() {
+            static const size_t id = register_rule(type_name_v<Rule>);
+            return id;
+        }
+
+        static void enter(size_t id);
+        static void leave(uint64_t cycles);
+
+        static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+        }
+    };
+
+    using ParsePolicy = CountingParsePolicy;
+#else
+    using ParsePolicy = NullParsePolicy;
+#endif
+
+    // 解析一个子规则, 由 Policy 记录这次尝试
+    template<typename Rule, typename Policy = ParsePolicy>
+    inline auto parse_rule(TokenIter begin, TokenIter end) {
+        typename Policy::template Scope<Rule> scope(begin);
+        auto result = Rule::parse(begin, end);
+        if (result.success) {
+            scope.success(result.end);
+        }
+        return result;
+    }
+}
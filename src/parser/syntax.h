@@ -1,3 +1,5 @@
+#pragma once
+
 #include "parser/ast.h"
 
 namespace rain {
@@ -98,6 +100,21 @@ namespace rain {
 
             return primExprs;
         }
+
+        std::vector<TokenType> get_operators() const {
+            std::vector<TokenType> operators;
+
+            for (const auto &conn_node : std::get<1>(this->children())->children()) {
+                operators.push_back(std::visit(
+                        [](auto &&terminal) {
+                          return terminal->token()->type;
+                        },
+                        std::get<0>(conn_node->children())->child()
+                    ));
+            }
+
+            return operators;
+        }
     };
 
     class AddExprNode : public ConnectionNode<
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "parser/syntax.h"
+#include "parser/ast_flat.h"
+
+namespace rain {
+    // syntax.h 中各节点在扁平 AST 上的只读视图
+
+    template<>
+    class FlatView<MulExprNode> : public FlatView<detail::structural_t<MulExprNode>> {
+    public:
+        using FlatView<detail::structural_t<MulExprNode>>::FlatView;
+
+        std::vector<FlatView<PrimaryExprNode>> get_primary_exprs() const {
+            std::vector<FlatView<PrimaryExprNode>> primExprs;
+
+            primExprs.push_back(this->get<0>());
+            for (const auto &conn_node : this->get<1>().children()) {
+                primExprs.push_back(conn_node.template get<1>());
+            }
+
+            return primExprs;
+        }
+
+        std::vector<TokenType> get_operators() const {
+            std::vector<TokenType> operators;
+
+            for (const auto &conn_node : this->get<1>().children()) {
+                operators.push_back(conn_node.template get<0>().visit(
+                    [](auto terminal) {
+                        return terminal.token()->type;
+                    }));
+            }
+
+            return operators;
+        }
+    };
+
+    template<>
+    class FlatView<AddExprNode> : public FlatView<detail::structural_t<AddExprNode>> {
+    public:
+        using FlatView<detail::structural_t<AddExprNode>>::FlatView;
+
+        std::vector<TokenType> get_operators() const {
+            std::vector<TokenType> operators;
+
+            for (const auto &conn_node : this->get<1>().children()) {
+                operators.push_back(conn_node.template get<0>().visit(
+                    [](auto terminal) {
+                        return terminal.token()->type;
+                    }));
+            }
+
+            return operators;
+        }
+
+        std::vector<FlatView<MulExprNode>> get_terms() const {
+            std::vector<FlatView<MulExprNode>> mulExprs;
+
+            mulExprs.push_back(this->get<0>());
+            for (const auto &conn_node : this->get<1>().children()) {
+                mulExprs.push_back(conn_node.template get<1>());
+            }
+
+            return mulExprs;
+        }
+    };
+
+    template<>
+    class FlatView<ExprNode> : public FlatView<AddExprNode> {
+    public:
+        using FlatView<AddExprNode>::FlatView;
+    };
+}
@@ -0,0 +1,239 @@
+#pragma once
+
+#include "lexer/lexer.h"
+
+#include <deque>
+
+namespace rain {
+    class TokenStream;
+
+    // 语法分析使用的 token 位置
+    // 只保存所属的 TokenStream 与下标, 解引用时才按需向 lexer 取 token
+    class TokenIter {
+    public:
+        TokenIter()
+            : stream(nullptr), index(0)
+        {
+        }
+
+        TokenIter(TokenStream *stream, size_t index)
+            : stream(stream), index(index)
+        {
+        }
+
+        Token *operator*() const;
+
+        TokenIter operator+(ptrdiff_t n) const {
+            return TokenIter(stream, index + n);
+        }
+
+        TokenIter &operator++() {
+            index ++;
+            return *this;
+        }
+
+        ptrdiff_t operator-(const TokenIter &rhs) const {
+            return static_cast<ptrdiff_t>(index) - static_cast<ptrdiff_t>(rhs.index);
+        }
+
+        bool operator==(const TokenIter &rhs) const {
+            return index == rhs.index;
+        }
+
+        size_t position() const {
+            return index;
+        }
+
+        TokenStream *source() const {
+            return stream;
+        }
+
+    private:
+        TokenStream *stream;
+        size_t index;
+    };
+
+    // 拉取式的 token 源
+    //
+    // 以 lexer 构造时, 解引用到尚未分析的位置才调用 Lexer::pull, 词法与语法分析交替进行
+    // 拉取到的 token 及其 PosInfo 从 pool 中取出, 归窗口所有
+    // 组合子在可能回溯的位置上建立 Checkpoint, 最早的 Checkpoint 之前的 token 从窗口中移除并释放,
+    // 只有终结符通过 retain 保留的 token 交还给 Token::pool, 与语法树一同存活
+    // 因此被丢弃的标点与不建语法树时的 token 只在回溯范围内存活
+    //
+    // 以 token 序列构造时直接读取该序列, 与原先基于 vector 迭代器的行为相同, token 仍归序列的所有者
+    class TokenStream {
+    public:
+        // Checkpoint 按后进先出的顺序建立与销毁, 与递归下降的调用顺序一致
+        class Checkpoint {
+        public:
+            Checkpoint(TokenStream *stream, size_t index)
+                : stream(stream), slot(stream->marks.size())
+            {
+                stream->marks.push_back(index);
+            }
+
+            ~Checkpoint() {
+                stream->marks.pop_back();
+            }
+
+            Checkpoint(const Checkpoint &) = delete;
+            Checkpoint &operator=(const Checkpoint &) = delete;
+
+            // 之前的位置不会再回溯, 将检查点前移到 it
+            void move(TokenIter it) {
+                stream->marks[slot] = it.position();
+                if (slot == 0) {
+                    stream->release(it.position());
+                }
+            }
+
+        private:
+            TokenStream *stream;
+            size_t slot;
+        };
+
+        explicit TokenStream(Lexer &lexer)
+            : lexer(&lexer), tokens(nullptr)
+        {
+        }
+
+        explicit TokenStream(const std::vector<Token *> &tokens)
+            : lexer(nullptr), tokens(&tokens)
+        {
+        }
+
+        TokenStream(const TokenStream &) = delete;
+        TokenStream &operator=(const TokenStream &) = delete;
+
+        ~TokenStream() {
+            for (const Entry &entry : window) {
+                discard(entry);
+            }
+        }
+
+        TokenIter begin() {
+            return TokenIter(this, 0);
+        }
+
+        // 拉取模式下没有已知的结尾, 读到 ENDMARK 之后一直返回 ENDMARK
+        TokenIter end() {
+            return TokenIter(this, tokens != nullptr ? tokens->size() : SIZE_MAX);
+        }
+
+        Token *at(size_t index) {
+            if (tokens != nullptr && index < tokens->size()) {
+                return (*tokens)[index];
+            }
+            if (index - base < window.size()) {
+                return window[index - base].token;
+            }
+            return fill(index);
+        }
+
+        // index 处的 token 被终结符引用, 连同 PosInfo 交还给 pool, 移出窗口时不再释放
+        // 只能在解引用 index 之后调用
+        void retain(size_t index) {
+            if (tokens != nullptr) {
+                return;
+            }
+            // 越过 ENDMARK 的位置都对应窗口末尾的 ENDMARK
+            Entry &entry = window[std::min(index - base, window.size() - 1)];
+            if (! entry.retained) {
+                entry.retained = true;
+                Token::pool.mark(entry.token);
+                if (entry.token->pos != nullptr) {
+                    PosInfo::pool.mark(entry.token->pos);
+                }
+            }
+        }
+
+        Checkpoint checkpoint(TokenIter it) {
+            return Checkpoint(this, it.position());
+        }
+
+        // 窗口中同时保留的 token 数的峰值
+        [[nodiscard]] size_t peak_window() const {
+            return peak;
+        }
+
+        // 拉取模式下是否已经从 lexer 读到了 ENDMARK, 此后 lexer 不应再分析
+        [[nodiscard]] bool pulled_endmark() const {
+            return endmark != nullptr;
+        }
+
+    private:
+        Lexer *lexer;
+        const std::vector<Token *> *tokens;
+
+        struct Entry {
+            Token *token;
+            // 已交还给 pool
+            bool retained;
+        };
+
+        std::deque<Entry> window;
+        // window[0] 的下标
+        size_t base = 0;
+        Token *endmark = nullptr;
+        size_t peak = 0;
+
+        // 各个检查点的位置, 从外到内不减
+        std::vector<size_t> marks;
+
+        Token *fill(size_t index);
+
+        static void discard(const Entry &entry) {
+            if (! entry.retained) {
+                delete entry.token->pos;
+                delete entry.token;
+            }
+        }
+
+        // 释放 upto 之前的 token, 成批进行以摊销 deque 的开销
+        void release(size_t upto) {
+            static constexpr size_t BATCH = 64;
+            if (upto < base + BATCH) {
+                return;
+            }
+            // 至少保留一个 token, 使读到 ENDMARK 之后仍能返回它
+            while (base < upto && window.size() > 1) {
+                discard(window.front());
+                window.pop_front();
+                base ++;
+            }
+        }
+    };
+
+    inline Token *TokenIter::operator*() const {
+        return stream->at(index);
+    }
+
+    inline Token *TokenStream::fill(size_t index) {
+        if (index < base) {
+            throw std::out_of_range("Token was released before the oldest checkpoint");
+        }
+
+        if (tokens != nullptr) {
+            // 与 ENDMARK 的行为一致, 越过结尾时返回最后一个 token
+            return tokens->empty() ? nullptr : tokens->back();
+        }
+
+        while (base + window.size() <= index) {
+            if (endmark != nullptr) {
+                return endmark;
+            }
+            Token *tok = lexer->pull();
+            Token::pool.unmark(tok);
+            if (tok->pos != nullptr) {
+                PosInfo::pool.unmark(tok->pos);
+            }
+            window.push_back({tok, false});
+            if (tok->type & TokenType::ENDMARK) {
+                endmark = tok;
+            }
+        }
+        peak = std::max(peak, window.size());
+        return window[index - base].token;
+    }
+}
@@ -0,0 +1,281 @@
+#include "pass/const_fold.h"
+#include "parser/ast_visitor.h"
+
+#include <optional>
+#include <unordered_map>
+
+using namespace rain;
+
+template<typename Chain>
+using __tail_of__ = std::remove_pointer_t<std::tuple_element_t<1, std::remove_cvref_t<decltype(std::declval<Chain &>().children())>>>;
+
+using __literal_variant__ = std::remove_cvref_t<decltype(std::declval<LiteralNode &>().child())>;
+using __primary_variant__ = std::remove_cvref_t<decltype(std::declval<PrimaryExprNode &>().child())>;
+
+// 统计子树中的节点个数
+struct __node_counter__ {
+    size_t count = 0;
+
+    template<typename Node>
+    void pre(const Node *node, size_t depth) {
+        count ++;
+    }
+};
+
+template<typename Node>
+static size_t __count_nodes__(const Node *node) {
+    __node_counter__ counter;
+    walk_iterative(node, counter);
+    return counter.count;
+}
+
+// 子树中的第一个 token, 作为新字面量的位置
+struct __first_token__ {
+    const Token *token = nullptr;
+
+    template<typename Node>
+    VisitAction pre(const Node *node, size_t depth) {
+        if constexpr (node_kind_v<Node> == NodeKind::TERMINAL) {
+            token = node->token();
+            return VisitAction::STOP;
+        }
+        return VisitAction::CONTINUE;
+    }
+};
+
+template<typename Node>
+static const Token *__origin_of__(const Node *node) {
+    __first_token__ first;
+    walk(node, first);
+    return first.token;
+}
+
+// ('+' | '-') 或 ('*' | '/' | '%') 的 token
+template<typename Step>
+static const Token *__operator_of__(const Step *step) {
+    return std::visit([](auto *terminal) {
+        return terminal->token();
+    }, std::get<0>(step->children())->child());
+}
+
+static bool __is_literal__(const PrimaryExprNode *node) {
+    return node->index() == 0;
+}
+
+static bool __is_literal__(const MulExprNode *node) {
+    return std::get<1>(node->children())->children().empty() && __is_literal__(std::get<0>(node->children()));
+}
+
+static bool __is_literal__(const ExprNode *node) {
+    return std::get<1>(node->children())->children().empty() && __is_literal__(std::get<0>(node->children()));
+}
+
+// 构造只含一个字面量的节点, 值无法写成字面量时返回 nullptr
+static PrimaryExprNode *__literal_primary__(Value value, const Token *origin, std::vector<Token *> &created) {
+    std::string text;
+    TokenType type;
+    if (! literal_text(value, text, type)) {
+        return nullptr;
+    }
+
+    Token *tok = new Token(type, text, origin->pos, origin->offset);
+    created.push_back(tok);
+    __literal_variant__ literal;
+    size_t index;
+    if (type == TokenType::FLOAT) {
+        literal.emplace<4>(new TerminalNode<TokenType::FLOAT>(tok));
+        index = 4;
+    } else {
+        literal.emplace<0>(new TerminalNode<TokenType::DEC_INTEGER>(tok));
+        index = 0;
+    }
+
+    __primary_variant__ primary;
+    primary.emplace<0>(new LiteralNode(std::move(literal), index));
+    return new PrimaryExprNode(std::move(primary), 0);
+}
+
+template<typename Node>
+static Node *__literal_node__(Value value, const Token *origin, std::vector<Token *> &created) {
+    PrimaryExprNode *primary = __literal_primary__(value, origin, created);
+    if constexpr (std::is_same_v<Node, PrimaryExprNode>) {
+        return primary;
+    } else {
+        if (primary == nullptr) {
+            return nullptr;
+        }
+        MulExprNode *mul = new MulExprNode(std::make_tuple(primary, new __tail_of__<MulExprNode>({})));
+        if constexpr (std::is_same_v<Node, MulExprNode>) {
+            return mul;
+        } else {
+            return new ExprNode(std::make_tuple(mul, new __tail_of__<ExprNode>({})));
+        }
+    }
+}
+
+// 先自底向上求出所有常量子树的值, 再自顶向下把能写成字面量的最大子树替换掉
+struct __const_folder__ {
+    FoldStats stats;
+    std::unordered_map<const void *, Value> values;
+
+    std::optional<Value> evaluate(const PrimaryExprNode *node) {
+        std::optional<Value> result;
+
+        switch (node->index()) {
+        case 0: {
+            const Token *tok = std::visit([](auto *terminal) {
+                return terminal->token();
+            }, std::get<0>(node->child())->child());
+
+            Value value;
+            EvalStatus status = parse_literal(tok, value);
+            if (status == EvalStatus::OK) {
+                result = value;
+            }
+            // 字符串字面量不参与折叠, 不算错误
+            else if (status != EvalStatus::UNSUPPORTED) {
+                stats.diagnostics.push_back({status, tok});
+            }
+            break;
+        }
+        case 2:
+            result = evaluate_chain(std::get<1>(std::get<2>(node->child())->children()));
+            break;
+        default:
+            break;
+        }
+
+        if (result) {
+            values.emplace(node, *result);
+        }
+        return result;
+    }
+
+    std::optional<Value> evaluate(const MulExprNode *node) {
+        return evaluate_chain(node);
+    }
+
+    // head (op operand)* 形式的链, 即 MulExprNode 与 AddExprNode
+    template<typename Chain>
+    std::optional<Value> evaluate_chain(const Chain *node) {
+        const auto &[head, tail] = node->children();
+
+        std::optional<Value> acc = evaluate(head);
+        for (const auto *step : tail->children()) {
+            // 即使左侧已不是常量, 右侧的子树也要求值
+            std::optional<Value> rhs = evaluate(std::get<1>(step->children()));
+            if (! acc || ! rhs) {
+                acc.reset();
+                continue;
+            }
+
+            Value out;
+            EvalStatus status = apply_binary(__operator_of__(step)->type, *acc, *rhs, out);
+            if (status != EvalStatus::OK) {
+                stats.diagnostics.push_back({status, __operator_of__(step)});
+                acc.reset();
+                continue;
+            }
+            acc = out;
+        }
+
+        if (acc) {
+            values.emplace(node, *acc);
+        }
+        return acc;
+    }
+
+    // 若 slot 是常量且能写成字面量则替换之, 返回 slot 是否已是字面量
+    template<typename Node>
+    bool replace(Node *&slot) {
+        if (__is_literal__(slot)) {
+            return true;
+        }
+
+        auto it = values.find(slot);
+        if (it == values.end()) {
+            return false;
+        }
+
+        Node *folded = __literal_node__<Node>(it->second, __origin_of__(slot), stats.created);
+        if (folded == nullptr) {
+            return false;
+        }
+
+        values.erase(it);
+        stats.folded ++;
+        stats.eliminated += __count_nodes__(slot) - __count_nodes__(folded);
+        destroy_tree(slot);
+        slot = folded;
+        return true;
+    }
+
+    void rewrite_operand(PrimaryExprNode *&slot) {
+        if (! replace(slot) && slot->index() == 2) {
+            rewrite(std::get<1>(std::get<2>(slot->child())->children()));
+        }
+    }
+
+    void rewrite_operand(MulExprNode *&slot) {
+        if (! replace(slot)) {
+            rewrite_chain(slot);
+        }
+    }
+
+    void rewrite(ExprNode *&slot) {
+        if (! replace(slot)) {
+            rewrite_chain(slot);
+        }
+    }
+
+    template<typename Chain>
+    void rewrite_chain(Chain *node) {
+        auto &[head, tail] = node->children();
+        auto &steps = tail->children();
+        using Head = std::remove_pointer_t<std::remove_reference_t<decltype(head)>>;
+
+        // 合并从左起连续的常量操作数
+        size_t merged = 0;
+        auto it = values.find(head);
+        if (it != values.end()) {
+            Value acc = it->second;
+            for ( ; merged < steps.size() ; merged ++) {
+                auto rhs = values.find(std::get<1>(steps[merged]->children()));
+                Value out;
+                if (rhs == values.end() || apply_binary(__operator_of__(steps[merged])->type, acc, rhs->second, out) != EvalStatus::OK) {
+                    break;
+                }
+                acc = out;
+            }
+
+            Head *folded = merged > 0 ? __literal_node__<Head>(acc, __origin_of__(head), stats.created) : nullptr;
+            if (folded != nullptr) {
+                size_t removed = __count_nodes__(head);
+                values.erase(head);
+                destroy_tree(head);
+                for (size_t i = 0 ; i < merged ; i ++) {
+                    removed += __count_nodes__(steps[i]);
+                    values.erase(std::get<1>(steps[i]->children()));
+                    destroy_tree(steps[i]);
+                }
+                steps.erase(steps.begin(), steps.begin() + merged);
+                head = folded;
+
+                stats.folded ++;
+                stats.eliminated += removed - __count_nodes__(folded);
+            }
+        }
+
+        rewrite_operand(head);
+        for (auto *step : steps) {
+            rewrite_operand(std::get<1>(step->children()));
+        }
+    }
+};
+
+FoldStats rain::fold_constants(ExprNode *&root) {
+    __const_folder__ folder;
+    folder.evaluate_chain(root);
+    folder.rewrite(root);
+    return std::move(folder.stats);
+}
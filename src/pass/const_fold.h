@@ -0,0 +1,29 @@
+#pragma once
+
+#include "parser/syntax.h"
+#include "eval/value.h"
+
+namespace rain {
+    // 常量折叠中无法折叠的运算
+    struct FoldDiagnostic {
+        EvalStatus status;
+        // 出错的运算符或字面量
+        const Token *at;
+    };
+
+    struct FoldStats {
+        // 被替换为单个字面量的子树个数
+        size_t folded = 0;
+        // 因此减少的节点个数
+        size_t eliminated = 0;
+        std::vector<FoldDiagnostic> diagnostics;
+        // 为折叠结果新建的字面量 token, 不在 lexer 的 token 序列中, 由 Token::pool 释放
+        // 保存扁平 AST 时需要把它们接在 token 序列之后
+        std::vector<Token *> created;
+    };
+
+    // 将 root 中的常量子树替换为单个字面量, root 本身也可能被替换
+    // 只折叠从左起连续的常量操作数, 以保持左结合的求值顺序
+    // 结果为负数或非有限浮点数时无法写成字面量, 保持原样
+    FoldStats fold_constants(ExprNode *&root);
+}
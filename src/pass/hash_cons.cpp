@@ -0,0 +1,110 @@
+#include "pass/hash_cons.h"
+#include "util/hash.h"
+
+#include <functional>
+
+using namespace rain;
+
+// 每种组合子一个地址, 作为 Shape::tag
+template<typename Node>
+static const char __tag__ = 0;
+
+template<typename Node>
+static void __delete_node__(void *node) {
+    delete static_cast<Node *>(node);
+}
+
+struct HashConsTable::Interner {
+    HashConsTable &table;
+
+    // 换成已驻留的子节点, 并把它加入 shape
+    template<typename Child>
+    void adopt(Child *&child, Shape &shape) {
+        if (child == nullptr) {
+            // 被丢弃的终结符
+            shape.children.push_back(nullptr);
+            shape.hash = hash_combine(shape.hash, 0);
+            return;
+        }
+        using Structural = detail::structural_t<Child>;
+        const void *canonical = table.replaced.at(static_cast<const void *>(static_cast<Structural *>(child)));
+        child = static_cast<Child *>(static_cast<Structural *>(const_cast<void *>(canonical)));
+        shape.children.push_back(canonical);
+        shape.hash = hash_combine(shape.hash, table.hashes.at(canonical));
+    }
+
+    // 子节点先于父节点离开, 因此 post 时所有子节点都已驻留
+    template<typename Node>
+    void post(const Node *node, size_t depth) {
+        using Structural = detail::structural_t<Node>;
+        Structural *self = const_cast<Structural *>(static_cast<const Structural *>(node));
+
+        Shape shape;
+        shape.tag = &__tag__<Structural>;
+        shape.hash = hash_mix(reinterpret_cast<uintptr_t>(shape.tag));
+
+        if constexpr (node_kind_v<Structural> == NodeKind::TERMINAL) {
+            shape.type = self->token()->type;
+            shape.text = self->token()->content;
+            shape.hash = hash_combine(shape.hash, static_cast<uint64_t>(shape.type));
+            shape.hash = hash_combine(shape.hash, hash_bytes(shape.text.data(), shape.text.size()));
+        }
+        else if constexpr (node_kind_v<Structural> == NodeKind::CLOSURE) {
+            for (auto *&child : self->children()) {
+                adopt(child, shape);
+            }
+        }
+        else if constexpr (node_kind_v<Structural> == NodeKind::CONNECTION) {
+            std::apply([&](auto *&... children) {
+                (adopt(children, shape), ...);
+            }, self->children());
+        }
+        else if constexpr (node_kind_v<Structural> == NodeKind::OPTIONS) {
+            shape.index = self->index();
+            shape.hash = hash_combine(shape.hash, shape.index);
+            std::visit([&](auto *&child) {
+                adopt(child, shape);
+            }, self->child());
+        }
+
+        const void *canonical = table.canonical(std::move(shape), self, sizeof(Structural), __delete_node__<Structural>);
+        table.replaced[self] = canonical;
+    }
+};
+
+HashConsTable::~HashConsTable() {
+    for (auto &[node, deleter] : owned) {
+        deleter(node);
+    }
+}
+
+const void *HashConsTable::canonical(Shape &&shape, void *node, size_t size, void (*deleter)(void *)) {
+    uint64_t hash = shape.hash;
+    auto [it, inserted] = shapes.emplace(std::move(shape), node);
+    if (inserted) {
+        hashes.emplace(node, hash);
+        owned.emplace_back(node, deleter);
+        bytes += size;
+    }
+    else if (it->second != node) {
+        // 遍历结束后再释放, 使 replaced 中的键在本次 intern 中不会被复用
+        garbage.emplace_back(node, deleter);
+        duplicates ++;
+    }
+    return it->second;
+}
+
+ExprNode *HashConsTable::intern(ExprNode *root) {
+    Interner interner{*this};
+    walk_iterative(static_cast<const ExprNode *>(root), interner);
+
+    using Structural = detail::structural_t<ExprNode>;
+    const void *canonical = replaced.at(static_cast<const void *>(static_cast<Structural *>(root)));
+
+    for (auto &[node, deleter] : garbage) {
+        deleter(node);
+    }
+    garbage.clear();
+    replaced.clear();
+    return static_cast<ExprNode *>(static_cast<Structural *>(const_cast<void *>(canonical)));
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "parser/syntax.h"
+#include "parser/ast_visitor.h"
+
+#include <unordered_map>
+
+namespace rain {
+    // 结构共享的语法树
+    //
+    // intern 将结构相同的子树合并为同一个节点: 节点的类型, 子节点, 以及终结符的 token 类型与文本都相同即视为相同
+    // 合并后同一张表中两棵子树相等当且仅当指针相等, 每个节点的结构哈希也缓存在表中, 可以直接作为缓存的键
+    //
+    // 驻留后的树是一个有向无环图:
+    //   节点归表所有, 随表一起释放, 不能再用 destroy_tree 释放
+    //   节点不能再被修改, 常量折叠等改写树的 pass 需要在 intern 之前进行
+    //   相同文本的终结符只保留第一次出现的 token, 之后的位置信息不再可用
+    class HashConsTable {
+    public:
+        HashConsTable() = default;
+        ~HashConsTable();
+
+        HashConsTable(const HashConsTable &) = delete;
+        HashConsTable &operator=(const HashConsTable &) = delete;
+
+        // 驻留以 root 为根的树, 返回规范化的根
+        // 重复的节点在返回前释放, root 的所有权转移给表
+        ExprNode *intern(ExprNode *root);
+
+        // 已驻留节点的结构哈希
+        template<typename Node>
+        [[nodiscard]] uint64_t hash(const Node *node) const {
+            return hashes.at(static_cast<const void *>(static_cast<const detail::structural_t<Node> *>(node)));
+        }
+
+        // 表中不同的节点个数
+        [[nodiscard]] size_t size() const {
+            return owned.size();
+        }
+
+        // 因与已有节点相同而被释放的节点个数
+        [[nodiscard]] size_t merged() const {
+            return duplicates;
+        }
+
+        // 表中节点自身占用的字节数, 不含 ClosureNode 的子节点数组
+        [[nodiscard]] size_t node_bytes() const {
+            return bytes;
+        }
+
+    private:
+        // 描述一个节点的结构, 子节点均已驻留, 因此按指针比较即可
+        struct Shape {
+            const void *tag;            // 节点的组合子类型
+            uint64_t hash;
+            TokenType type = TokenType::NONE;
+            std::string_view text;
+            size_t index = 0;           // OptionsNode 选中的候选
+            std::vector<const void *> children;
+
+            bool operator==(const Shape &rhs) const {
+                return tag == rhs.tag && hash == rhs.hash && type == rhs.type && text == rhs.text
+                    && index == rhs.index && children == rhs.children;
+            }
+        };
+
+        struct ShapeHash {
+            size_t operator()(const Shape &shape) const {
+                return shape.hash;
+            }
+        };
+
+        // 后序遍历一棵树, 逐个驻留其中的节点
+        struct Interner;
+
+        // shape 已有规范节点时返回它并释放 node, 否则以 node 作为规范节点
+        const void *canonical(Shape &&shape, void *node, size_t size, void (*deleter)(void *));
+
+        std::unordered_map<Shape, const void *, ShapeHash> shapes;
+        std::unordered_map<const void *, uint64_t> hashes;
+        std::vector<std::pair<void *, void (*)(void *)>> owned;
+        size_t duplicates = 0;
+        size_t bytes = 0;
+
+        // 仅在一次 intern 期间有效
+        std::unordered_map<const void *, const void *> replaced;
+        std::vector<std::pair<void *, void (*)(void *)>> garbage;
+    };
+}
@@ -0,0 +1,244 @@
+#include "server/compile_server.h"
+
+#include "file/helper.h"
+#include "parser/ast_dot.h"
+#include "util/hash.h"
+#include "util/trace.h"
+
+#include <cerrno>
+#include <chrono>
+#include <sstream>
+
+#if defined(__unix__)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace rain;
+
+static constexpr size_t __max_request__ = 4096;
+// 服务端逐个处理连接, 一个不发送请求或不读取结果的客户端最多占用这么久
+static constexpr int __io_timeout_ms__ = 2000;
+
+CompileServer::CompileServer(std::string socket_path)
+    : socket_path(std::move(socket_path))
+{
+}
+
+CompileServer::~CompileServer() {
+#if defined(__unix__)
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+#endif
+}
+
+const Module *CompileServer::lookup(const std::string &path, std::string &error) {
+#if defined(__unix__)
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        error = std::format("{}: no such file", path);
+        return nullptr;
+    }
+    int64_t mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    uint64_t size = st.st_size;
+
+    Entry &entry = cache[path];
+    if (entry.module != nullptr && entry.mtime == mtime && entry.size == size) {
+        hits ++;
+        return entry.module.get();
+    }
+
+    try {
+        bytebuffer source = [&]() {
+            RAIN_TRACE_SPAN("read", path);
+            return readall(path.c_str());
+        }();
+        uint64_t hash = hash_bytes(source.data(), source.length());
+        entry.mtime = mtime;
+        entry.size = size;
+
+        // 只是被 touch 过, 内容没有变化
+        if (entry.module != nullptr && entry.hash == hash) {
+            rehashes ++;
+            return entry.module.get();
+        }
+
+        entry.hash = hash;
+        entry.module = std::make_unique<Module>(path);
+        analyses ++;
+        // 服务只回答单个文件的请求, 被导入的文件在被请求时才分析
+        analyze_module(*entry.module, std::move(source), [](const std::string &) {});
+        return entry.module.get();
+    }
+    catch (const std::exception &e) {
+        cache.erase(path);
+        error = std::format("{}: {}", path, e.what());
+        return nullptr;
+    }
+#else
+    error = "the compile server requires Unix domain sockets";
+    return nullptr;
+#endif
+}
+
+std::string CompileServer::handle(std::string_view request) {
+    size_t space = request.find(' ');
+    std::string_view command = request.substr(0, space);
+    std::string path = space == std::string_view::npos ? std::string() : ModuleLoader::canonical(std::string(request.substr(space + 1)));
+    RAIN_TRACE_SPAN("request", request);
+
+    if (command == "stop") {
+        stopping = true;
+        return "ok\n";
+    }
+    if (command == "stats") {
+        return std::format("ok\ncached: {}\nhits: {}\nunchanged after touch: {}\nanalyses: {}\n",
+                           cache.size(), hits, rehashes, analyses);
+    }
+    if (command != "check" && command != "tokens" && command != "ast") {
+        return std::format("error\nunknown command '{}'\n", command);
+    }
+    if (path.empty()) {
+        return std::format("error\n{} requires a path\n", command);
+    }
+
+    std::string error;
+    const Module *module = lookup(path, error);
+    if (module == nullptr) {
+        return std::format("error\n{}\n", error);
+    }
+    if (! module->error.empty()) {
+        return std::format("error\n{}\n", module->error);
+    }
+
+    std::string out = "ok\n";
+    if (command == "tokens") {
+        for (size_t i = 0 ; i < module->tokens.size() ; i ++) {
+            const Token *tok = module->tokens[i];
+            out += std::format("[{}](type: {}, content: \"{}\")\n", i + 1, tok->type, tok->content);
+        }
+    }
+    else if (command == "ast" && module->ast != nullptr) {
+        std::ostringstream dot;
+        generate_ast_dot(dot, module->ast);
+        out += dot.str();
+    }
+    return out;
+}
+
+bool CompileServer::serve() {
+#if defined(__unix__)
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        return false;
+    }
+    // 上一次没有正常退出时留下的 socket 文件
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listen_fd, 16) != 0) {
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+
+    while (! stopping) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+
+        // 整条请求须在期限内读完, 而不只是每次 read, 否则逐字节发送的客户端仍能一直占住服务
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(__io_timeout_ms__);
+        std::string request;
+        char chunk[512];
+        ssize_t n;
+        bool timed_out = false;
+        while (request.size() < __max_request__ && request.find('\n') == std::string::npos) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            pollfd pfd = {fd, POLLIN, 0};
+            int ready = remaining > 0 ? poll(&pfd, 1, static_cast<int>(remaining)) : 0;
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ready == 0) {
+                timed_out = true;
+                break;
+            }
+            if (ready < 0 || (n = read(fd, chunk, sizeof(chunk))) <= 0) {
+                break;
+            }
+            request.append(chunk, n);
+        }
+        request = request.substr(0, request.find('\n'));
+
+        // 写回结果同样有期限, 不读取结果的客户端不会让 send 一直阻塞
+        timeval timeout = {__io_timeout_ms__ / 1000, (__io_timeout_ms__ % 1000) * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        std::string response = timed_out ? "error\nrequest timed out\n" : handle(request);
+        for (size_t written = 0 ; written < response.size() ; ) {
+            n = send(fd, response.data() + written, response.size() - written, MSG_NOSIGNAL);
+            if (n <= 0) {
+                break;
+            }
+            written += n;
+        }
+        close(fd);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::optional<std::string> rain::send_request(const std::string &socket_path, std::string_view request) {
+#if defined(__unix__)
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        return std::nullopt;
+    }
+    memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return std::nullopt;
+    }
+
+    std::string line = std::string(request) + "\n";
+    for (size_t written = 0 ; written < line.size() ; ) {
+        ssize_t n = send(fd, line.data() + written, line.size() - written, MSG_NOSIGNAL);
+        if (n <= 0) {
+            close(fd);
+            return std::nullopt;
+        }
+        written += n;
+    }
+
+    std::string response;
+    char chunk[4096];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+        response.append(chunk, n);
+    }
+    close(fd);
+    return response;
+#else
+    return std::nullopt;
+#endif
+}
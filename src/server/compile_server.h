@@ -0,0 +1,59 @@
+#pragma once
+
+#include "module/module_loader.h"
+
+#include <optional>
+
+namespace rain {
+    // 常驻的编译服务, 在本地 Unix socket 上接受请求
+    //
+    // 以规范化路径为键缓存分析好的模块
+    // 文件的 mtime 与大小不变时直接使用缓存, 否则比较内容的哈希, 只有内容改变的文件才重新分析
+    //
+    // 每个连接发送一行请求, 服务端写回结果后关闭连接:
+    //   check  <path>   分析是否成功
+    //   tokens <path>   token 序列
+    //   ast    <path>   DOT 格式的语法树
+    //   stats           缓存的命中情况
+    //   stop            停止服务
+    // 结果的第一行为 "ok" 或 "error", 之后为正文
+    // 请求须在 2 秒内发送完, 否则返回 "error" 并关闭连接, 以免一个客户端挡住其他所有请求
+    class CompileServer {
+    public:
+        explicit CompileServer(std::string socket_path);
+        ~CompileServer();
+
+        CompileServer(const CompileServer &) = delete;
+        CompileServer &operator=(const CompileServer &) = delete;
+
+        // 在当前线程中逐个处理请求, 直到收到 stop
+        // 无法监听 socket_path 时返回 false
+        bool serve();
+
+        // 处理一条请求 (不含换行), 返回写回客户端的结果
+        std::string handle(std::string_view request);
+
+    private:
+        struct Entry {
+            int64_t mtime = 0;
+            uint64_t size = 0;
+            uint64_t hash = 0;
+            std::unique_ptr<Module> module;
+        };
+
+        std::string socket_path;
+        int listen_fd = -1;
+        bool stopping = false;
+
+        std::map<std::string, Entry> cache;
+        size_t hits = 0;
+        size_t rehashes = 0;    // mtime 改变但内容未变
+        size_t analyses = 0;
+
+        // 返回 path 对应的最新模块, 文件无法读取时返回 nullptr 并填写 error
+        const Module *lookup(const std::string &path, std::string &error);
+    };
+
+    // 向 socket_path 上的服务发送一条请求并返回结果, 无法连接时返回 std::nullopt
+    std::optional<std::string> send_request(const std::string &socket_path, std::string_view request);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace rain {
+    // 64 位整数混合 (murmur3 fmix64)
+    inline uint64_t hash_mix(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    inline uint64_t hash_combine(uint64_t seed, uint64_t value) {
+        return hash_mix(seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+    }
+
+    // 快速的非加密哈希, 每次读取 8 字节
+    inline uint64_t hash_bytes(const void *data, size_t size, uint64_t seed = 0) {
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        uint64_t h = seed ^ (size * 0x9e3779b97f4a7c15ULL);
+
+        while (size >= 8) {
+            uint64_t word;
+            memcpy(&word, p, 8);
+            h = (h ^ hash_mix(word)) * 0x9e3779b97f4a7c15ULL;
+            h = (h << 31) | (h >> 33);
+            p += 8;
+            size -= 8;
+        }
+
+        uint64_t tail = 0;
+        memcpy(&tail, p, size);
+        h ^= hash_mix(tail ^ size);
+
+        return hash_mix(h);
+    }
+}
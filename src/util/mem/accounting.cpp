@@ -0,0 +1,152 @@
+#include "util/mem/accounting.h"
+
+#ifdef RAIN_MEM_ACCOUNTING
+
+#include <cstdlib>
+#include <format>
+#include <new>
+
+using namespace rain::mem;
+
+namespace {
+    struct AtomicCategory {
+        std::atomic<size_t> live_bytes;
+        std::atomic<size_t> peak_bytes;
+        std::atomic<size_t> live_objects;
+        std::atomic<size_t> total_objects;
+    };
+
+    struct AtomicPhase {
+        std::atomic<size_t> news;
+        std::atomic<size_t> new_bytes;
+    };
+}
+
+// 零初始化, 在任何静态对象构造之前就可以使用
+constinit static AtomicCategory __categories__[static_cast<size_t>(Category::COUNT)] = {};
+constinit static AtomicPhase __phases__[static_cast<size_t>(Phase::COUNT)] = {};
+constinit static thread_local Phase __current_phase__ = Phase::OTHER;
+
+void Accounting::allocated(Category category, size_t bytes) {
+    AtomicCategory &stats = __categories__[static_cast<size_t>(category)];
+    size_t live = stats.live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    stats.live_objects.fetch_add(1, std::memory_order_relaxed);
+    stats.total_objects.fetch_add(1, std::memory_order_relaxed);
+
+    size_t peak = stats.peak_bytes.load(std::memory_order_relaxed);
+    while (live > peak && ! stats.peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void Accounting::freed(Category category, size_t bytes) {
+    AtomicCategory &stats = __categories__[static_cast<size_t>(category)];
+    stats.live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    stats.live_objects.fetch_sub(1, std::memory_order_relaxed);
+}
+
+CategoryStats Accounting::category(Category category) {
+    const AtomicCategory &stats = __categories__[static_cast<size_t>(category)];
+    return {
+        stats.live_bytes.load(std::memory_order_relaxed),
+        stats.peak_bytes.load(std::memory_order_relaxed),
+        stats.live_objects.load(std::memory_order_relaxed),
+        stats.total_objects.load(std::memory_order_relaxed)
+    };
+}
+
+PhaseStats Accounting::phase(Phase phase) {
+    const AtomicPhase &stats = __phases__[static_cast<size_t>(phase)];
+    return {
+        stats.news.load(std::memory_order_relaxed),
+        stats.new_bytes.load(std::memory_order_relaxed)
+    };
+}
+
+Phase Accounting::current() {
+    return __current_phase__;
+}
+
+Phase Accounting::enter(Phase phase) {
+    Phase previous = __current_phase__;
+    __current_phase__ = phase;
+    return previous;
+}
+
+void Accounting::leave(Phase previous) {
+    __current_phase__ = previous;
+}
+
+const char *Accounting::category_name(Category category) {
+    switch (category) {
+    case Category::TOKEN: return "tokens";
+    case Category::POSITION: return "positions";
+    case Category::KEYWORD_TABLE: return "keyword tables";
+    case Category::AST_NODE: return "ast nodes";
+    case Category::SOURCE_BUFFER: return "source buffers";
+    default: break;
+    }
+    return "<unknown>";
+}
+
+const char *Accounting::phase_name(Phase phase) {
+    switch (phase) {
+    case Phase::OTHER: return "other";
+    case Phase::SETUP: return "setup";
+    case Phase::LEX: return "lex";
+    case Phase::PARSE: return "parse";
+    case Phase::PASS: return "pass";
+    case Phase::CODEGEN: return "codegen";
+    default: break;
+    }
+    return "<unknown>";
+}
+
+std::string Accounting::dump_text() {
+    std::string out = std::format("{:<16} {:>12} {:>12} {:>12} {:>12}\n",
+                                  "category", "live bytes", "peak bytes", "live objs", "total objs");
+    for (size_t i = 0 ; i < static_cast<size_t>(Category::COUNT) ; i ++) {
+        CategoryStats stats = category(static_cast<Category>(i));
+        out += std::format("{:<16} {:>12} {:>12} {:>12} {:>12}\n",
+                           category_name(static_cast<Category>(i)),
+                           stats.live_bytes, stats.peak_bytes, stats.live_objects, stats.total_objects);
+    }
+
+    out += std::format("\n{:<16} {:>12} {:>12}\n", "phase", "new calls", "new bytes");
+    for (size_t i = 0 ; i < static_cast<size_t>(Phase::COUNT) ; i ++) {
+        PhaseStats stats = phase(static_cast<Phase>(i));
+        out += std::format("{:<16} {:>12} {:>12}\n", phase_name(static_cast<Phase>(i)), stats.news, stats.new_bytes);
+    }
+    return out;
+}
+
+// 替换全局 operator new 以统计调用次数
+// 其余形式 (数组, nothrow) 在 libstdc++ 中都转发到这里, 对应的 operator delete 一并替换为 free
+void *operator new(size_t size) {
+    AtomicPhase &stats = __phases__[static_cast<size_t>(__current_phase__)];
+    stats.news.fetch_add(1, std::memory_order_relaxed);
+    stats.new_bytes.fetch_add(size, std::memory_order_relaxed);
+
+    if (size == 0) {
+        size = 1;
+    }
+    while (true) {
+        if (void *ptr = std::malloc(size)) {
+            return ptr;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+#endif
@@ -0,0 +1,137 @@
+#pragma once
+
+// 内存统计, 仅在定义 RAIN_MEM_ACCOUNTING 时编译
+// 按类别统计存活字节数, 峰值与对象数, 并按阶段统计全局 operator new 的调用次数
+// 未定义时 RAIN_MEM_ALLOC / RAIN_MEM_FREE / RAIN_MEM_PHASE 展开为空, Tracked 为空基类
+
+#include <cstddef>
+#include <string>
+
+#ifdef RAIN_MEM_ACCOUNTING
+#include <atomic>
+#endif
+
+namespace rain {
+    namespace mem {
+        enum class Category {
+            TOKEN = 0,
+            POSITION,
+            KEYWORD_TABLE,
+            AST_NODE,
+            SOURCE_BUFFER,
+            COUNT
+        };
+
+        enum class Phase {
+            OTHER = 0,
+            SETUP,      // 只发生一次的初始化, 例如构建关键字表
+            LEX,
+            PARSE,
+            PASS,
+            CODEGEN,
+            COUNT
+        };
+
+        // std::string 在堆上占用的字节数, 短字符串存放在对象内部时为 0
+        inline size_t heap_bytes(const std::string &str) {
+            const char *data = str.data();
+            const char *self = reinterpret_cast<const char *>(&str);
+            if (data >= self && data < self + sizeof(str)) {
+                return 0;
+            }
+            return str.capacity() + 1;
+        }
+
+#ifdef RAIN_MEM_ACCOUNTING
+        struct CategoryStats {
+            size_t live_bytes;
+            size_t peak_bytes;
+            size_t live_objects;
+            size_t total_objects;
+        };
+
+        struct PhaseStats {
+            size_t news;        // operator new 的调用次数
+            size_t new_bytes;   // operator new 申请的字节数
+        };
+
+        // 计数在所有线程间共享
+        class Accounting {
+        public:
+            static void allocated(Category category, size_t bytes);
+            static void freed(Category category, size_t bytes);
+
+            static CategoryStats category(Category category);
+            static PhaseStats phase(Phase phase);
+
+            // 当前线程所处的阶段, 全局 operator new 将调用计入该阶段
+            static Phase current();
+            static Phase enter(Phase phase);
+            static void leave(Phase previous);
+
+            static const char *category_name(Category category);
+            static const char *phase_name(Phase phase);
+
+            static std::string dump_text();
+        };
+
+        // 在作用域内切换当前线程的阶段, 离开时恢复, 因此可以嵌套
+        // 例如按需分析 token 时, parse 阶段中的分析仍计入 lex 阶段
+        class PhaseScope {
+        private:
+            Phase previous;
+        public:
+            PhaseScope(Phase phase)
+                : previous(Accounting::enter(phase))
+            {
+            }
+
+            ~PhaseScope() {
+                Accounting::leave(previous);
+            }
+        };
+
+        // 统计 T 的对象, 按 sizeof(T) 计算大小
+        // 用作 T 的基类, 拷贝与移动构造的对象同样计入
+        template<typename T, Category C>
+        struct Tracked {
+            Tracked() {
+                Accounting::allocated(C, sizeof(T));
+            }
+
+            Tracked(const Tracked &) {
+                Accounting::allocated(C, sizeof(T));
+            }
+
+            Tracked &operator=(const Tracked &) = default;
+
+            ~Tracked() {
+                Accounting::freed(C, sizeof(T));
+            }
+        };
+#else
+        template<typename T, Category C>
+        struct Tracked {
+        };
+#endif
+    }
+}
+
+#ifdef RAIN_MEM_ACCOUNTING
+
+#define RAIN_MEM_ALLOC(category, bytes) \
+    rain::mem::Accounting::allocated(rain::mem::Category::category, (bytes))
+
+#define RAIN_MEM_FREE(category, bytes) \
+    rain::mem::Accounting::freed(rain::mem::Category::category, (bytes))
+
+#define RAIN_MEM_PHASE(phase) \
+    rain::mem::PhaseScope __mem_phase_scope__(rain::mem::Phase::phase)
+
+#else
+
+#define RAIN_MEM_ALLOC(category, bytes) ((void) 0)
+#define RAIN_MEM_FREE(category, bytes) ((void) 0)
+#define RAIN_MEM_PHASE(phase) ((void) 0)
+
+#endif
@@ -1,16 +1,81 @@
 #pragma once
 
 #include <cstddef>
+#include <climits>
+#include <cstring>
 #include <stdexcept>
 #include <iostream>
 
+#include "util/mem/accounting.h"
+
 namespace rain {
+    // 不做边界检查的扫描游标
+    // 依赖 bytebuffer 末尾的零填充区, 读到 '\0' 即视为输入结束
+    class bytecursor {
+    private:
+        const char *base;
+        const char *ptr;
+        const char *limit;
+    public:
+        bytecursor(const char *base, size_t pos, size_t size)
+            : base(base), ptr(base + pos), limit(base + size)
+        {
+        }
+
+        template<int N = 0>
+        [[nodiscard]] char peek() const {
+            return ptr[N];
+        }
+
+        [[nodiscard]] char peek(int offset) const {
+            return ptr[offset];
+        }
+
+        void advance(int increasement = 1) {
+            ptr += increasement;
+        }
+
+        // 只在读到 '\0' 时调用, 用于区分源码中的 '\0' 与真正的结尾
+        [[nodiscard]] bool at_end() const {
+            return ptr >= limit;
+        }
+
+        [[nodiscard]] const char *raw() const {
+            return ptr;
+        }
+
+        [[nodiscard]] size_t pos() const {
+            return ptr - base;
+        }
+
+        std::string slice(size_t start) const {
+            const char *end = ptr < limit ? ptr : limit;
+            if (end < base + start) {
+                return std::string();
+            }
+            return std::string(base + start, end);
+        }
+    };
+
     class bytebuffer {
     private:
         size_t size;
         char *buffer;
         size_t ptr = 0;
     public:
+        // 缓冲区末尾至少保留 PADDING 个 '\0'
+        // 词法分析器的 lookahead 最多 10 字节, 64 字节足够覆盖
+        static constexpr size_t PADDING = 64;
+
+        // 分配 size + PADDING 字节, 并将末尾填零
+        static char *allocate(size_t size) {
+            char *buffer = new char[size + PADDING];
+            memset(buffer + size, 0, PADDING);
+            RAIN_MEM_ALLOC(SOURCE_BUFFER, size + PADDING);
+            return buffer;
+        }
+
+        // buffer 必须由 allocate 分配
         bytebuffer(size_t size, char *buffer)
             : size(size), buffer(buffer)
         {
@@ -23,13 +88,16 @@ namespace rain {
         }
 
         bytebuffer(const std::string &str)
-            : size(str.size()), buffer(new char[str.size()])
+            : size(str.size()), buffer(allocate(str.size()))
         {
+            memcpy(buffer, str.data(), str.size());
         }
 
         ~bytebuffer() {
-            if (buffer != nullptr)
+            if (buffer != nullptr) {
                 delete[] buffer;
+                RAIN_MEM_FREE(SOURCE_BUFFER, size + PADDING);
+            }
         }
 
         [[nodiscard]] bool valid_ptr(size_t ptr) const {
@@ -75,6 +143,24 @@ namespace rain {
             return ptr;
         }
 
+        size_t length() const {
+            return size;
+        }
+
+        const char *data() const {
+            return buffer;
+        }
+
+        // 从当前位置开始扫描
+        bytecursor scan() const {
+            return bytecursor(buffer, ptr, size);
+        }
+
+        // 将游标的位置写回, 越过结尾的部分截断到 size
+        void sync(const bytecursor &cursor) {
+            ptr = cursor.pos() < size ? cursor.pos() : size;
+        }
+
         std::string slice(size_t start, size_t end = INT_MAX) const {
             end = (end == INT_MAX) ? ptr : end;
             if (end < start) {
@@ -86,4 +172,4 @@ namespace rain {
             return std::string(data);
         }
     };
-}
\ No newline at end of file
+}
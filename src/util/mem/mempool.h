@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <vector>
 using std::vector;
 
@@ -19,6 +20,22 @@ namespace rain {
                 objects.push_back(token);
             }
 
+            // 接管 other 中的所有对象, 用于把一个线程创建的对象转交给另一个线程
+            // 调用者负责两个线程之间的同步, 例如在 join 之后调用
+            void adopt(Pool &other) {
+                objects.insert(objects.end(), other.objects.begin(), other.objects.end());
+                other.objects.clear();
+            }
+
+            // 交出 obj 的所有权, 之后由调用者负责释放
+            // 从最近 mark 的对象向前查找, 刚创建的对象只需比较一次
+            void unmark(T *obj) {
+                auto it = std::find(objects.rbegin(), objects.rend(), obj);
+                if (it != objects.rend()) {
+                    objects.erase(std::next(it).base());
+                }
+            }
+
             void cleanup() {
                 for (T *obj : objects)
                     delete obj;
@@ -0,0 +1,148 @@
+#include "util/perf_counters.h"
+
+#include <chrono>
+#include <format>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace rain;
+
+#if defined(__linux__)
+static int __open_event__(uint32_t type, uint64_t config) {
+    perf_event_attr attr = {};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // 计数器多于硬件槽位时内核会轮流调度, 读取时据此放大
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    return fd;
+}
+
+static constexpr uint64_t __cache_miss__(uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+#endif
+
+PerfCounters::PerfCounters() {
+    for (int &fd : fds) {
+        fd = -1;
+    }
+#if defined(__linux__)
+    fds[CYCLES] = __open_event__(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[INSTRUCTIONS] = __open_event__(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[BRANCH_MISSES] = __open_event__(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    fds[L1D_MISSES] = __open_event__(PERF_TYPE_HW_CACHE, __cache_miss__(PERF_COUNT_HW_CACHE_L1D));
+    fds[LLC_MISSES] = __open_event__(PERF_TYPE_HW_CACHE, __cache_miss__(PERF_COUNT_HW_CACHE_LL));
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#if defined(__linux__)
+    for (int fd : fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+bool PerfCounters::any_available() const {
+    for (int fd : fds) {
+        if (fd >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+PerfCounters::Sample PerfCounters::read() const {
+    Sample sample;
+    sample.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+#if defined(__linux__)
+    for (int i = 0 ; i < EVENT_COUNT ; i ++) {
+        if (fds[i] < 0) {
+            continue;
+        }
+        // value, time_enabled, time_running
+        uint64_t data[3] = {};
+        if (::read(fds[i], data, sizeof(data)) != sizeof(data)) {
+            continue;
+        }
+        sample.values[i] = (data[2] == 0 || data[2] == data[1])
+            ? data[0]
+            : static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]);
+    }
+#endif
+    return sample;
+}
+
+const char *PerfCounters::event_name(Event event) {
+    switch (event) {
+    case CYCLES: return "cycles";
+    case INSTRUCTIONS: return "instructions";
+    case BRANCH_MISSES: return "branch-misses";
+    case L1D_MISSES: return "L1D-misses";
+    case LLC_MISSES: return "LLC-misses";
+    default: break;
+    }
+    return "<unknown>";
+}
+
+PerfPhases::Scope::~Scope() {
+    PerfCounters::Sample end = phases.counters.read();
+    Phase phase{std::move(name), {}, processed, std::move(unit)};
+    phase.delta.ns = end.ns - begin.ns;
+    for (int i = 0 ; i < PerfCounters::EVENT_COUNT ; i ++) {
+        phase.delta.values[i] = end.values[i] - begin.values[i];
+    }
+    phases.recorded.push_back(std::move(phase));
+}
+
+std::string PerfPhases::dump_text() const {
+    std::string out;
+    if (! counters.any_available()) {
+        out += "hardware counters unavailable, reporting wall-clock time only\n";
+    }
+
+    out += std::format("{:<8} {:>10} {:>10} {:>6}", "phase", "time ms", "units", "IPC");
+    for (int i = 0 ; i < PerfCounters::EVENT_COUNT ; i ++) {
+        if (i != PerfCounters::INSTRUCTIONS) {
+            out += std::format(" {:>14}", std::format("{}/unit", PerfCounters::event_name(static_cast<PerfCounters::Event>(i))));
+        }
+    }
+    out += "\n";
+
+    for (const Phase &phase : recorded) {
+        const PerfCounters::Sample &d = phase.delta;
+        std::string ipc = "-";
+        if (counters.available(PerfCounters::CYCLES) && counters.available(PerfCounters::INSTRUCTIONS) && d.values[PerfCounters::CYCLES] > 0) {
+            ipc = std::format("{:.2f}", static_cast<double>(d.values[PerfCounters::INSTRUCTIONS]) / d.values[PerfCounters::CYCLES]);
+        }
+
+        out += std::format("{:<8} {:>10.3f} {:>10} {:>6}", phase.name, d.ns / 1e6,
+                           std::format("{} {}", phase.units, phase.unit), ipc);
+        for (int i = 0 ; i < PerfCounters::EVENT_COUNT ; i ++) {
+            if (i == PerfCounters::INSTRUCTIONS) {
+                continue;
+            }
+            if (! counters.available(static_cast<PerfCounters::Event>(i)) || phase.units == 0) {
+                out += std::format(" {:>14}", "-");
+            } else {
+                out += std::format(" {:>14.3f}", static_cast<double>(d.values[i]) / phase.units);
+            }
+        }
+        out += "\n";
+    }
+    return out;
+}
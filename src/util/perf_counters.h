@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace rain {
+    // 基于 perf_event_open 的硬件计数器
+    // 只统计当前线程的用户态事件, 打不开的计数器 (如在容器中或非 Linux 系统上) 跳过, 只剩时钟时照常计时
+    class PerfCounters {
+    public:
+        enum Event {
+            CYCLES = 0,
+            INSTRUCTIONS,
+            BRANCH_MISSES,
+            L1D_MISSES,
+            LLC_MISSES,
+            EVENT_COUNT
+        };
+
+        struct Sample {
+            uint64_t ns = 0;
+            uint64_t values[EVENT_COUNT] = {};
+        };
+
+        PerfCounters();
+        ~PerfCounters();
+
+        PerfCounters(const PerfCounters &) = delete;
+        PerfCounters &operator=(const PerfCounters &) = delete;
+
+        [[nodiscard]] bool available(Event event) const {
+            return fds[event] >= 0;
+        }
+
+        // 是否至少有一个硬件计数器可用
+        [[nodiscard]] bool any_available() const;
+
+        // 当前的累计值, 计数器被复用时按实际运行的时间比例放大
+        [[nodiscard]] Sample read() const;
+
+        static const char *event_name(Event event);
+
+    private:
+        int fds[EVENT_COUNT];
+    };
+
+    // 按阶段记录计数器的差值
+    class PerfPhases {
+    public:
+        struct Phase {
+            std::string name;
+            PerfCounters::Sample delta;
+            size_t units;
+            std::string unit;
+        };
+
+        // 一个阶段, 析构时记录
+        class Scope {
+        public:
+            Scope(PerfPhases &phases, std::string name, std::string unit)
+                : phases(phases), name(std::move(name)), unit(std::move(unit)), begin(phases.counters.read())
+            {
+            }
+
+            ~Scope();
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+            // 本阶段处理的单位数 (字节, token, 节点), 用于计算每单位的开销
+            void units(size_t count) {
+                processed = count;
+            }
+
+        private:
+            PerfPhases &phases;
+            std::string name;
+            std::string unit;
+            PerfCounters::Sample begin;
+            size_t processed = 0;
+        };
+
+        [[nodiscard]] Scope scope(std::string name, std::string unit) {
+            return Scope(*this, std::move(name), std::move(unit));
+        }
+
+        // 补上最近记录的阶段的单位数, 用于阶段结束后才能统计的情况
+        void units(size_t count) {
+            if (! recorded.empty()) {
+                recorded.back().units = count;
+            }
+        }
+
+        [[nodiscard]] const std::vector<Phase> &phases() const {
+            return recorded;
+        }
+
+        // 每个阶段的时间, IPC 与每单位的周期数和缺失数
+        std::string dump_text() const;
+
+    private:
+        PerfCounters counters;
+        std::vector<Phase> recorded;
+    };
+}
@@ -0,0 +1,143 @@
+#include "util/trace.h"
+#include "util/utf8.h"
+
+#ifdef RAIN_TRACE
+
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace rain;
+
+std::atomic<bool> trace::active = false;
+
+namespace {
+    struct Event {
+        const char *name;
+        uint64_t begin;
+        uint64_t end;
+        char detail[64];
+    };
+
+    // 单写者的环形缓冲区, 只有所属线程写入
+    // head 单调递增, 写完一条记录后以 release 发布, 读者以 acquire 读取
+    struct Buffer {
+        static constexpr size_t CAPACITY = 1 << 14;
+
+        size_t tid;
+        std::string name;
+        std::atomic<uint64_t> head = 0;
+        Event events[CAPACITY];
+    };
+}
+
+static std::mutex __registry_mutex__;
+static std::vector<std::unique_ptr<Buffer>> __buffers__;
+static std::chrono::steady_clock::time_point __epoch__;
+static thread_local Buffer *__local__ = nullptr;
+
+// 线程第一次记录时注册自己的缓冲区, 缓冲区在线程退出后仍然保留, 直到写出
+static Buffer &__local_buffer__() {
+    if (__local__ == nullptr) [[unlikely]] {
+        auto buffer = std::make_unique<Buffer>();
+        std::lock_guard lock(__registry_mutex__);
+        buffer->tid = __buffers__.size() + 1;
+        buffer->name = std::format("thread {}", buffer->tid);
+        __local__ = buffer.get();
+        __buffers__.push_back(std::move(buffer));
+    }
+    return *__local__;
+}
+
+void trace::start() {
+    __epoch__ = std::chrono::steady_clock::now();
+    active.store(true, std::memory_order_relaxed);
+}
+
+uint64_t trace::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - __epoch__).count();
+}
+
+void trace::record(const char *name, std::string_view detail, uint64_t begin, uint64_t end) {
+    Buffer &buffer = __local_buffer__();
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    Event &event = buffer.events[head % Buffer::CAPACITY];
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+    size_t length = std::min(detail.size(), sizeof(event.detail) - 1);
+    // 截断时退回到码点边界, 不在 JSON 中留下半个 UTF-8 序列
+    if (length < detail.size()) {
+        while (length > 0 && utf8_is_continuation(detail[length])) {
+            length --;
+        }
+    }
+    memcpy(event.detail, detail.data(), length);
+    event.detail[length] = '\0';
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void trace::thread_name(std::string_view name) {
+    if (! enabled()) {
+        return;
+    }
+    Buffer &buffer = __local_buffer__();
+    std::lock_guard lock(__registry_mutex__);
+    buffer.name = name;
+}
+
+static std::string __escape__(std::string_view str) {
+    std::string out;
+    for (char ch : str) {
+        if (ch == '"' || ch == '\\') {
+            out += '\\';
+            out += ch;
+        }
+        else if (static_cast<unsigned char>(ch) < 0x20) {
+            out += std::format("\\u{:04x}", static_cast<int>(ch));
+        }
+        else {
+            out += ch;
+        }
+    }
+    return out;
+}
+
+long long trace::write_json(const std::string &path) {
+    std::ofstream out(path);
+    if (! out) {
+        return -1;
+    }
+
+    std::lock_guard lock(__registry_mutex__);
+    long long spans = 0;
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+    out << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"Rain\"}}";
+    for (const auto &buffer : __buffers__) {
+        out << std::format(",\n{{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": {}, \"args\": {{\"name\": \"{}\"}}}}",
+                           buffer->tid, __escape__(buffer->name));
+
+        // 被覆盖的记录已经丢失, 只输出最后 CAPACITY 条
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t first = head > Buffer::CAPACITY ? head - Buffer::CAPACITY : 0;
+        for (uint64_t i = first ; i < head ; i ++) {
+            const Event &event = buffer->events[i % Buffer::CAPACITY];
+            // 时间戳以微秒为单位
+            out << std::format(",\n{{\"name\": \"{}\", \"cat\": \"rain\", \"ph\": \"X\", \"pid\": 1, \"tid\": {}, \"ts\": {:.3f}, \"dur\": {:.3f}",
+                               event.name, buffer->tid, event.begin / 1e3, (event.end - event.begin) / 1e3);
+            if (event.detail[0] != '\0') {
+                out << std::format(", \"args\": {{\"detail\": \"{}\"}}", __escape__(event.detail));
+            }
+            out << "}";
+            spans ++;
+        }
+    }
+    out << "\n]}\n";
+    return out ? spans : -1;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#pragma once
+
+// 时间线追踪, 导出为 Chrome trace-event 格式的 JSON, 可以直接用 Perfetto 打开
+// 仅在定义 RAIN_TRACE 时编译, 未定义时 RAIN_TRACE_SPAN 展开为空
+//
+// 每个线程把 span 写入自己的环形缓冲区, 写入不加锁, 写满后覆盖最早的记录
+// 编译进来但未开启时, 一个 span 的开销只是一次预测为不成立的分支
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#ifdef RAIN_TRACE
+#include <atomic>
+#endif
+
+namespace rain {
+    namespace trace {
+#ifdef RAIN_TRACE
+        extern std::atomic<bool> active;
+
+        [[nodiscard]] inline bool enabled() {
+            return active.load(std::memory_order_relaxed);
+        }
+
+        // 开始记录, 之后的时间戳相对于此刻
+        void start();
+
+        // 单调时钟, 单位为纳秒
+        [[nodiscard]] uint64_t now();
+
+        // 记录当前线程的一个 span, detail 超出长度时在码点边界处截断
+        void record(const char *name, std::string_view detail, uint64_t begin, uint64_t end);
+
+        // 当前线程在时间线上显示的名字, 默认为 "thread N"
+        void thread_name(std::string_view name);
+
+        // 把所有线程已记录的 span 写入 path, 应当在各线程结束记录之后调用
+        // 返回写出的 span 个数, 无法写入时返回 -1
+        long long write_json(const std::string &path);
+
+        // 作用域内的一个 span, name 须为字符串常量, detail 须在 span 结束前保持有效
+        class Span {
+        private:
+            const char *name = nullptr;
+            std::string_view detail;
+            uint64_t begin;
+        public:
+            explicit Span(const char *name, std::string_view detail = {}) {
+                if (enabled()) [[unlikely]] {
+                    this->name = name;
+                    this->detail = detail;
+                    begin = now();
+                }
+            }
+
+            ~Span() {
+                if (name != nullptr) [[unlikely]] {
+                    record(name, detail, begin, now());
+                }
+            }
+
+            Span(const Span &) = delete;
+            Span &operator=(const Span &) = delete;
+        };
+#else
+        [[nodiscard]] inline bool enabled() {
+            return false;
+        }
+
+        inline void thread_name(std::string_view name) {
+        }
+#endif
+    }
+}
+
+#ifdef RAIN_TRACE
+
+#define RAIN_TRACE_SPAN(...) \
+    rain::trace::Span __trace_span__(__VA_ARGS__)
+
+#else
+
+#define RAIN_TRACE_SPAN(...) ((void) 0)
+
+#endif
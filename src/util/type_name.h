@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string_view>
+
+namespace rain {
+    namespace detail {
+        template<typename T>
+        constexpr std::string_view raw_type_name() {
+#if defined(__clang__)
+            constexpr std::string_view name = __PRETTY_FUNCTION__;
+            constexpr std::string_view prefix = "[T = ";
+            constexpr std::string_view suffix = "]";
+#elif defined(__GNUC__)
+            constexpr std::string_view name = __PRETTY_FUNCTION__;
+            constexpr std::string_view prefix = "[with T = ";
+            constexpr std::string_view suffix = ";";
+#elif defined(_MSC_VER)
+            constexpr std::string_view name = __FUNCSIG__;
+            constexpr std::string_view prefix = "raw_type_name<";
+            constexpr std::string_view suffix = ">(void)";
+#endif
+            constexpr size_t begin = name.find(prefix) + prefix.size();
+            constexpr size_t end = name.find(suffix, begin);
+            return name.substr(begin, end - begin);
+        }
+    }
+
+    // 编译期得到的类型名, 如 "rain::AddExprNode"
+    template<typename T>
+    inline constexpr std::string_view type_name_v = detail::raw_type_name<T>();
+
+    // 去掉命名空间的类型名, 如 "AddExprNode"; 模板类型保持原样
+    template<typename T>
+    inline constexpr std::string_view short_type_name_v = [] {
+        constexpr std::string_view name = type_name_v<T>;
+        if constexpr (name.find('<') != std::string_view::npos) {
+            return name;
+        } else {
+            constexpr size_t colon = name.rfind("::");
+            return colon == std::string_view::npos ? name : name.substr(colon + 2);
+        }
+    }();
+}
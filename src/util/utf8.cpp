@@ -0,0 +1,58 @@
+#include "util/utf8.h"
+
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace rain;
+
+// data 开头的 32 字节是否全是 ASCII
+static bool __ascii_chunk__(const char *data) {
+#if defined(__AVX2__)
+    __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+    return _mm256_movemask_epi8(chunk) == 0;
+#elif defined(__SSE2__)
+    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16));
+    return _mm_movemask_epi8(_mm_or_si128(lo, hi)) == 0;
+#else
+    uint64_t words[4];
+    memcpy(words, data, sizeof(words));
+    return ((words[0] | words[1] | words[2] | words[3]) & 0x8080808080808080ULL) == 0;
+#endif
+}
+
+size_t rain::utf8_validate(const char *data, size_t size) {
+    static constexpr size_t CHUNK = 32;
+
+    size_t i = 0;
+    while (i < size) {
+        if (i + CHUNK <= size && __ascii_chunk__(data + i)) {
+            i += CHUNK;
+            continue;
+        }
+
+        // 逐个码点检查, 直到下一个可能的 ASCII 块
+        size_t stop = i + CHUNK < size ? i + CHUNK : size;
+        while (i < stop) {
+            unsigned char ch = static_cast<unsigned char>(data[i]);
+            if (ch < 0x80) {
+                i ++;
+                continue;
+            }
+
+            // 不依赖零填充, 末尾被截断的序列视为非法
+            char seq[4] = {};
+            memcpy(seq, data + i, size - i < 4 ? size - i : 4);
+
+            int length;
+            if (utf8_decode(seq, length) == UTF8_INVALID) {
+                return i;
+            }
+            i += length;
+        }
+    }
+    return size;
+}
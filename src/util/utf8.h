@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "util/xid_table.h"
+
+namespace rain {
+    constexpr uint32_t UTF8_INVALID = 0xFFFFFFFF;
+
+    // 检查 data 是否为合法的 UTF-8 (RFC 3629: 无过长编码, 无代理项, 不超过 U+10FFFF)
+    // 返回第一个非法序列的偏移, 全部合法时返回 size
+    // 纯 ASCII 的块按 16/32 字节整块跳过
+    size_t utf8_validate(const char *data, size_t size);
+
+    constexpr bool utf8_is_continuation(char ch) {
+        return (static_cast<unsigned char>(ch) & 0xC0) == 0x80;
+    }
+
+    // 解码 p 处的一个码点, length 为其字节数
+    // 非法序列返回 UTF8_INVALID, length 为 1
+    // 读到 '\0' 时一定停止, 因此可以直接用于零填充的缓冲区, 也可以在常量求值中用于以 '\0' 结尾的数组
+    constexpr uint32_t utf8_decode(const char *p, int &length) {
+        auto s = [p](int i) {
+            return static_cast<unsigned char>(p[i]);
+        };
+        uint32_t cp = 0;
+        uint32_t min = 0;
+
+        length = 1;
+        if (s(0) < 0x80) {
+            return s(0);
+        }
+        else if ((s(0) & 0xE0) == 0xC0) {
+            cp = s(0) & 0x1F;
+            length = 2;
+            min = 0x80;
+        }
+        else if ((s(0) & 0xF0) == 0xE0) {
+            cp = s(0) & 0x0F;
+            length = 3;
+            min = 0x800;
+        }
+        else if ((s(0) & 0xF8) == 0xF0) {
+            cp = s(0) & 0x07;
+            length = 4;
+            min = 0x10000;
+        }
+        else {
+            return UTF8_INVALID;
+        }
+
+        for (int i = 1 ; i < length ; i ++) {
+            if ((s(i) & 0xC0) != 0x80) {
+                length = 1;
+                return UTF8_INVALID;
+            }
+            cp = (cp << 6) | (s(i) & 0x3F);
+        }
+
+        if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+            length = 1;
+            return UTF8_INVALID;
+        }
+        return cp;
+    }
+
+    constexpr bool is_xid_start(uint32_t cp) {
+        if (cp >= 0x40000) {
+            return false;
+        }
+        const detail::XidBlock &block = detail::xid_blocks[detail::xid_index[cp >> 7]];
+        return (block.start[(cp >> 6) & 1] >> (cp & 63)) & 1;
+    }
+
+    constexpr bool is_xid_continue(uint32_t cp) {
+        if (cp >= 0x40000) {
+            // 变体选择符补充区是唯一位于表外的 XID_Continue
+            return cp >= 0xE0100 && cp <= 0xE01EF;
+        }
+        const detail::XidBlock &block = detail::xid_blocks[detail::xid_index[cp >> 7]];
+        return (block.cont[(cp >> 6) & 1] >> (cp & 63)) & 1;
+    }
+}
@@ -9,9 +9,11 @@
 #include <cassert>
 #include <format>
 #include <functional>
+#include <cstdint>
 
 #include "util/mem/bytebuffer.h"
 #include "util/mem/mempool.h"
+#include "util/mem/accounting.h"
 
 using std::pair;
 using std::string;